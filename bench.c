@@ -0,0 +1,572 @@
+/*
+  Micro-benchmarks of the AI on synthetic boards: the time per call (ns) of each strategy of player.c and of the
+  helpers every move goes through, so that a change which makes the moves slower shows up before it is played.
+  The boards are rectangles of the sizes of the shipped levels and larger ones, with a snake laid out as a random
+  self-avoiding walk filling a share of the free cells, and a bonus on a random free cell. Every function is timed
+  on the same boards (the same seed gives the same boards), best of 7 runs (RUNS), and averaged over the boards of a size
+  and fill ratio. bench.c includes player.c itself, so that its static functions can be called one by one.
+
+  Build:
+    gcc -std=c99 -Wall -O2 -o bench bench.c snake_sim.c
+  Usage:
+    ./bench [-boards integer] [-seed integer] [-sizes list] [-fills list] [-only name]
+            [-save file] [-compare file] [-threshold percent]
+  -sizes is a list of sizes such as 10x5,20x10 and -fills a list of percents of free cells held by the snake,
+  -only keeps the functions whose name contains a text (e.g. -only move: for the whole moves).
+  -save writes the results as a baseline; -compare reads a baseline and flags every function whose median time over
+  the boards is slower than it by more than -threshold percent (10 by default), and then exits with status 1.
+*/
+#include "player.c" // the AI, with its static functions (so player.c is not linked)
+
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t
+#include <stdio.h> // printf, fprintf, fopen
+#include <stdlib.h> // malloc, calloc, free, qsort, strtol
+#include <string.h> // strcmp, strstr, strtok
+#include <time.h> // clock_gettime
+
+// main program's header files
+#include "snake_sim.h" // sim_random
+
+#define MAX_SIZES 16 // sizes in -sizes
+#define MAX_FILLS 16 // fill ratios in -fills
+#define RUNS 7 // timed runs of each function on each board (the best is kept)
+#define RUN_SECONDS 1e-3 // least duration of a timed run (calls are added until it is reached)
+#define WALK_ATTEMPTS 64 // random walks tried to lay out a snake of the wanted length
+#define CALIBRATION_STEPS 1000000 // steps of the reference loop
+
+/*
+  Functions timed: the helpers, the strategies called alone, and the whole decision of each strategy (chooseMove)
+*/
+enum functions {F_ACTION_VALID, F_COUNT_VALID_MOVES, F_PATH_TO_BONUS, F_PATH_TO_TAIL, F_ZIGZAG, F_AGGRESSIVE, F_SMART,
+                F_MOVE_SMART, F_MOVE_LOOKAHEAD, F_MOVE_HAMILTON, F_MOVE_MCTS, FUNCTIONS};
+
+static const char *function_names[FUNCTIONS] = {
+  "actionValid", "countValidMoves", "pathToBonus", "pathToTail", "zigzagStrategy", "aggressiveStrategy", "smartStrategy",
+  "move:smart", "move:lookahead", "move:hamilton", "move:mcts"
+};
+
+/*
+  Settings of a run, read from the command line
+*/
+typedef struct {
+  int boards; // boards per size and fill ratio
+  uint64_t seed; // seed of the first board
+  int nsizes; // sizes of the boards
+  int xsizes[MAX_SIZES];
+  int ysizes[MAX_SIZES];
+  int nfills; // percents of the free cells held by the snake
+  int fills[MAX_FILLS];
+  const char *only; // only the functions whose name contains it (NULL: all)
+  const char *save; // file the baseline is written to (NULL: none)
+  const char *compare; // baseline to compare with (NULL: none)
+  double threshold; // percent of slowdown flagged by -compare
+} settings;
+
+/*
+  board struct, a synthetic game state: the map, the snake as the engine gives it, and the last action
+*/
+typedef struct {
+  int xsize; // x size of the map
+  int ysize; // y size of the map
+  char **map; // rows of the map
+  char *cells; // their characters
+  struct snake_link *links; // the snake, head first
+  int length; // its length
+  double fill; // share of the free cells it holds
+  action last; // move that brought the head to its cell
+} board;
+
+/*
+  result struct, the mean time of a function on the boards of a size and fill ratio
+*/
+typedef struct {
+  int function; // function timed
+  int xsize; // size of the boards
+  int ysize;
+  int fill; // percent asked for
+  double ns; // mean time per call
+  double fillDone; // mean share of the free cells held by the snakes
+} result;
+
+// prototypes of the local/private functions
+static bool read_parameters(int, char **, settings *);
+static bool read_list(char *, int *, int *, int, int *);
+static double now(void);
+static bool make_board(board *, int, int, int, uint64_t *);
+static void free_board(board *);
+static int walk_snake(const board *, int *, int *, int, int, uint64_t *);
+static GameContext *board_context(board *);
+static long run_function(int, board *, GameContext *, long);
+static double time_function(int, board *, GameContext *);
+static bool save_results(const char *, const result *, int, double);
+static int compare_results(const char *, const result *, int, double, double);
+static int compare_doubles(const void *, const void *);
+static double calibrate(void);
+
+static volatile long sink; // results of the calls, so that they are not optimized away
+
+int main(int argc, char **argv){
+  settings set;
+  if (!read_parameters(argc, argv, &set)){
+    printf("Usage: bench [-boards integer] [-seed integer] [-sizes list] [-fills list] [-only name]"
+           " [-save file] [-compare file] [-threshold percent]\n");
+    return 1;
+  }
+
+  result *results = calloc((size_t)set.nsizes * set.nfills * FUNCTIONS, sizeof(result));
+  if (results == NULL) return 1;
+  int nresults = 0;
+  uint64_t rng = set.seed;
+
+  double calibration = calibrate();
+  printf("%-20s %8s %5s %6s %12s\n", "function", "size", "fill", "done", "ns/call");
+  for (int s = 0; s < set.nsizes; s++){
+    for (int f = 0; f < set.nfills; f++){
+      double ns[FUNCTIONS] = {0}, fillDone = 0;
+      for (int b = 0; b < set.boards; b++){
+        board bd;
+        if (!make_board(&bd, set.xsizes[s], set.ysizes[s], set.fills[f], &rng)) return 1;
+        fillDone += bd.fill;
+        for (int fn = 0; fn < FUNCTIONS; fn++){
+          if (set.only != NULL && strstr(function_names[fn], set.only) == NULL) continue;
+          GameContext *ctx = board_context(&bd); //A new context per function: none is warmed up by another
+          if (ctx == NULL) return 1;
+          ns[fn] += time_function(fn, &bd, ctx);
+          freeGameContext(ctx);
+        }
+        free_board(&bd);
+      }
+
+      for (int fn = 0; fn < FUNCTIONS; fn++){
+        if (set.only != NULL && strstr(function_names[fn], set.only) == NULL) continue;
+        result *r = &results[nresults++];
+        r->function = fn;
+        r->xsize = set.xsizes[s];
+        r->ysize = set.ysizes[s];
+        r->fill = set.fills[f];
+        r->ns = ns[fn] / set.boards;
+        r->fillDone = fillDone / set.boards;
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", r->xsize, r->ysize);
+        printf("%-20s %8s %4d%% %5.1f%% %12.1f\n", function_names[fn], size, r->fill, 100 * r->fillDone, r->ns);
+      }
+    }
+  }
+
+  calibration = (calibration + calibrate()) / 2; //Before and after, the speed of the machine may drift
+  printf("Reference loop: %.3f ns/step\n", calibration);
+
+  int regressions = 0;
+  if (set.compare != NULL){//(before -save, which may write the same file)
+    regressions = compare_results(set.compare, results, nresults, set.threshold, calibration);
+    if (regressions < 0){
+      printf("Error: can't read the baseline %s\n", set.compare);
+      return 1;
+    }
+  }
+  if (set.save != NULL && !save_results(set.save, results, nresults, calibration)){
+    printf("Error: can't write %s\n", set.save);
+    return 1;
+  }
+  free(results);
+  return regressions > 0;
+}
+
+/*
+  read_parameters function:
+  This function reads the options (there are no other arguments).
+*/
+static bool read_parameters(int argc, char **argv, settings *set){
+  static char defaultSizes[] = "10x5,20x10,40x10,80x20,160x40,320x80";
+  static char defaultFills[] = "5,25,50,75,95";
+  char *sizes = defaultSizes, *fills = defaultFills;
+  set->boards = 3;
+  set->seed = 1;
+  set->only = NULL;
+  set->save = NULL;
+  set->compare = NULL;
+  set->threshold = 10;
+
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-boards") == 0) set->boards = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-seed") == 0) set->seed = strtoull(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-sizes") == 0) sizes = argv[i + 1];
+    else if (strcmp(argv[i], "-fills") == 0) fills = argv[i + 1];
+    else if (strcmp(argv[i], "-only") == 0) set->only = argv[i + 1];
+    else if (strcmp(argv[i], "-save") == 0) set->save = argv[i + 1];
+    else if (strcmp(argv[i], "-compare") == 0) set->compare = argv[i + 1];
+    else if (strcmp(argv[i], "-threshold") == 0) set->threshold = strtod(argv[i + 1], NULL);
+    else return false;
+    i += 2;
+  }
+
+  return i == argc && set->boards > 0 && set->threshold >= 0
+         && read_list(sizes, set->xsizes, set->ysizes, MAX_SIZES, &set->nsizes)
+         && read_list(fills, set->fills, NULL, MAX_FILLS, &set->nfills);
+}
+
+/*
+  read_list function:
+  This function reads a comma separated list of sizes ("20x10", when ys is given) or of percents (from 1 to 99).
+  Sizes hold at least 3x3 cells, so that there is a free cell inside the border.
+*/
+static bool read_list(char *text, int *xs, int *ys, int max, int *count){
+  *count = 0;
+  for (char *item = strtok(text, ","); item != NULL; item = strtok(NULL, ",")){
+    if (*count == max) return false;
+    char *end;
+    xs[*count] = strtol(item, &end, 10);
+    if (ys != NULL){
+      if (*end != 'x') return false;
+      ys[*count] = strtol(end + 1, &end, 10);
+      if (xs[*count] < 3 || ys[*count] < 3) return false;
+    } else if (xs[*count] < 1 || xs[*count] > 99){
+      return false;
+    }
+    if (*end != '\0') return false;
+    (*count)++;
+  }
+  return *count > 0;
+}
+
+/*
+  now function:
+  This function returns a monotonic time in seconds.
+*/
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+  make_board function:
+  This function makes a board: walls around, the snake laid out by walk_snake over fill percent of the free cells
+  (a bit less if no walk got that far), and the bonus on a random free cell. It returns false if there is no memory.
+*/
+static bool make_board(board *bd, int xsize, int ysize, int fill, uint64_t *rng){
+  int cells = xsize * ysize, freeCells = (xsize - 2) * (ysize - 2);
+  bd->xsize = xsize;
+  bd->ysize = ysize;
+  bd->map = malloc(ysize * sizeof(char *));
+  bd->cells = malloc((size_t)(xsize + 1) * ysize);
+  bd->links = malloc(cells * sizeof(struct snake_link));
+  int *walk = malloc(cells * sizeof(int)), *best = malloc(cells * sizeof(int));
+  if (bd->map == NULL || bd->cells == NULL || bd->links == NULL || walk == NULL || best == NULL){
+    free(walk);
+    free(best);
+    free_board(bd);
+    return false;
+  }
+
+  for (int y = 0; y < ysize; y++){
+    bd->map[y] = bd->cells + (size_t)y * (xsize + 1);
+    for (int x = 0; x < xsize; x++){
+      bd->map[y][x] = (x == 0 || y == 0 || x == xsize - 1 || y == ysize - 1) ? WALL : PATH;
+    }
+    bd->map[y][xsize] = '\0';
+  }
+
+  //Snake: the longest walk of the attempts (the first ones wander more, the last ones pack the cells better)
+  int wanted = (int)((long)freeCells * fill / 100);
+  if (wanted < 1) wanted = 1;
+  if (wanted > freeCells - 1) wanted = freeCells - 1 > 0 ? freeCells - 1 : 1;
+  int length = 0;
+  for (int attempt = 0; attempt < WALK_ATTEMPTS && length < wanted; attempt++){
+    int n = walk_snake(bd, walk, best, wanted, attempt < WALK_ATTEMPTS / 2 ? 30 : 0, rng);
+    if (n > length){
+      length = n;
+      memcpy(best + cells - n, walk, n * sizeof(int)); //(kept at the end of best, whose beginning walk_snake uses)
+    }
+  }
+  const int *cellsOfSnake = best + cells - length;
+  for (int i = 0; i < length; i++){
+    int x = cellsOfSnake[i] % xsize, y = cellsOfSnake[i] / xsize;
+    bd->links[i] = (struct snake_link){i == 0 ? SNAKE_HEAD : i == length - 1 ? SNAKE_TAIL : SNAKE_BODY, x, y, NULL};
+    if (i > 0) bd->links[i - 1].next = &bd->links[i];
+    bd->map[y][x] = bd->links[i].c;
+  }
+  bd->length = length;
+  bd->fill = (double)length / freeCells;
+
+  //Move that brought the head there (from the second link)
+  bd->last = NORTH;
+  if (length > 1){
+    int dx = bd->links[0].x - bd->links[1].x, dy = bd->links[0].y - bd->links[1].y;
+    bd->last = (dx == 1) ? EAST : (dx == -1) ? WEST : (dy == 1) ? SOUTH : NORTH;
+  }
+
+  //Bonus: a random free cell
+  if (length < freeCells){
+    int x, y;
+    do {
+      x = 1 + (int)(sim_random(rng) % (uint64_t)(xsize - 2));
+      y = 1 + (int)(sim_random(rng) % (uint64_t)(ysize - 2));
+    } while (bd->map[y][x] != PATH);
+    bd->map[y][x] = BONUS;
+  }
+  free(walk);
+  free(best);
+  return true;
+}
+
+/*
+  free_board function:
+  This function releases the memory of a board.
+*/
+static void free_board(board *bd){
+  free(bd->map);
+  free(bd->cells);
+  free(bd->links);
+}
+
+/*
+  walk_snake function:
+  This function lays out a snake as a self-avoiding walk from a random free cell, head first, up to wanted cells:
+  each step goes to the free neighbor with the fewest free neighbors (ties broken at random), which packs the walk,
+  except that randomPercent percent of the steps go to any free neighbor. The cells are written in walk,
+  seen is scratch for the cells taken; it returns the length reached (the walk stops when it is stuck).
+*/
+static int walk_snake(const board *bd, int *walk, int *seen, int wanted, int randomPercent, uint64_t *rng){
+  int xsize = bd->xsize, cells = xsize * bd->ysize;
+  int offsets[4] = {-xsize, 1, xsize, -1};
+  for (int i = 0; i < cells; i++) seen[i] = (bd->cells[(i / xsize) * (xsize + 1) + i % xsize] == WALL);
+
+  int cell;
+  do {
+    cell = (int)(sim_random(rng) % (uint64_t)cells);
+  } while (seen[cell]);
+  int n = 0;
+  walk[n++] = cell;
+  seen[cell] = 1;
+
+  while (n < wanted){
+    int candidates[4], degrees[4], count = 0, fewest = 5;
+    for (int a = 0; a < 4; a++){
+      int next = cell + offsets[a];
+      if (seen[next]) continue;
+      int degree = 0;
+      for (int b = 0; b < 4; b++) degree += !seen[next + offsets[b]];
+      candidates[count] = next;
+      degrees[count++] = degree;
+      if (degree < fewest) fewest = degree;
+    }
+    if (count == 0) break;
+
+    int pick;
+    if ((int)(sim_random(rng) % 100) < randomPercent){
+      pick = (int)(sim_random(rng) % (uint64_t)count);
+    } else {
+      int ties = 0;
+      for (int i = 0; i < count; i++) if (degrees[i] == fewest) candidates[ties++] = candidates[i];
+      pick = (int)(sim_random(rng) % (uint64_t)ties);
+    }
+    cell = candidates[pick];
+    walk[n++] = cell;
+    seen[cell] = 1;
+  }
+  return n;
+}
+
+/*
+  board_context function:
+  This function makes an AI context that starts a game on the board, with the default constants, no instrumentation,
+  and a fixed MCTS budget of 100 playouts (so that its time doesn't depend on a clock). It returns NULL if there is no memory.
+*/
+static GameContext *board_context(board *bd){
+  GameContext *ctx = newGameContext(1);
+  if (ctx == NULL) return NULL;
+  StrategyParams params;
+  defaultStrategyParams(&params);
+  setStrategyParams(ctx, &params);
+  setMctsBudget(ctx, 0, 100);
+  enableMoveStats(ctx, false);
+  chooseStrategy(ctx, "hamilton"); //(so that the cycle is prepared, move:* then switches the strategy)
+  updateContext(ctx, bd->map, bd->xsize, bd->ysize, bd->links, (action)-1);
+  if (ctx->body == NULL){
+    freeGameContext(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+/*
+  run_function function:
+  This function calls a function n times on a board (actionValid is called for the 4 moves of the head each time),
+  and returns the sum of the results.
+*/
+static long run_function(int function, board *bd, GameContext *ctx, long n){
+  Position head = ctx->headPos, tail = ctx->tailPos, bonus = ctx->bonusPos;
+  action first; //First move of the path queries
+  int headCell = head.y * bd->xsize + head.x;
+  long sum = 0;
+
+  switch (function){
+  case F_ACTION_VALID:
+    for (long i = 0; i < n; i++){
+      for (int a = NORTH; a <= WEST; a++) sum += actionValid(ctx, (action)a, headCell);
+    }
+    break;
+  case F_COUNT_VALID_MOVES:
+    for (long i = 0; i < n; i++) sum += countValidMoves(ctx, headCell);
+    break;
+  case F_PATH_TO_BONUS:
+    for (long i = 0; i < n; i++) sum += pathToBonus(ctx, bd->map, &first);
+    break;
+  case F_PATH_TO_TAIL:
+    for (long i = 0; i < n; i++) sum += pathToTail(ctx, bd->map, &first);
+    break;
+  case F_ZIGZAG:
+    for (long i = 0; i < n; i++) sum += zigzagStrategy(bd->map, bd->xsize, bd->ysize, head, tail, bonus, ctx, bd->last);
+    break;
+  case F_AGGRESSIVE:
+    for (long i = 0; i < n; i++) sum += aggressiveStrategy(bd->map, bd->ysize, bd->xsize, head, bonus, ctx);
+    break;
+  case F_SMART:
+    for (long i = 0; i < n; i++) sum += smartStrategy(bd->map, bd->xsize, bd->ysize, head, tail, bonus, ctx, bd->last);
+    break;
+  default: //The whole decision of a strategy
+    ctx->strategy = (function == F_MOVE_HAMILTON) ? HAMILTON_STRATEGY : (function == F_MOVE_MCTS) ? MCTS_STRATEGY : SMART_STRATEGY;
+    ctx->lookahead = (function == F_MOVE_LOOKAHEAD);
+    for (long i = 0; i < n; i++) sum += chooseMove(ctx, bd->map, bd->xsize, bd->ysize, bd->links, bd->last);
+    break;
+  }
+  return sum;
+}
+
+/*
+  time_function function:
+  This function returns the time of one call of a function on a board, in ns: the number of calls per run is doubled
+  until a run lasts RUN_SECONDS, then the best of RUNS runs is kept.
+*/
+static double time_function(int function, board *bd, GameContext *ctx){
+  sink += run_function(function, bd, ctx, 1); //Warm up (first allocations, caches)
+  long n = 1;
+  double elapsed;
+  for (;;){
+    double start = now();
+    sink += run_function(function, bd, ctx, n);
+    elapsed = now() - start;
+    if (elapsed >= RUN_SECONDS) break;
+    n *= 2;
+  }
+  double best = elapsed;
+  for (int r = 1; r < RUNS; r++){
+    double start = now();
+    sink += run_function(function, bd, ctx, n);
+    elapsed = now() - start;
+    if (elapsed < best) best = elapsed;
+  }
+  return best * 1e9 / n;
+}
+
+/*
+  save_results function:
+  This function writes the results as a baseline: one line per function, size and fill ratio,
+  after the time of the reference loop.
+*/
+static bool save_results(const char *filename, const result *results, int nresults, double calibration){
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) return false;
+  fprintf(file, "# bench baseline: function size fill ns/call\n");
+  fprintf(file, "# calibration %.4f\n", calibration);
+  for (int i = 0; i < nresults; i++){
+    const result *r = &results[i];
+    fprintf(file, "%s %dx%d %d %.1f\n", function_names[r->function], r->xsize, r->ysize, r->fill, r->ns);
+  }
+  return fclose(file) == 0;
+}
+
+/*
+  compare_results function:
+  This function compares the results with a baseline (the results missing from it are skipped) and prints, for each
+  function, the median change of its time over the sizes and fill ratios, and its worst one. A function whose median
+  is slower than the baseline by more than threshold percent is a regression: one result alone varies too much from
+  one run to the next to tell (by 25% on a busy machine), a slower function is slower on most boards.
+  The baseline is first scaled by the speed of the machine, measured by the reference loop in both runs.
+  It returns the number of regressions (-1 if the baseline can't be read).
+*/
+static int compare_results(const char *filename, const result *results, int nresults, double threshold, double calibration){
+  FILE *file = fopen(filename, "r");
+  double *changes = malloc((nresults > 0 ? nresults : 1) * sizeof(double));
+  if (file == NULL || changes == NULL){
+    if (file != NULL) fclose(file);
+    free(changes);
+    return -1;
+  }
+  for (int i = 0; i < nresults; i++) changes[i] = -1e300; //Not in the baseline
+
+  char line[256], name[64];
+  double scale = 1, baseCalibration;
+  while (fgets(line, sizeof(line), file) != NULL){
+    int xsize, ysize, fill;
+    double ns;
+    if (sscanf(line, "# calibration %lf", &baseCalibration) == 1 && baseCalibration > 0) scale = calibration / baseCalibration;
+    if (line[0] == '#' || sscanf(line, "%63s %dx%d %d %lf", name, &xsize, &ysize, &fill, &ns) != 5 || ns <= 0) continue;
+    for (int i = 0; i < nresults; i++){
+      const result *r = &results[i];
+      if (strcmp(function_names[r->function], name) != 0 || r->xsize != xsize || r->ysize != ysize || r->fill != fill) continue;
+      changes[i] = 100 * (r->ns - ns * scale) / (ns * scale);
+    }
+  }
+  fclose(file);
+
+  printf("Compared with %s (machine speed %.2fx the baseline's), threshold %.1f%%:\n", filename, 1 / scale, threshold);
+  int regressions = 0;
+  double *sorted = malloc((nresults > 0 ? nresults : 1) * sizeof(double));
+  for (int fn = 0; fn < FUNCTIONS && sorted != NULL; fn++){
+    int n = 0, over = 0, worst = -1;
+    for (int i = 0; i < nresults; i++){
+      if (results[i].function != fn || changes[i] < -1e299) continue;
+      sorted[n++] = changes[i];
+      if (changes[i] > threshold) over++;
+      if (worst < 0 || changes[i] > changes[worst]) worst = i;
+    }
+    if (n == 0) continue;
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    double median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    bool regressed = median > threshold;
+    regressions += regressed;
+    printf("%-10s %-20s median %+6.1f%% over %d results, %d over the threshold, worst %+.1f%% (%dx%d %d%%)\n",
+           regressed ? "REGRESSION" : "ok", function_names[fn], median, n, over, changes[worst],
+           results[worst].xsize, results[worst].ysize, results[worst].fill);
+  }
+  free(sorted);
+  free(changes);
+  return regressions;
+}
+
+/*
+  compare_doubles function:
+  This function orders two doubles for qsort.
+*/
+static int compare_doubles(const void *a, const void *b){
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  calibrate function:
+  This function returns the time of a step of a fixed reference loop (a chain of multiplies and shifts, best of
+  RUNS runs), which tells how fast the machine runs at the moment.
+*/
+static double calibrate(void){
+  double best = 0;
+  for (int r = 0; r < RUNS; r++){
+    uint64_t x = 88172645463325252ull;
+    double start = now();
+    for (long i = 0; i < CALIBRATION_STEPS; i++){
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      x *= 0x2545F4914F6CDD1Dull;
+    }
+    double elapsed = now() - start;
+    sink += (long)(x & 1);
+    if (r == 0 || elapsed < best) best = elapsed;
+  }
+  return best * 1e9 / CALIBRATION_STEPS;
+}
@@ -0,0 +1,279 @@
+/*
+  Decoder of the flight recorder dumps (snake.flight, see dumpFlightRecorder in player_api.h).
+  It prints the last decisions of the game as annotated map frames: the snake, the bonus, the decision that chose
+  the move (see moveStatsPickName), the score of each move when the move was chosen by scoring them, and the move.
+  The body of each frame is rebuilt from the dump: the snake of the last decision, and the head and tail of every
+  decision recorded (the cells of the body are where the head was, and the tails go back to the oldest of them).
+
+  Build:
+    gcc -std=c99 -Wall -O2 -o flight flight.c snake_sim.c player.c
+  Usage:
+    ./flight [-frames integer] [-radius integer] dump_file
+  -frames is the number of decisions shown, the last ones (10 by default, 0: all of the dump), and -radius crops
+  the frames to the cells that far from the head (0 by default: the whole map).
+*/
+
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // int32_t, uint32_t
+#include <stdio.h> // printf, fopen, fread
+#include <stdlib.h> // malloc, calloc, free, qsort, strtol
+#include <string.h> // strcmp, memcmp, memcpy
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "player_api.h"
+
+/*
+  Settings of a run, read from the command line
+*/
+typedef struct {
+  long frames; // decisions shown (0: all)
+  int radius; // cells shown around the head (0: the whole map)
+} settings;
+
+/*
+  flight_dump struct, a dump as read from its file
+*/
+typedef struct {
+  FlightHeader header; // header of the dump
+  char *walls; // the level, one char per cell
+  int32_t *snake; // the snake of the last decision, from the head
+  FlightRecord *records; // the records found in the ring, sorted by sequence
+  int count; // number of records
+  int32_t *history; // cell of the head at each decision from oldest (-1: unknown)
+  long oldest; // decision of history[0]
+} flight_dump;
+
+// prototypes of the local/private functions
+static bool read_parameters(int, char **, settings *, int *);
+static int compare_records(const void *, const void *);
+static bool read_dump(const char *, flight_dump *);
+static bool rebuild_history(flight_dump *);
+static int32_t history_cell(const flight_dump *, long);
+static void show_frame(const flight_dump *, const FlightRecord *, long, int, const settings *);
+static void free_dump(flight_dump *);
+
+static const char *actionNames[4] = {"NORTH", "EAST", "SOUTH", "WEST"};
+static const char *strategyNames[3] = {"smart", "hamilton", "mcts"};
+
+int main(int argc, char **argv){
+  settings set;
+  int first;
+
+  if (!read_parameters(argc, argv, &set, &first)){
+    printf("Usage: flight [-frames integer] [-radius integer] dump_file\n");
+    return 1;
+  }
+
+  flight_dump dump;
+  if (!read_dump(argv[first], &dump)){
+    printf("Error: %s is not a flight recorder dump\n", argv[first]);
+    return 1;
+  }
+  if (!rebuild_history(&dump)){
+    free_dump(&dump);
+    return 1;
+  }
+
+  const FlightHeader *h = &dump.header;
+  long decision = h->decision;
+  printf("%s: %dx%d level, %ld decisions, %d recorded, snake length %d at the last one\n", argv[first],
+         h->mapxsize, h->mapysize, decision, dump.count, h->length);
+  if (dump.count > 0){
+    long picks[MOVE_STATS_PICKS + 1] = {0}; //The last one counts the decisions without a pick
+    for (int i = 0; i < dump.count; i++) picks[dump.records[i].pick < MOVE_STATS_PICKS ? dump.records[i].pick : MOVE_STATS_PICKS]++;
+    printf("picks of the recorded decisions:");
+    for (int p = 0; p <= MOVE_STATS_PICKS; p++){
+      if (picks[p] > 0) printf(" %s %ld,", p < MOVE_STATS_PICKS ? moveStatsPickName(p) : "none", picks[p]);
+    }
+    printf("\n");
+  }
+
+  int from = (set.frames > 0 && set.frames < dump.count) ? dump.count - (int)set.frames : 0;
+  for (int i = from; i < dump.count; i++) show_frame(&dump, &dump.records[i], dump.records[i].sequence, dump.records[i].length, &set);
+  if (dump.count == 0 || dump.records[dump.count - 1].sequence < (uint32_t)decision){
+    show_frame(&dump, NULL, decision, h->length, &set); //The decision being made when the dump was taken
+  }
+
+  free_dump(&dump);
+  return 0;
+}
+
+/*
+  read_parameters function:
+  This function reads the options, the remaining argument is the dump file.
+*/
+static bool read_parameters(int argc, char **argv, settings *set, int *first){
+  set->frames = 10;
+  set->radius = 0;
+
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-frames") == 0) set->frames = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-radius") == 0) set->radius = (int)strtol(argv[i + 1], NULL, 10);
+    else return false;
+    i += 2;
+  }
+  *first = i;
+  return i + 1 == argc && set->frames >= 0 && set->radius >= 0;
+}
+
+static int compare_records(const void *a, const void *b){
+  uint32_t x = ((const FlightRecord *)a)->sequence, y = ((const FlightRecord *)b)->sequence;
+  return (x > y) - (x < y);
+}
+
+/*
+  read_dump function:
+  This function reads a dump and checks it (written by this version, on a machine with the same byte order),
+  then keeps the records of the ring that hold a decision, sorted from the oldest.
+*/
+static bool read_dump(const char *filename, flight_dump *dump){
+  memset(dump, 0, sizeof(*dump));
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) return false;
+
+  FlightHeader *h = &dump->header;
+  bool ok = fread(h, sizeof(*h), 1, f) == 1 && memcmp(h->magic, "SNAKEFLT", sizeof(h->magic)) == 0
+    && h->version == FLIGHT_VERSION && h->byteOrder == 0x01020304u && h->mapxsize > 0 && h->mapysize > 0
+    && h->length > 0 && (long)h->length <= (long)h->mapxsize * h->mapysize && h->records == FLIGHT_RECORDS;
+  size_t cells = ok ? (size_t)h->mapxsize * h->mapysize : 0;
+  if (ok){
+    dump->walls = malloc(cells);
+    dump->snake = malloc(h->length * sizeof(int32_t));
+    dump->records = malloc(FLIGHT_RECORDS * sizeof(FlightRecord));
+    ok = dump->walls != NULL && dump->snake != NULL && dump->records != NULL
+      && fread(dump->walls, 1, cells, f) == cells
+      && fread(dump->snake, sizeof(int32_t), h->length, f) == (size_t)h->length
+      && fread(dump->records, sizeof(FlightRecord), FLIGHT_RECORDS, f) == FLIGHT_RECORDS;
+  }
+  fclose(f);
+  for (int i = 0; ok && i < h->length; i++) ok = (dump->snake[i] >= 0 && (size_t)dump->snake[i] < cells);
+  if (!ok){
+    free_dump(dump);
+    return false;
+  }
+
+  for (int i = 0; i < FLIGHT_RECORDS; i++){//Empty slots, and a slot being written when the dump was taken, are dropped
+    const FlightRecord *r = &dump->records[i];
+    bool inside = r->head >= 0 && (size_t)r->head < cells && r->tail >= 0 && (size_t)r->tail < cells
+      && r->bonus < (int32_t)cells && r->length > 0 && r->action < 4;
+    if (r->sequence != 0 && r->sequence <= h->decision && inside) dump->records[dump->count++] = *r;
+  }
+  qsort(dump->records, dump->count, sizeof(FlightRecord), compare_records);
+  return true;
+}
+
+/*
+  rebuild_history function:
+  This function finds where the head was at each decision, back to the tail of the oldest record:
+  the snake of the last decision holds its last length heads, the record of a decision its head, and its tail
+  the head of length - 1 decisions before. Between two records the tail moves by at most one decision per decision,
+  so the tails of the records and the last snake leave no gap.
+*/
+static bool rebuild_history(flight_dump *dump){
+  const FlightHeader *h = &dump->header;
+  long last = h->decision;
+  long oldest = last - h->length + 1;
+  for (int i = 0; i < dump->count; i++){
+    long tail = (long)dump->records[i].sequence - dump->records[i].length + 1;
+    if (tail < oldest) oldest = tail;
+  }
+
+  long size = last - oldest + 1;
+  dump->history = malloc(size * sizeof(int32_t));
+  if (dump->history == NULL) return false;
+  dump->oldest = oldest;
+  for (long k = 0; k < size; k++) dump->history[k] = -1;
+  for (int i = 0; i < h->length; i++) dump->history[last - i - oldest] = dump->snake[i];
+  for (int i = 0; i < dump->count; i++){
+    const FlightRecord *r = &dump->records[i];
+    dump->history[r->sequence - oldest] = r->head;
+    dump->history[(long)r->sequence - r->length + 1 - oldest] = r->tail;
+  }
+  return true;
+}
+
+/*
+  history_cell function:
+  This function returns the cell of the head at a decision (-1: unknown).
+*/
+static int32_t history_cell(const flight_dump *dump, long decision){
+  long k = decision - dump->oldest;
+  return (k >= 0 && dump->history != NULL) ? dump->history[k] : -1;
+}
+
+/*
+  show_frame function:
+  This function prints the map of a decision, with what the record of the decision tells (r NULL: the state of the
+  decision being made when the dump was taken, which has no record yet).
+*/
+static void show_frame(const flight_dump *dump, const FlightRecord *r, long decision, int length, const settings *set){
+  const FlightHeader *h = &dump->header;
+  int xsize = h->mapxsize, ysize = h->mapysize;
+  size_t cells = (size_t)xsize * ysize;
+  char *frame = malloc(cells);
+  if (frame == NULL) return;
+  memcpy(frame, dump->walls, cells);
+
+  int unknown = 0;
+  for (long k = decision - length + 1; k <= decision; k++){//From the tail to the head
+    int32_t cell = history_cell(dump, k);
+    if (cell < 0){
+      unknown++;
+      continue;
+    }
+    frame[cell] = (k == decision) ? SNAKE_HEAD : (k == decision - length + 1) ? SNAKE_TAIL : SNAKE_BODY;
+  }
+  int32_t head = history_cell(dump, decision);
+  if (r != NULL && r->bonus >= 0) frame[r->bonus] = BONUS;
+
+  printf("\ndecision %ld: length %d", decision, length);
+  if (head >= 0) printf(", head (%d,%d)", head % xsize, head / xsize);
+  if (r != NULL){
+    printf(", tail (%d,%d)", r->tail % xsize, r->tail / xsize);
+    if (r->bonus >= 0) printf(", bonus (%d,%d)", r->bonus % xsize, r->bonus / xsize);
+    else printf(", no bonus");
+    printf(", %s strategy\n", r->strategy < 3 ? strategyNames[r->strategy] : "?");
+    printf("  %s", r->pick < MOVE_STATS_PICKS ? moveStatsPickName(r->pick) : "no pick counted");
+    if (r->flags & FLIGHT_SCORED){
+      printf(", scores:");
+      for (int i = 0; i < 4; i++){
+        if (r->scores[i] <= -1e29f) printf(" %s invalid", actionNames[i]);
+        else printf(" %s %.1f", actionNames[i], r->scores[i]);
+      }
+    }
+    printf(" -> %s%s\n", actionNames[r->action], (r->flags & FLIGHT_PONDERED) ? " (pondered)" : "");
+  } else {
+    printf(", being decided when the dump was taken\n");
+  }
+  if (unknown > 0) printf("  (%d cells of the body are not in the dump)\n", unknown);
+
+  int x0 = 0, x1 = xsize - 1, y0 = 0, y1 = ysize - 1;
+  if (set->radius > 0 && head >= 0){
+    int hx = head % xsize, hy = head / xsize;
+    x0 = (hx - set->radius > 0) ? hx - set->radius : 0;
+    x1 = (hx + set->radius < xsize - 1) ? hx + set->radius : xsize - 1;
+    y0 = (hy - set->radius > 0) ? hy - set->radius : 0;
+    y1 = (hy + set->radius < ysize - 1) ? hy + set->radius : ysize - 1;
+  }
+  for (int y = y0; y <= y1; y++) printf("  %.*s\n", x1 - x0 + 1, frame + (size_t)y * xsize + x0);
+  free(frame);
+}
+
+/*
+  free_dump function:
+  This function releases the memory of a dump.
+*/
+static void free_dump(flight_dump *dump){
+  free(dump->walls);
+  free(dump->snake);
+  free(dump->records);
+  free(dump->history);
+  dump->walls = NULL;
+  dump->snake = NULL;
+  dump->records = NULL;
+  dump->history = NULL;
+}
@@ -0,0 +1,55 @@
+/*
+  Level compiler: turns level files into compiled levels (see LevelArtifact in player.c), the tables the AI
+  would otherwise compute at the beginning of the first game of each process. A player finds the compiled level
+  of the map it is given in the directory named by SNAKE_LEVELS, maps it and uses it as it is, e.g.
+    ./levelc -o levels level-*.map
+    SNAKE_LEVELS=levels SNAKE_STRATEGY=hamilton ./snake level-20x10.map
+  Without SNAKE_LEVELS, or when the directory has no artifact for the map, the tables are computed as before.
+
+  Build:
+    gcc -std=c99 -Wall -O2 -o levelc levelc.c snake_sim.c player.c
+  Usage:
+    ./levelc [-o directory] level_file...
+*/
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdio.h> // printf
+#include <string.h> // strcmp
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "player_api.h"
+#include "snake_sim.h"
+
+int main(int argc, char **argv){
+  const char *directory = ".";
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-o") == 0) directory = argv[i + 1];
+    else break;
+    i += 2;
+  }
+  if (i >= argc || argv[i][0] == '-'){
+    printf("Usage: levelc [-o directory] level_file...\n");
+    return 1;
+  }
+
+  bool ok = true;
+  for (; i < argc; i++){
+    sim_level level;
+    char path[4096];
+    if (!sim_level_read(&level, argv[i])){
+      ok = false;
+      continue;
+    }
+    if (compileLevel(level.map, level.xsize, level.ysize, directory, path, sizeof(path))){
+      printf("%s: %s\n", argv[i], path);
+    } else {
+      printf("Error: cannot write the compiled level of %s in %s\n", argv[i], directory);
+      ok = false;
+    }
+    sim_level_free(&level);
+  }
+  return ok ? 0 : 1;
+}
@@ -1,11 +1,27 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, mmap
+
 // compiler's header files
 #include <stdbool.h> // bool, true, false
-#include <stdlib.h> // rand
+#include <stddef.h> // offsetof
+#include <stdlib.h> // rand, malloc, free, qsort
 #include <stdio.h> // printf
+#include <string.h> // strcmp, strncmp, strspn, strcspn, memchr
+#include <stdint.h> // uint64_t
+#include <time.h> // clock_gettime
+#include <errno.h> // errno, EINTR
+#include <fcntl.h> // open
+#include <signal.h> // sigaction, raise
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // close, write
+#ifdef PLAYER_PONDER
+#include <pthread.h> // pthread_create, pthread_mutex_lock, pthread_cond_wait
+#endif
 
 // main program's header file
 #include "snake_def.h"
 #include "snake_dec.h"
+#include "player_api.h"
 
 // student name goes here
 char * student="Mohammad Amara"; 
@@ -18,17 +34,616 @@ typedef struct {//Position in the map (this will be used to define graph nodes)
     int y;
 } Position;
 
+/*
+  Strategies that can be selected with the SNAKE_STRATEGY environment variable
+  (read at the beginning of each game: "smart" by default, "hamilton", "mcts", or "lookahead" for smart with SNAKE_LOOKAHEAD=on),
+  or with chooseStrategy
+*/
+enum strategies {SMART_STRATEGY, HAMILTON_STRATEGY, MCTS_STRATEGY};
+typedef enum strategies strategy;
+
+/*
+  HamiltonCycle struct, a cycle going through every free cell of a level exactly once.
+  It is computed once per level and kept as two flat tables indexed by cell (y * mapxsize + x):
+  the successor of each cell on the cycle, and its ordinal (position along the cycle, -1 for walls).
+*/
+typedef struct {
+  int mapxsize; // x size of the level the cycle was computed for
+  int mapysize; // y size of the level the cycle was computed for
+  unsigned long signature; // hash of the walls of the level
+  bool found; // whether the level has a cycle (false: the tables are not used)
+  int length; // number of cells of the cycle
+  int *next; // successor of each cell on the cycle
+  int *order; // ordinal of each cell on the cycle
+  void *mapping; // compiled level the tables are read from (NULL: the tables were allocated and computed)
+  size_t mappingSize; // size of that mapping
+} HamiltonCycle;
+
+#define LEVEL_ARTIFACT_VERSION 1 // version of the compiled levels (an artifact of another version is ignored)
+#define LEVEL_ARTIFACT_BYTE_ORDER 0x01020304u // written as a native integer (an artifact of another machine is ignored)
+
+/*
+  LevelArtifact struct, the beginning of a compiled level (see compileLevel): everything the AI computes once
+  per level, in a file that is mapped in memory and used as it is, without parsing. It is followed by the walls
+  (one byte per cell, 1 for a wall, to check the artifact against the map), padded to 8 bytes, then the next
+  and order tables of the Hamiltonian cycle (one int per cell each).
+  The file of a level is found from the map alone: <directory>/level-<x size>x<y size>-<signature>.lvl.
+*/
+typedef struct {
+  char magic[8]; // "SNAKELVL"
+  unsigned version; // LEVEL_ARTIFACT_VERSION
+  unsigned byteOrder; // LEVEL_ARTIFACT_BYTE_ORDER
+  int mapxsize; // x size of the level
+  int mapysize; // y size of the level
+  unsigned long long signature; // levelSignature of the level
+  int found; // whether the level has a cycle
+  int length; // number of cells of the cycle
+  unsigned long long size; // size of the file
+} LevelArtifact;
+
+#define POLICY_VERSION 1 // version of the policy tables (a table of another version is ignored)
+#define POLICY_MAX_CELLS 28 // free cells of the largest level a policy can be solved for (a snake's key fits in 64 bits)
+#define POLICY_KEY_HEAD 5 // bit of the rank of the head in a key (bits 0-4: length - 1)
+#define POLICY_KEY_LINKS 10 // bit of the direction of the first link in a key (2 bits per link)
+#define POLICY_EMPTY (~0ULL) // key of an empty slot (no snake is that long)
+
+/*
+  PolicyHeader struct, the beginning of a policy table (solver.c): the best move of every state of a small level,
+  solved offline, in a file that is mapped in memory like a compiled level. It is followed by the walls (one byte
+  per cell), padded to 8 bytes, then the slots: an open addressing hash table (linear probing from policySlot)
+  holding one PolicyEntry per snake, at most half full. The free cells are numbered by rank (row-major order).
+  The file of a level is found from the map alone: <directory>/level-<x size>x<y size>-<signature>.pol.
+*/
+typedef struct {
+  char magic[8]; // "SNAKEPOL"
+  unsigned version; // POLICY_VERSION
+  unsigned byteOrder; // LEVEL_ARTIFACT_BYTE_ORDER
+  int mapxsize; // x size of the level
+  int mapysize; // y size of the level
+  unsigned long long signature; // levelSignature of the level
+  int cells; // free cells of the level
+  int padding;
+  unsigned long long snakes; // snakes in the table
+  unsigned long long slots; // slots of the table (a power of 2)
+  unsigned long long size; // size of the file
+  double score; // expected score of a game played with the table (from a random start)
+} PolicyHeader;
+
+/*
+  PolicyEntry struct, the moves of a snake: its key (policyKey: length - 1, rank of the head, then the direction
+  from each cell to the next one toward the tail), and the best move for the bonus on each free cell, 2 bits per
+  rank of the bonus cell
+*/
+typedef struct {
+  uint64_t key; // key of the snake (POLICY_EMPTY: empty slot)
+  uint64_t moves; // move per bonus cell
+} PolicyEntry;
+
+/*
+  PolicyTable struct, the policy table of the current level, mapped from the directory of the compiled levels.
+  It is looked up before the strategies: when it has the state, its move is played.
+*/
+typedef struct {
+  bool enabled; // whether the table is looked up (SNAKE_POLICY=off: no)
+  int mapxsize; // x size of the level the table was looked for
+  int mapysize; // y size of the level the table was looked for
+  unsigned long signature; // signature of that level
+  bool searched; // whether the directory was searched for this level
+  void *mapping; // the mapped file (NULL: no table)
+  size_t mappingSize; // size of that mapping
+  const PolicyEntry *entries; // slots of the table
+  uint64_t mask; // slots - 1
+  int cells; // free cells of the level
+  int *rank; // rank of each cell among the free cells (-1: wall)
+} PolicyTable;
+
+/*
+  Arena struct, a single block of memory holding all the buffers that depend on the map size.
+  It is allocated once per map size (not once per move): the buffers are carved out of it by layoutBuffers.
+  An arena without memory (base is NULL) only measures the space the buffers need.
+*/
+typedef struct {
+  char *base; // memory of the arena, NULL when measuring
+  size_t size; // size of the memory
+  size_t used; // bytes carved out so far
+} Arena;
+
+/*
+  PathFinder struct, the buffers of the BFS and A* searches, carved out of the arena.
+  Instead of clearing dist and parent before each search, every search gets a new generation number:
+  dist[cell] and parent[cell] are only meaningful when seen[cell] holds the current generation.
+*/
+typedef struct {
+  int *queue; // BFS frontier
+  unsigned long long *heap; // A* frontier, binary heap of (estimated length, -moves so far, cell) packed in 21 bits each
+  int *dist; // number of moves from the start of the search
+  int *parent; // cell we came from, to rebuild the path
+  unsigned *seen; // generation in which the cell was reached
+  unsigned generation; // generation of the current search
+  int cells; // number of cells of the map
+  int *cellX; // x coordinate of each cell (saves a division per visited cell)
+  int *cellY; // y coordinate of each cell
+} PathFinder;
+
+/*
+  VirtualSnake struct, a snake moved ahead of time on a copy of the board, without touching the real one.
+  Its oldest cells are read from the real snake's ring buffer (only a counter moves when the tail advances),
+  and the cells entered by its head are pushed to its own buffer: it starts in O(1), and each move is O(1).
+*/
+typedef struct {
+  const Position *body; // ring buffer of the real snake
+  int first; // index of the real head in that ring buffer
+  int capacity; // size of that ring buffer
+  int mapxsize; // x size of the map (cells are y * mapxsize + x)
+  int realCells; // number of cells of the real snake still part of the virtual snake (from the real head)
+  int *pushed; // cells entered by the virtual head, in order
+  int npushed; // number of cells pushed
+  int popped; // number of pushed cells already left by the tail
+  int length; // length of the virtual snake
+} VirtualSnake;
+
+/*
+  Decisions counted by the instrumentation (which strategy chose the move, and why for the smart strategy)
+*/
+enum picks {PICK_AGGRESSIVE_SMALL, PICK_AGGRESSIVE_CLOSE, PICK_ZIGZAG_FULL, PICK_ZIGZAG_FAR, PICK_ZIGZAG_DEFAULT,
+            PICK_HAMILTON, PICK_MCTS, PICK_LOOKAHEAD_BONUS, PICK_LOOKAHEAD_TAIL, PICK_POLICY};
+typedef enum picks pick;
+
+//Names of the decisions, in the order of the picks enum
+static const char *pickNames[MOVE_STATS_PICKS] = {"aggressive (small snake)", "aggressive (bonus close)",
+  "zigzag (map full)", "zigzag (bonus far)", "zigzag (default)", "hamilton", "mcts", "lookahead (bonus)", "lookahead (tail)",
+  "policy table"};
+
+/*
+  Instrumentation struct, the counters of a context. Every counter is behind a check of enabled,
+  so when it is off the cost is one predictable branch per counter.
+*/
+typedef struct {
+  bool enabled; // whether the counters run
+  bool chosen; // whether set by enableMoveStats (SNAKE_STATS is then ignored)
+  bool print; // whether each game's summary is printed (on stderr) when it ends
+  bool atexitDone; // whether the summary of the last game is registered to be printed at exit
+  MoveStats game; // counters of the current game
+  MoveStats total; // counters of the previous games
+} Instrumentation;
+
+/*
+  FlightRecorder struct, the ring of the last decisions of a context (see FlightRecord in player_api.h).
+  The slot of a decision is filled in place while the decision is made: its sequence is cleared first and set last,
+  so a dump taken in the middle (from a signal handler) finds it empty rather than half written. Nothing is locked:
+  only the thread playing the context writes, a dump only reads.
+*/
+typedef struct {
+  FlightRecord records[FLIGHT_RECORDS]; // ring of the decisions, by sequence modulo FLIGHT_RECORDS
+  FlightRecord *current; // slot of the decision being made (NULL: none)
+  uint32_t decisions; // decisions recorded in this game
+  uint32_t state; // decision whose state the context holds (decisions + 1 while deciding)
+  char *walls; // the level, WALL or PATH for each cell (written at each resync)
+} FlightRecorder;
+
+#define GRID_OCCUPIED 1 // a cell that is not an empty path or the bonus (the head can't go through it)
+#define GRID_BLOCKED 2 // a wall, the body or the tail (actionValid refuses it)
+
+/*
+  Grid struct, a flat view of the map made for the strategies: one byte of GRID_* flags per cell (y * mapxsize + x),
+  and the index change of each move, so a neighbor is one addition and one load instead of two row lookups and three compares.
+  It is built at each resync, then updateContext only rewrites the cells a move changes (new head, old head, freed tail).
+  The border of walls every level has pads the rows: the neighbors of a cell the snake can stand on are always in the grid.
+*/
+typedef struct {
+  unsigned char *cells; // flags of each cell
+  int offsets[4]; // index changes when moving NORTH, EAST, SOUTH, WEST
+} Grid;
+
+/*
+  DistanceField struct, the length of the shortest path (around the walls and the body) from the bonus to every free cell.
+  The bonus stays put for many moves, so the field is computed once per bonus (a full BFS), then repaired after each move:
+  the freed tail can only bring cells closer (the decrease spreads from it), and the new head only pushes away
+  the cells whose every shortest path went through it, which are the only ones searched again.
+  Only the moves reading it keep it: on a large map, a move can push away most of the cells behind the body,
+  which costs more than the search of the few distances a move needs. So the field is built when a move reads it
+  (the aggressive strategy), repaired while the following moves read it too, and dropped after a move that didn't.
+*/
+typedef struct {
+  bool used; // whether the strategy can read the field (smart, lookahead), otherwise it is never computed
+  bool valid; // whether dist is the field of the current bonus
+  bool read; // whether the field was read since the last move (otherwise it is dropped instead of repaired)
+  int *dist; // moves from the bonus to each cell (-1: not free, or cut off from the bonus)
+  int *queue; // cells to spread from
+  unsigned long long *seeds; // cells to search again, packed as (distance << 32 | cell) to be sorted by distance
+  unsigned *stamp; // repair in which each cell had to be searched again
+  unsigned generation; // number of the current repair
+} DistanceField;
+
+/*
+  Bitboard struct, the free cells of the map as a mask of bits: bit i is the cell i of the grid (y * mapxsize + x),
+  64 cells per word, so the 80x20 level holds in 25 words. A step of a flood fill is then a few shifts per word:
+  moving EAST or WEST shifts the mask by one bit, NORTH or SOUTH by mapxsize bits (whole words, then bits).
+  The bits that wrap around from one row to the next land on the walls of the border, which the free mask clears.
+  Every mask is padded with empty words before and after the board, so the shifts read the words around a word
+  without bounds checks, and the number of words is a multiple of 4 for the SIMD kernel.
+*/
+typedef struct {
+  uint64_t *free; // free cells (the grid cells without GRID_OCCUPIED)
+  uint64_t *virtualFree; // copy of free changed by the virtual snake of the lookahead
+  uint64_t *reach; // cells reached by the current fill
+  uint64_t *next; // cells reached after one more step
+  int words; // words of the board
+  int padding; // empty words before and after the board
+  int rowWords; // mapxsize / 64 (the whole words of a shift by one row)
+  int rowBits; // mapxsize % 64 (the bits of a shift by one row)
+  bool simd; // whether the fills use fillStepSimd (SNAKE_BITBOARD=scalar: fillStep)
+} Bitboard;
+
+/*
+  Region struct, what the region analysis found behind a move
+*/
+typedef struct {
+  int size; // free cells reached, besides the start (the fill stops once the snake fits)
+  bool tail; // whether the tail was reached (the snake can follow it, so it can't get trapped)
+} Region;
+
+// kernels inlined in each specialization, even when the compiler would rather call them
+#if defined(__GNUC__)
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+/*
+  SizeKernels struct, the searches every move runs (the BFS of the distances and a step of the flood fill)
+  and the constants of the map size, chosen once per game by selectKernels.
+  The shipped levels have their own kernels, compiled with the size as a constant (see SIZE_KERNELS): the index change
+  of each move and the shifts of a row are immediates, and the 4 neighbors are checked one after another.
+  Any other size gets the generic kernels, which read them from the grid and the bitboard.
+*/
+typedef struct {
+  int mapxsize; // size the kernels are compiled for (0: any size)
+  int mapysize;
+  int (*bfs)(PathFinder *, const Grid *, int, const int *, int); // bfsDistances
+  int (*fillStep)(const Bitboard *, const uint64_t *, int, int); // fillStep
+  int (*fillStepSimd)(const Bitboard *, const uint64_t *, int, int); // fillStepSimd
+  int innerCells; // cells inside the border
+} SizeKernels;
+
+/*
+  MoveScores struct, what a scoring strategy (zigzag, aggressive) found about each move, NORTH to WEST.
+  The score of a valid move is - distance * distanceWeight + space * spaceWeight - trap,
+  and the best one is played (the fallback when no valid move scores above -999999).
+  Keeping the terms rather than the scores lets playerMoves score the moves of a whole batch of games at once.
+*/
+typedef struct {
+  bool valid[4]; // whether each move is valid (the terms of the others are 0)
+  double distance[4]; // moves from where the move leads to the target
+  double space[4]; // free neighbors there
+  double trap[4]; // trap penalty of the move
+  double distanceWeight; // weights of the terms
+  double spaceWeight;
+  action fallback; // move played when no move is valid (drawn at random)
+} MoveScores;
+
+/*
+  BatchScores struct, the scratch of a MoveBatch. The games whose move comes down to scoring leave their MoveScores
+  in deferred, then scoreBatch reads the same terms laid out move by move and game by game (struct of arrays),
+  so each vector operation works on 4 games. The arrays are padded to a multiple of 4 entries with invalid moves.
+*/
+struct BatchScores {
+  MoveScores *deferred; // scores left by the games (one per game of the batch at most)
+  int *games; // game of the batch of each deferred entry
+  int lanes; // entries of the arrays below (the capacity rounded up to a multiple of 4)
+  double *distance; // terms of move i of entry j at [i * lanes + j]
+  double *space;
+  double *trap;
+  long long *valid; // -1 if move i of entry j is valid, 0 otherwise (same layout)
+  double *distanceWeight; // weights of each entry
+  double *spaceWeight;
+  long long *best; // fallback of each entry, then the move chosen
+};
+
+#define MCTS_NODES 65536 // nodes of the MCTS tree (when it is full, the playouts go on without growing it)
+#define MCTS_EXPLORATION 0.7 // exploration constant of UCT
+
+/*
+  MctsNode struct, a node of the Monte Carlo search tree: the state reached by playing the moves from the root.
+*/
+typedef struct {
+  int parent; // parent node (-1 for the root)
+  int children[4]; // child reached by each action (-1: not expanded yet)
+  int visits; // number of playouts through this node
+  double value; // sum of their rewards
+  uint64_t hash; // Zobrist key of the state (see zobristKey)
+  int hint; // best action of the state in the transposition table, expanded first (-1: none)
+} MctsNode;
+
+/*
+  TranspositionEntry struct, a slot of a transposition table: the statistics of a state packed in one word,
+  and its Zobrist key XORed with them. There is no lock: a reader seeing half of a concurrent write gets
+  a key that doesn't match and ignores the entry, so a table can be shared by the searchers of several threads.
+*/
+typedef struct {
+  uint64_t check; // key ^ data
+  uint64_t data; // visits (bits 0-31), mean value (bits 32-47, in 1/65535), best action + 1 (48-50, 0: none), age (56-63)
+} TranspositionEntry;
+
+/*
+  TranspositionTable struct, the statistics of the states searched by MCTS, by Zobrist key: a fixed number
+  of buckets of 2 entries, the first one kept for the state with the most visits (replace by depth),
+  the second one always replaced. Entries of an older search (age) are replaced first.
+*/
+struct TranspositionTable {
+  TranspositionEntry *entries; // the entries (2 per bucket)
+  size_t mask; // number of entries - 1 (a power of 2)
+};
+
+#define TRANSPOSITION_ENTRIES 65536 // entries of a context's own table (1 MB)
+#define MCTS_MAX_SEEDED (1 << 24) // most playouts a node takes from the table (its visits stay far from overflowing)
+#define ZOBRIST_LINK 0 // kinds of Zobrist keys of a cell: a body link toward the head, by direction (0 to 3),
+#define ZOBRIST_HEAD 4 // the head,
+#define ZOBRIST_BONUS 5 // the bonus
+
+/*
+  MctsSearch struct, the tree and the budget of the MCTS strategy.
+  The nodes are allocated on the first move played with MCTS, and every move starts a new tree in them,
+  whose nodes start from the statistics the transposition table has for their states.
+*/
+typedef struct {
+  MctsNode *nodes; // pool of nodes
+  int used; // nodes of the current tree
+  long budget; // time budget per move in microseconds (0: none)
+  long maxPlayouts; // playout budget per move (0: none)
+  bool budgetChosen; // whether set by setMctsBudget (SNAKE_MCTS_BUDGET and SNAKE_MCTS_PLAYOUTS are then ignored)
+  MctsStats stats; // totals since the context was made
+  bool tableEnabled; // whether the searches go through a transposition table (SNAKE_MCTS_TABLE=off: no)
+  TranspositionTable *table; // table shared with other contexts (shareTranspositionTable), NULL: the context's own
+  TranspositionTable *ownTable; // the context's own table (allocated on the first search, cleared at each game)
+  unsigned age; // number of searches, stored in the entries
+} MctsSearch;
+
+/*
+  Playout struct, the state of one MCTS playout.
+  The board is never copied: the cells the playout changes are written in the overlay of the context
+  (see overlayCell), and its snake is a virtual snake, so starting a playout is O(1).
+*/
+typedef struct {
+  VirtualSnake snake; // the snake of the playout
+  int head; // cell of its head
+  int bonus; // cell of the bonus (-1 once eaten: the next one can't be known)
+  int steps; // moves played
+  int eatenAt; // move at which the bonus was eaten (-1: not eaten)
+} Playout;
+
+/*
+  Ponder struct, the decision computed ahead by a worker thread while the engine waits between two moves
+  (built with -DPLAYER_PONDER -pthread, played with SNAKE_PONDER=on). After returning a move, playerMove predicts
+  the state the engine will send next (the snake moved by that action, the bonus where it is: only moves that don't
+  eat are predicted, a new bonus can't be known) and the worker decides the move of that state on the context itself.
+  The next call takes the decision if its state is the predicted one; otherwise the context is put back
+  (random generator and counters as before the speculation, snake and grid resynced) and the move is decided as usual,
+  so the moves are the same with or without pondering. Until then the context belongs to the worker.
+*/
+typedef struct {
+  bool enabled; // whether moves are pondered (SNAKE_PONDER=on)
+  bool pending; // whether a prediction was handed to the worker and not taken yet
+  action played; // action the prediction follows
+  int mapxsize; // size of the predicted map
+  int mapysize;
+  char **rows; // predicted map
+  char *cells; // its characters (mapxsize + 1 per row)
+  int cellsCapacity; // characters allocated
+  struct snake_link *links; // predicted snake
+  int linksCapacity; // links allocated
+  action decision; // move of the predicted state
+  unsigned long long rng; // random generator before the speculation
+  int resyncs; // resyncs before the speculation
+  MoveStats stats; // counters of the game before the speculation
+  MctsStats mctsStats; // MCTS totals before the speculation
+#ifdef PLAYER_PONDER
+  bool started; // whether the worker runs
+  bool busy; // whether the worker is deciding
+  bool quit; // whether the worker must stop
+  pthread_t thread; // the worker
+  pthread_mutex_t lock; // guards busy and quit
+  pthread_cond_t wake; // signaled when there is a prediction (or quit)
+  pthread_cond_t done; // signaled when the decision is made
+#endif
+} Ponder;
+
+/*
+  GameContext struct, what the AI remembers about the current game from one call of snake() to the next.
+  The snake is kept in a ring buffer of positions (head first), so that after each move only the new head
+  has to be pushed and, unless the bonus was eaten, the old tail popped: no walk of the snake list, no scan of the map.
+  The bonus position is kept until it gets eaten. Any disagreement with the engine's state triggers a full resync.
+*/
+struct GameContext {
+  int mapxsize; // x size of the map of the current game
+  int mapysize; // y size of the map of the current game
+  Arena arena; // memory of the buffers below
+  PathFinder paths; // buffers of the path searches
+  Grid grid; // flat view of the map
+  DistanceField bonusField; // distances to the bonus
+  Bitboard bits; // free cells as bit masks, for the flood fills
+  SizeKernels kernels; // kernels and constants of the map size
+  bool genericKernels; // whether the generic kernels are used whatever the size (SNAKE_KERNELS=generic)
+  Position *body; // ring buffer of the snake's cells, from the head to the tail
+  int capacity; // size of the ring buffer (number of cells of the map)
+  int first; // index of the head in the ring buffer
+  int length; // snake length
+  Position headPos; // position of the snake's head
+  Position tailPos; // position of the snake's tail
+  Position bonusPos; // position of the bonus (the tail when there is no bonus on the map)
+  bool bonusFound; // whether bonusPos holds the bonus
+  int resyncs; // number of full resyncs in this game (should stay at 1)
+  strategy strategy; // strategy played in this game
+  bool strategyChosen; // whether the strategy was set by chooseStrategy (the environment variables are then ignored)
+  bool seeded; // whether rng was seeded
+  unsigned long long rng; // state of the random generator (see randomAction)
+  StrategyParams params; // constants of the strategies
+  bool paramsChosen; // whether params were set by setStrategyParams (SNAKE_PARAMS is then ignored)
+  bool lookahead; // whether moves toward the bonus are checked on a virtual snake first (SNAKE_LOOKAHEAD=on)
+  int *path; // cells of the planned path, from the first move to the target
+  int *virtualCells; // cells pushed by the virtual snake
+  unsigned *overlayStamp; // playout that last wrote each cell of the overlay
+  unsigned char *overlayCells; // grid flags written by the playouts (meaningful when stamped by the current playout)
+  unsigned overlayGeneration; // number of the current playout
+  MctsSearch mcts; // tree and budget of the MCTS strategy
+  Instrumentation moveStats; // latency and decision counters
+  FlightRecorder flight; // last decisions, for post-mortems
+  MoveScores *deferred; // where the scoring strategies leave their scores instead of choosing (playerMoves), NULL: they choose
+  bool deferredMove; // whether the move was left in deferred
+  HamiltonCycle cycle; // cycle of the current level (cached from one game to the next)
+  const char *levelDirectory; // directory of the compiled levels (SNAKE_LEVELS, NULL: the cycle is always computed)
+  PolicyTable policy; // solved moves of the current level (cached from one game to the next)
+  Ponder ponder; // decision computed ahead between two moves
+};
+
+/*
+  ParamInfo struct, the name of a field of StrategyParams (as written in the parameter files) and its place in the struct
+*/
+typedef struct {
+  const char *name; // name of the field
+  size_t offset; // offset of the field
+} ParamInfo;
+
+//Fields of StrategyParams, in the order they are written
+static const ParamInfo paramTable[] = {
+  {"aggressiveLength", offsetof(StrategyParams, aggressiveLength)},
+  {"bonusRadius", offsetof(StrategyParams, bonusRadius)},
+  {"fillRatio", offsetof(StrategyParams, fillRatio)},
+  {"distanceRatio", offsetof(StrategyParams, distanceRatio)},
+  {"zigzagBonusWeight", offsetof(StrategyParams, zigzagBonusWeight)},
+  {"zigzagSpaceWeight", offsetof(StrategyParams, zigzagSpaceWeight)},
+  {"aggressiveBonusWeight", offsetof(StrategyParams, aggressiveBonusWeight)},
+  {"aggressiveSpaceWeight", offsetof(StrategyParams, aggressiveSpaceWeight)},
+  {"trapWeight", offsetof(StrategyParams, trapWeight)},
+};
+
+//State of the current game, kept between two calls of snake() (other contexts can be made with newGameContext)
+static GameContext gameContext;
+static bool flightArmed; // whether the dump of gameContext's flight recorder is set up (see armFlightDump)
+static char flightPath[4096]; // file it is dumped to
+
 // prototypes of the local/private functions
 static void printAction(action);
-static bool actionValid(action, char **, int, int);
-static Position getHeadPos(snake_list);
-static Position getTailPos(snake_list);
-static action followTailStrategy(char **, int, int, Position, Position, Position, snake_list);
-static int countValidMoves(char **, int, int);
-static int getSnakeLength(snake_list);
-static action zigzagStrategy(char **, int, int, Position, Position, Position, action);
-static action aggressiveStrategy(char **, int, int, Position, Position);
-static action smartStrategy(char **, int, int, Position, Position, Position, snake_list, action);
+static action decideMove(GameContext *, char **, int, int, snake_list, action);
+static action chooseMove(GameContext *, char **, int, int, snake_list, action);
+static void startPonder(GameContext *, char **, int, int, snake_list, action);
+static bool takePonder(GameContext *, char **, int, int, snake_list, action, action *);
+static void dropPonder(GameContext *);
+static void stopPonder(GameContext *);
+#ifdef PLAYER_PONDER
+static void *ponderWorker(void *);
+static void waitPonder(Ponder *);
+static void undoPonder(GameContext *);
+#endif
+static void printMove(const GameContext *, action);
+static action randomAction(GameContext *);
+static bool parseStrategy(const char *, strategy *, bool *);
+static bool actionValid(GameContext *, action, int);
+static bool moveValid(GameContext *, action, int);
+static bool findBonus(char **, int, int, Position *);
+static void buildGrid(GameContext *, char **);
+static void resyncContext(GameContext *, char **, int, int, snake_list);
+static void updateContext(GameContext *, char **, int, int, snake_list, action);
+static void *arenaAlloc(Arena *, size_t);
+static void layoutBuffers(GameContext *);
+static void setupBuffers(GameContext *);
+static bool cellFree(char);
+static void newSearch(PathFinder *);
+KERNEL_INLINE void bfsVisit(PathFinder *, const unsigned char *, int, int, const int *, int, int *, int *);
+KERNEL_INLINE int bfsKernel(PathFinder *, const unsigned char *, int, int, const int *, int);
+static int bfsDistances(PathFinder *, const Grid *, int, const int *, int);
+static unsigned long long heapEntry(int, int, int);
+static int findPath(PathFinder *, char **, int, Position, Position, bool, action *);
+static int pathDistance(const PathFinder *, int);
+static int pathToBonus(GameContext *, char **, action *);
+static int pathToTail(GameContext *, char **, action *);
+static void distancesToTarget(GameContext *, Position, Position);
+static void buildBonusField(GameContext *);
+static void blockFieldCell(GameContext *, int);
+static void freeFieldCell(GameContext *, int);
+static int compareSeeds(const void *, const void *);
+static int countValidMoves(GameContext *, int);
+static void setCellBit(uint64_t *, int, bool);
+static bool cellBit(const uint64_t *, int);
+static bool touchesCell(const GameContext *, const uint64_t *, int);
+KERNEL_INLINE int fillStepKernel(const Bitboard *, const uint64_t *, int, int, int, int);
+static int fillStep(const Bitboard *, const uint64_t *, int, int);
+KERNEL_INLINE int fillStepSimdKernel(const Bitboard *, const uint64_t *, int, int, int, int);
+static int fillStepSimd(const Bitboard *, const uint64_t *, int, int);
+static void selectKernels(GameContext *);
+static void fillRegion(GameContext *, const uint64_t *, int, int, int, Region *);
+static void regionAround(GameContext *, int, int, Region *);
+static double trapPenalty(GameContext *, int);
+static void startScores(GameContext *, MoveScores *, double, double);
+static double moveScore(const MoveScores *, int);
+static action bestScoredMove(const MoveScores *);
+static action scoreMoves(GameContext *, const MoveScores *);
+static void gatherScores(BatchScores *, int);
+static void scoreBatch(BatchScores *, int);
+static action zigzagStrategy(char **, int, int, Position, Position, Position, GameContext *, action);
+static action aggressiveStrategy(char **, int, int, Position, Position, GameContext *);
+static action smartStrategy(char **, int, int, Position, Position, Position, GameContext *, action);
+static void startVirtualSnake(VirtualSnake *, const GameContext *);
+static int virtualTail(const VirtualSnake *);
+static int virtualTailNext(const VirtualSnake *);
+static int advanceVirtualSnake(VirtualSnake *, int, bool);
+static void moveVirtualSnake(VirtualSnake *, uint64_t *, int, bool);
+static int planPath(GameContext *, int);
+static bool safePathToBonus(GameContext *, char **, action *);
+static action lookaheadStrategy(char **, int, int, Position, Position, Position, GameContext *, action);
+static unsigned long levelSignature(char **, int, int);
+static bool buildRectangleCycle(HamiltonCycle *, char **, int, int);
+static bool buildBlockCycle(HamiltonCycle *, char **, int, int);
+static bool numberCycle(HamiltonCycle *, int, int);
+static void releaseCycle(HamiltonCycle *);
+static bool computeCycle(HamiltonCycle *, char **, int, int);
+static void levelArtifactPath(char *, size_t, const char *, int, int, unsigned long);
+static size_t levelArtifactTables(int);
+static bool loadLevelArtifact(HamiltonCycle *, const char *, char **, int, int, unsigned long);
+static void prepareCycle(HamiltonCycle *, const char *, char **, int, int);
+static action actionTowards(int, int, int);
+static action hamiltonStrategy(char **, int, int, Position, Position, Position, GameContext *, action);
+static void policyPath(char *, size_t, const char *, int, int, unsigned long);
+static size_t policyEntriesOffset(int);
+static uint64_t policySlot(uint64_t, uint64_t);
+static void releasePolicy(PolicyTable *);
+static bool loadPolicy(PolicyTable *, const char *, char **, int, int, unsigned long);
+static void preparePolicy(PolicyTable *, const char *, char **, int, int);
+static bool policyMove(GameContext *, action *);
+static double monotonicSeconds(void);
+static long long monotonicNanoseconds(void);
+static void notePick(GameContext *, pick);
+static void noteLatency(MoveStats *, long long);
+static void endGameStats(GameContext *);
+static void printLastGameStats(void);
+static void storeSequence(uint32_t *, uint32_t);
+static void beginFlight(GameContext *);
+static void recordScores(GameContext *, const MoveScores *);
+static void recordFlight(GameContext *, action, bool);
+static bool writeAll(int, const void *, size_t);
+static void armFlightDump(void);
+static void dumpLastFlight(void);
+static void flightSignal(int);
+static double approximateLog(double);
+static double approximateSqrt(double);
+static void startPlayout(GameContext *, Playout *);
+static unsigned char overlayCell(const GameContext *, int);
+static int playoutMoves(const GameContext *, const Playout *);
+static void playoutStep(GameContext *, Playout *, int);
+static int rolloutMove(GameContext *, const Playout *, int);
+static double playoutReward(const GameContext *, const Playout *, bool);
+static uint64_t zobristKey(int, int);
+static int linkDirection(const GameContext *, int, int);
+static uint64_t snakeHash(const GameContext *);
+static uint64_t playoutHash(const GameContext *, const Playout *, uint64_t, int);
+static uint64_t loadWord(const uint64_t *);
+static void storeWord(uint64_t *, uint64_t);
+static bool probeTable(const TranspositionTable *, uint64_t, uint64_t *);
+static void storeTable(TranspositionTable *, uint64_t, uint64_t);
+static TranspositionTable *searchTable(GameContext *);
+static int newNode(MctsSearch *, const TranspositionTable *, int, int, uint64_t);
+static void saveTree(const MctsSearch *, TranspositionTable *);
+static action mctsStrategy(char **, int, int, Position, Position, Position, GameContext *, action);
 
 
 /*
@@ -42,283 +657,1893 @@ action snake(
 	     snake_list s, // snake coded as a linked list
 	     action last_action // last action made, set to -1 in the beginning 
 	     ) {
-  action a; // action to choose and return
-  
-  //Coordinates of the snake's head---------------------------------------------------------------------------
-  Position headPos = getHeadPos(s);
-
-  if (DEBUG){//Print the coordinates of the of the head
-    printf("X coordinates of the head = %d\nY coordinates of the head = %d\n", headPos.x, headPos.y);
+  if (!gameContext.seeded){//The engine seeds rand(), our generator is seeded from it once
+    seedGameContext(&gameContext, (unsigned long long)rand());
   }
-  //----------------------------------------------------------------------------------------------------------
+  action a = playerMove(&gameContext, map, mapxsize, mapysize, s, last_action);
+  if (gameContext.moveStats.print && !gameContext.moveStats.atexitDone){//The engine doesn't tell when the game ends
+    gameContext.moveStats.atexitDone = (atexit(printLastGameStats) == 0);
+  }
+  if (!flightArmed){//Nor how it ends: the flight recorder is dumped at exit, or when the program crashes
+    flightArmed = true;
+    armFlightDump();
+  }
+  return a;
+}
 
-  //Coordinates of the snake's tail---------------------------------------------------------------------------
-  Position tailPos = getTailPos(s);
+/*
+  newGameContext function:
+  This function allocates a new context, with its random generator seeded. It returns NULL if there is no memory.
+  The buffers are allocated when the context plays its first game.
+*/
+GameContext *newGameContext(unsigned long long seed){
+  GameContext *ctx = calloc(1, sizeof(GameContext));
+  if (ctx != NULL) seedGameContext(ctx, seed);
+  return ctx;
+}
 
-  if (DEBUG){//Print the coordinates of the tail
-    printf("X coordinates of the tail = %d\nY coordinates of the tail = %d\n", tailPos.x, tailPos.y);
-  }
-  //----------------------------------------------------------------------------------------------------------
+/*
+  freeGameContext function:
+  This function releases a context made by newGameContext, and all its buffers.
+*/
+void freeGameContext(GameContext *ctx){
+  if (ctx == NULL) return;
+  stopPonder(ctx); //(the worker may still use the buffers)
+  free(ctx->arena.base);
+  releaseCycle(&ctx->cycle);
+  releasePolicy(&ctx->policy);
+  free(ctx->mcts.nodes);
+  freeTranspositionTable(ctx->mcts.ownTable);
+  free(ctx);
+}
 
-  //Coordinates of the Bonus----------------------------------------------------------------------------------
-  Position bonusPos;
-
-  //Look for the Bonus (we start from 1 and subtract 1 to not waste time looking in the walls)
-  for (int row = 1; row < mapysize - 1; row++)
-    for (int col = 1; col < mapxsize - 1; col++)
-      if (map[row][col] == BONUS){
-        bonusPos.x = col;
-        bonusPos.y = row;
-        break; //Bonus found, break the loop
-      }
-  
-  if (DEBUG){ //Print the coordinates of the bonus
-    printf("X coordinates of the bonus = %d\nY coordinates of the bonus = %d\n", bonusPos.x, bonusPos.y);
-  }
-  //-----------------------------------------------------------------------------------------------------------
+/*
+  seedGameContext function:
+  This function seeds the random generator of a context: the same seed on the same game gives the same moves.
+*/
+void seedGameContext(GameContext *ctx, unsigned long long seed){
+  dropPonder(ctx);
+  ctx->rng = seed;
+  ctx->seeded = true;
+}
 
-  a = smartStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, s, last_action);
+/*
+  getRandomState function:
+  This function returns the state of the random generator of a context: seeding a context with it
+  (seedGameContext) makes it draw the same numbers from there, e.g. to replay a recorded decision.
+*/
+unsigned long long getRandomState(GameContext *ctx){
+  dropPonder(ctx); //A pondered move changes the state until it is taken or discarded
+  return ctx->rng;
+}
 
-  if (DEBUG) {
-    int snakeLength = getSnakeLength(s);
-    int distToBonus = abs(headPos.x - bonusPos.x) + abs(headPos.y - bonusPos.y);
-    printf("Snake length: %d, Distance to bonus: %d - Moving: ", snakeLength, distToBonus);
-    printAction(a);
-    printf("\n");
-  }
+/*
+  chooseStrategy function:
+  This function sets the strategy of the context's next games ("smart", "hamilton", "mcts" or "lookahead"),
+  in place of the environment variables. It returns false if the name is unknown.
+*/
+bool chooseStrategy(GameContext *ctx, const char *name){
+  dropPonder(ctx);
+  if (!parseStrategy(name, &ctx->strategy, &ctx->lookahead)) return false;
+  ctx->strategyChosen = true;
+  return true;
+}
 
-  return a; // answer to the game engine
+/*
+  enableMoveStats function:
+  This function turns the instrumentation of a context on or off, in place of SNAKE_STATS
+  (the counters are read with getMoveStats, nothing is printed).
+*/
+void enableMoveStats(GameContext *ctx, bool enabled){
+  dropPonder(ctx);
+  ctx->moveStats.enabled = enabled;
+  ctx->moveStats.print = false;
+  ctx->moveStats.chosen = true;
 }
 
-//Helper functions
 /*
-  printAction function:
-  This function prints the input action name on screen.
+  getMoveStats function:
+  This function gives the counters of all the games played with a context, the current one included.
 */
-static void printAction(action a) {
-  switch(a) {
-  case NORTH:
-    printf("NORTH");
-    break;
-  case EAST:
-    printf("EAST");
-    break;
-  case SOUTH:
-    printf("SOUTH");
-    break;
-  case WEST:
-    printf("WEST");
-    break;
-  }
+void getMoveStats(GameContext *ctx, MoveStats *stats){
+  dropPonder(ctx); //(so is a pondered move's count)
+  *stats = ctx->moveStats.total;
+  mergeMoveStats(stats, &ctx->moveStats.game);
 }
 
 /*
-  actionValid funtion:
-  This function checks if the action is valid or not, then changes the ok variable accordingly.
-*/
-static bool actionValid(action a, char ** map, int x, int y){
-  switch(a) { // check whether the randomly selected action is valid, i.e., if its preconditions are satisfied 
-  case NORTH: // going toward this direction does not put snake's head into
-    if(map[y-1][x]!=WALL // a wall
-	    && map[y-1][x]!=SNAKE_BODY // snake's body
-	    && map[y-1][x]!=SNAKE_TAIL) // snake's tail
-	    return true; // this direction is safe, hence valid!
-    break;
-  case EAST: // going toward this direction does not put snake's head into
-    if(map[y][x+1]!=WALL // a wall
-	    && map[y][x+1]!=SNAKE_BODY // snake's body
-	    && map[y][x+1]!=SNAKE_TAIL) // snake's tail
-	    return true; // this direction is safe, hence valid!
-    break;
-  case SOUTH: // going toward this direction does not put snake's head into
-    if(map[y+1][x]!=WALL // a wall
-	    && map[y+1][x]!=SNAKE_BODY // snake's body
-	    && map[y+1][x]!=SNAKE_TAIL) // snake's tail
-	  return true; // this direction is safe, hence valid!
-    break;
-  case WEST: // going toward this direction does not put snake's head into
-    if(map[y][x-1]!=WALL // a wall
-	    && map[y][x-1]!=SNAKE_BODY // snake's body
-	    && map[y][x-1]!=SNAKE_TAIL) // snake's tail
-	    return true; // this direction is safe, hence valid!
-    break;
-  }
-  return false;
+  mergeMoveStats function:
+  This function adds counters to others (e.g. the counters of several contexts).
+*/
+void mergeMoveStats(MoveStats *into, const MoveStats *from){
+  into->calls += from->calls;
+  for (int i = 0; i < MOVE_STATS_BUCKETS; i++) into->latency[i] += from->latency[i];
+  if (from->maxLatency > into->maxLatency) into->maxLatency = from->maxLatency;
+  for (int i = 0; i < MOVE_STATS_PICKS; i++) into->picks[i] += from->picks[i];
+  into->validChecks += from->validChecks;
+  into->neighborCounts += from->neighborCounts;
+  into->regionCells += from->regionCells;
+  into->ponderHits += from->ponderHits;
+  into->ponderMisses += from->ponderMisses;
 }
 
 /*
-  getHeadPos function:
-  This function takes in the snake list and returns the position of the head in the Position type variable.
+  moveStatsPickName function:
+  This function returns the name of a decision counted in MoveStats.picks.
 */
-static Position getHeadPos(snake_list s){
-  Position HeadPos;
-  HeadPos.x = s->x;
-  HeadPos.y = s->y;
-  return HeadPos;
+const char *moveStatsPickName(int i){
+  return pickNames[i];
 }
 
 /*
-  getHeadPos function:
-  This function takes in the snake list and returns the position of the tail in a Position type variable.
+  printMoveStats function:
+  This function prints a summary of counters: moves, p50/p99/max latency (read from the histogram: the upper bound
+  of the bucket holding the percentile), calls of the helpers per move, and the share of each decision.
 */
-static Position getTailPos(snake_list s){
-  Position tailPos;
-  snake_list current = s;
+void printMoveStats(FILE *file, const char *title, const MoveStats *stats){
+  double percentiles[2] = {0.5, 0.99};
+  double values[2] = {0, 0};
+  if (stats->calls == 0) return;
 
-  while(current->next != NULL){
-    current = current->next;
+  for (int p = 0; p < 2; p++){
+    long rank = (long)(percentiles[p] * stats->calls + 0.5), seen = 0;
+    if (rank < 1) rank = 1;
+    for (int b = 0; b < MOVE_STATS_BUCKETS; b++){
+      seen += stats->latency[b];
+      if (seen < rank) continue;
+      int next = b + 1;
+      long long upper = (next < 4) ? next : (long long)(4 + next % 4) << (next / 4 - 1); //Start of the next bucket
+      values[p] = (upper < stats->maxLatency) ? upper : stats->maxLatency;
+      break;
+    }
+  }
+  fprintf(file, "%s: %ld moves, latency p50 %.2f us, p99 %.2f us, max %.2f us, %.1f actionValid, %.1f countValidMoves"
+          " and %.1f region cells per move\n",
+          title, stats->calls, values[0] / 1e3, values[1] / 1e3, stats->maxLatency / 1e3,
+          (double)stats->validChecks / stats->calls, (double)stats->neighborCounts / stats->calls,
+          (double)stats->regionCells / stats->calls);
+  long decisions = 0;
+  for (int i = 0; i < MOVE_STATS_PICKS; i++) decisions += stats->picks[i];
+  fprintf(file, "  strategy mix:");
+  for (int i = 0; i < MOVE_STATS_PICKS; i++){
+    if (stats->picks[i] > 0) fprintf(file, " %s %.1f%%", pickNames[i], 100.0 * stats->picks[i] / decisions);
   }
+  fprintf(file, "\n");
+  if (stats->ponderHits + stats->ponderMisses > 0){
+    fprintf(file, "  pondered: %ld moves taken from the worker, %ld mispredicted\n", stats->ponderHits, stats->ponderMisses);
+  }
+}
 
-  tailPos.x = current->x;
-  tailPos.y = current->y;
-  return tailPos;
+/*
+  setMctsBudget function:
+  This function sets the budget of each MCTS move, in place of SNAKE_MCTS_BUDGET and SNAKE_MCTS_PLAYOUTS:
+  the search stops after this many microseconds, or after this many playouts (0: no limit of this kind).
+  With no limit at all, the default time budget (1000 microseconds) is used.
+*/
+void setMctsBudget(GameContext *ctx, long microseconds, long playouts){
+  dropPonder(ctx);
+  ctx->mcts.budget = (microseconds > 0) ? microseconds : 0;
+  ctx->mcts.maxPlayouts = (playouts > 0) ? playouts : 0;
+  if (ctx->mcts.budget == 0 && ctx->mcts.maxPlayouts == 0) ctx->mcts.budget = 1000;
+  ctx->mcts.budgetChosen = true;
 }
 
 /*
-  countValidMoves function:
-  This function counts the valid moves possible, based on the position given by x and y coordinates
+  getMctsStats function:
+  This function gives the totals of the MCTS moves played with a context (playouts, time, slowest move).
 */
-static int countValidMoves(char **map, int x, int y){
-  int count = 0; //Counter to return the value
+void getMctsStats(GameContext *ctx, MctsStats *stats){
+  dropPonder(ctx);
+  *stats = ctx->mcts.stats;
+}
 
-  if (map[y-1][x] != WALL && map[y-1][x] != SNAKE_BODY && map[y-1][x] != SNAKE_TAIL) count++; // NORTH
-  if (map[y][x+1] != WALL && map[y][x+1] != SNAKE_BODY && map[y][x+1] != SNAKE_TAIL) count++; // EAST
-  if (map[y+1][x] != WALL && map[y+1][x] != SNAKE_BODY && map[y+1][x] != SNAKE_TAIL) count++; // SOUTH
-  if (map[y][x-1] != WALL && map[y][x-1] != SNAKE_BODY && map[y][x-1] != SNAKE_TAIL) count++; // WEST
+/*
+  headPathToBonus and headPathToTail functions:
+  These functions give the length of the shortest path from the head to the bonus or to the tail (-1 if there is none,
+  or no game yet) and its first move, on the map of the context's last move (the map given to it, as it was then).
+*/
+int headPathToBonus(GameContext *ctx, char **map, action *firstMove){
+  dropPonder(ctx);
+  if (ctx->body == NULL || ctx->paths.parent == NULL) return -1;
+  return pathToBonus(ctx, map, firstMove);
+}
 
-  return count;
+int headPathToTail(GameContext *ctx, char **map, action *firstMove){
+  dropPonder(ctx);
+  if (ctx->body == NULL || ctx->paths.parent == NULL) return -1;
+  return pathToTail(ctx, map, firstMove);
 }
 
 /*
-  followTailStrategy function:
-  This function chooses the best move possible, one that will not trap us by following the tail
-  and help us take the bonus if it's close to the path to the tail.
+  newTranspositionTable function:
+  This function allocates an empty transposition table of at least the given number of entries (rounded up to
+  a power of 2), to be shared by contexts with shareTranspositionTable. It returns NULL if there is no memory.
 */
-static action followTailStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, snake_list s){
-  
-  action moves[4] = {NORTH, EAST, SOUTH, WEST}; //Array to iterate through the moves without naming them everytime
-  //We store the coordinates changes in these arrays, they represent the how the position changes when moving in each direction,
-  //Example: moving NORTH, means the difference between x before and after the move is dx[0] and same for y, dy[0], same goes for EAST with index 1 and so on...
-  int dx[4] = {0, 1, 0, -1};
-  int dy[4] = {-1, 0, 1, 0};
-
-  int snakeLength = getSnakeLength(s);//Get snake length
-
-  //Calculate dynamic tolerance (ignore getting trapped) based on snake length and map size
-  //Longer snake need to have minimal tolerance, can easily get trapped
-  //Shorter snake we can go for the bonus without checking because the risk is minimal
-  int mapSize = (mapxsize + mapysize)/2; //Calculate the average dimension of the map
-  int tolerance = mapSize/2 - snakeLength/3; //To optimize the division constants later with tests
-
-  //Ensure minimum tolerance of 5
-  if (tolerance < 5) tolerance = 5;
-
-  //Here we will store the target position, it will be either tail or bonus
-  Position target;
-
-  //Here we will check for the best target between the bonus and the tail, to stay safe and be greedy (based on the tolenrance calculated)
-  if (snakeLength <= 5){//Small snake, very low risk of getting trapped (in big maps)
-    target = bonusPos;
-  } else {//Big snake, be careful and calculate the optimal target between the bonus and tail to stay safe and progress
-    //Calculate the distances:
-    int distHeadToBonus = abs(headPos.x - bonusPos.x) + abs(headPos.y - bonusPos.y);//Head to bonus distance
-    int distHeadToTail = abs(headPos.x - tailPos.x) + abs(headPos.y - tailPos.y); // Head to tail distance
-    int distBonusToTail = abs(bonusPos.x - tailPos.x) + abs(bonusPos.y - tailPos.y);// Bonus to tail distance
-
-    //If the bonus is in the path to the tail (or close (tolerance as max number of cells)), go to the bonus directly
-    //Otherwise go to tail to stay safe and not get trapped
-    if (distHeadToBonus + distBonusToTail <= distHeadToTail + tolerance){
-      target = bonusPos; //The bonus is on our path or very close so we go for it
-    } else {
-      target = tailPos; //Otherwise chase the tail to stay safe
-    }
+TranspositionTable *newTranspositionTable(size_t entries){
+  size_t size = 2;
+  while (size < entries) size *= 2;
+  TranspositionTable *table = malloc(sizeof(TranspositionTable));
+  if (table == NULL) return NULL;
+  table->entries = calloc(size, sizeof(TranspositionEntry));
+  if (table->entries == NULL){
+    free(table);
+    return NULL;
   }
+  table->mask = size - 1;
+  return table;
+}
 
-  //Here wee find the best move to reach the target we set, based on a score we will calculate for each move
-  action best_move = rand()%4; //We initialize the best move to choose with a random move
-  int best_score = -999999; //We calculate the scores of the best 
+/*
+  freeTranspositionTable function:
+  This function releases a table made by newTranspositionTable (no context may use it anymore).
+*/
+void freeTranspositionTable(TranspositionTable *table){
+  if (table == NULL) return;
+  free(table->entries);
+  free(table);
+}
 
-  for (int i = 0; i < 4; i++){//We go through all the moves possible in the array moves[4]
-    //Calculate the new head coordinates after the move
-    int newX = headPos.x + dx[i];
-    int newY = headPos.y + dy[i];
+/*
+  shareTranspositionTable function:
+  This function makes the MCTS searches of a context use a table shared with other contexts (e.g. the searchers
+  of one game on several threads), in place of its own one; NULL goes back to its own one. A shared table
+  is always used (SNAKE_MCTS_TABLE is ignored), and never cleared by the context.
+*/
+void shareTranspositionTable(GameContext *ctx, TranspositionTable *table){
+  dropPonder(ctx);
+  ctx->mcts.table = table;
+}
 
-    //Check if this move is valid
-    if (!actionValid(moves[i], map, headPos.x, headPos.y)){//If action not valid we skip this move
-      continue;
-    }
+/*
+  defaultStrategyParams function:
+  This function fills a parameter set with the values the strategies were written with.
+*/
+void defaultStrategyParams(StrategyParams *params){
+  params->aggressiveLength = 15;
+  params->bonusRadius = 5;
+  params->fillRatio = 0.6;
+  params->distanceRatio = 1.5;
+  params->zigzagBonusWeight = 10;
+  params->zigzagSpaceWeight = 50;
+  params->aggressiveBonusWeight = 200;
+  params->aggressiveSpaceWeight = 30;
+  params->trapWeight = 1000;
+}
+
+/*
+  setStrategyParams function:
+  This function sets the constants of the strategies for the context's games, in place of SNAKE_PARAMS.
+*/
+void setStrategyParams(GameContext *ctx, const StrategyParams *params){
+  dropPonder(ctx);
+  ctx->params = *params;
+  ctx->paramsChosen = true;
+}
+
+/*
+  strategyParamCount, strategyParamName and strategyParam functions:
+  These functions let a program go through the fields of StrategyParams by number (e.g. to tune them).
+*/
+int strategyParamCount(void){
+  return (int)(sizeof(paramTable) / sizeof(paramTable[0]));
+}
+
+const char *strategyParamName(int i){
+  return paramTable[i].name;
+}
 
-    int score = 0; //Store the score of the current move based on:
-                  // distance to the target (close is better)
-                  // space around this position (free cells) (the more the better)
-                  // distance to the center to avoid edges (the closer the better)
+double *strategyParam(StrategyParams *params, int i){
+  return (double *)((char *)params + paramTable[i].offset);
+}
 
-    // First: distance to target
-    int distToTarget = abs(newX - target.x) + abs(newY - target.y);
-    score -= distToTarget * 100; // 100 coefficent to prioritize getting closer to the target
+/*
+  readStrategyParams function:
+  This function reads the line of a parameter file made for a map size: "<x size>x<y size> name=value name=value ...".
+  The fields missing from the line (or unknown names) are left as they are. Lines starting with # are comments.
+  It returns false if the file can't be read or has no line for this map size.
+*/
+bool readStrategyParams(const char *filename, int mapxsize, int mapysize, StrategyParams *params){
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) return false;
 
-    // Second: Space around the position
-    int freeNeighbors = countValidMoves(map, newX, newY);
-    score += freeNeighbors * 10;
+  char line[4096];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), file) != NULL){
+    int x, y, start;
+    if (line[0] == '#' || sscanf(line, "%dx%d%n", &x, &y, &start) != 2 || x != mapxsize || y != mapysize) continue;
+    found = true;
 
-    // Third Avoid edges and corners
-    int distToCenter = abs(newX - mapxsize/2) + abs(newY - mapysize/2);
-    score -= distToCenter;
-    
-    if (score > best_score){ //If the current score is better, take this move and update the best_score
-      best_score = score;
-      best_move = moves[i];
+    char *p = line + start;
+    for (;;){
+      p += strspn(p, " \t\r\n");
+      size_t nameLength = strcspn(p, "= \t\r\n");
+      if (nameLength == 0 || p[nameLength] != '=') break;
+      char *end;
+      double value = strtod(p + nameLength + 1, &end);
+      if (end == p + nameLength + 1) break; //Not a number
+      for (int i = 0; i < strategyParamCount(); i++){
+        if (strlen(paramTable[i].name) == nameLength && strncmp(paramTable[i].name, p, nameLength) == 0){
+          *strategyParam(params, i) = value;
+        }
+      }
+      p = end;
     }
   }
+  fclose(file);
+  return found;
+}
 
-  return best_move;
+/*
+  writeStrategyParams function:
+  This function writes the line of a parameter file for a map size (see readStrategyParams).
+*/
+void writeStrategyParams(FILE *file, int mapxsize, int mapysize, const StrategyParams *params){
+  StrategyParams copy = *params;
+  fprintf(file, "%dx%d", mapxsize, mapysize);
+  for (int i = 0; i < strategyParamCount(); i++){
+    fprintf(file, " %s=%.6g", paramTable[i].name, *strategyParam(&copy, i));
+  }
+  fprintf(file, "\n");
 }
 
 /*
-  getSnakeLength function:
-  This function returns the length of the snake
+  playerMove function:
+  This function is snake() played with a given context (see player_api.h).
 */
-static int getSnakeLength(snake_list s){
-  int length = 0;
-  snake_list current = s;
-  while(current != NULL){ //Not the end of the snake
-    length++;
-    current = current->next;
+action playerMove(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action last_action){
+  bool timed = ctx->moveStats.enabled; //(the first move of a context is not timed: SNAKE_STATS is read by updateContext)
+  long long start = timed ? monotonicNanoseconds() : 0;
+
+  action a; // action to choose and return
+  bool pondered = takePonder(ctx, map, mapxsize, mapysize, s, last_action, &a);
+  if (!pondered){
+    a = decideMove(ctx, map, mapxsize, mapysize, s, last_action);
   }
-  return length;
+  printMove(ctx, a);
+  recordFlight(ctx, a, pondered);
+
+  if (timed && ctx->moveStats.enabled){
+    noteLatency(&ctx->moveStats.game, monotonicNanoseconds() - start);
+  }
+  startPonder(ctx, map, mapxsize, mapysize, s, a); //Decide the next move while the engine waits
+  return a; // answer to the game engine
 }
 
+#ifdef PLAYER_PONDER
 /*
-  zigzagStrategy function:
-  This function returns the action needed to go in a zigzag pattern while leaving a path on the bottom of the map
-  so the snake doesn't get trapped.
+  ponderWorker function:
+  This function is the worker thread of a context: it waits for a prediction, decides its move, and waits again.
 */
-static action zigzagStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, action last_action){
-  
-  action moves[4] = {NORTH, EAST, SOUTH, WEST}; //Array to iterate through the moves without naming them everytime
-  //We store the coordinates changes in these arrays, they represent the how the position changes when moving in each direction,
-  //Example: moving NORTH, means the difference between x before and after the move is dx[0] and same for y, dy[0], same goes for EAST with index 1 and so on...
+static void *ponderWorker(void *arg){
+  GameContext *ctx = arg;
+  Ponder *p = &ctx->ponder;
+  pthread_mutex_lock(&p->lock);
+  for (;;){
+    while (!p->busy && !p->quit) pthread_cond_wait(&p->wake, &p->lock);
+    if (p->quit) break;
+    pthread_mutex_unlock(&p->lock);
+    action a = decideMove(ctx, p->rows, p->mapxsize, p->mapysize, p->links, p->played);
+    pthread_mutex_lock(&p->lock);
+    p->decision = a;
+    p->busy = false;
+    pthread_cond_signal(&p->done);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+/*
+  startPonder function:
+  This function predicts the state the engine will send after the move a (see Ponder): the map and the snake list
+  as the engine draws them after a move that doesn't eat. The worker then decides the move of that state.
+  Nothing is predicted when the move eats the bonus or leaves the map.
+*/
+static void startPonder(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action a){
   int dx[4] = {0, 1, 0, -1};
   int dy[4] = {-1, 0, 1, 0};
+  Ponder *p = &ctx->ponder;
+  if (!p->enabled || (int)a < NORTH || (int)a > WEST || s == NULL || ctx->body == NULL) return;
+  int x = s->x + dx[a], y = s->y + dy[a];
+  if (x < 0 || x >= mapxsize || y < 0 || y >= mapysize || (map[y][x] != PATH && map[y][x] != SNAKE_TAIL)) return;
 
-  //zigzag pattern: move right, go down at the edge of the map, move left, go down, repeat
-  //With this we can sweep the map and get the bonus in case it's too far away without getting trapped
+  int length = 0;
+  for (snake_list current = s; current != NULL; current = current->next) length++;
+  int cells = (mapxsize + 1) * mapysize;
+  if (length > p->linksCapacity){
+    struct snake_link *links = realloc(p->links, length * sizeof(struct snake_link));
+    if (links == NULL) return;
+    p->links = links;
+    p->linksCapacity = length;
+  }
+  if (cells > p->cellsCapacity || mapysize != p->mapysize){
+    char *chars = realloc(p->cells, cells);
+    char **rows = realloc(p->rows, mapysize * sizeof(char *));
+    if (chars != NULL) p->cells = chars;
+    if (rows != NULL) p->rows = rows;
+    if (chars == NULL || rows == NULL) return;
+    p->cellsCapacity = cells;
+  }
+  p->mapxsize = mapxsize;
+  p->mapysize = mapysize;
+  for (int row = 0; row < mapysize; row++){
+    p->rows[row] = p->cells + (size_t)row * (mapxsize + 1);
+    memcpy(p->rows[row], map[row], mapxsize);
+    p->rows[row][mapxsize] = '\0';
+  }
 
-  //Check if we're at the right edge (near the right wall)
-  bool atRightEdge = (headPos.x >= mapxsize - 3); // Leave path for the snake to comeback -1 for the wall, -1 for the free path and -1 where the snake should be
-  //Check if we're at the left edge (near the right wall)
-  bool atLeftEdge = (headPos.x <= 2); //same logic because the map starts at 0
-  bool atBottomEdge = (headPos.y >= mapysize - 3); //Same logic
-  bool atTopEdge = (headPos.y <= 2); //Same logic
+  //The new head, then the old links but the tail (the engine's process_move)
+  p->links[0] = (struct snake_link){SNAKE_HEAD, x, y, NULL};
+  snake_list current = s;
+  for (int i = 1; i < length; i++, current = current->next){
+    p->links[i] = (struct snake_link){i == length - 1 ? SNAKE_TAIL : SNAKE_BODY, current->x, current->y, NULL};
+    p->links[i - 1].next = &p->links[i];
+  }
+  p->rows[current->y][current->x] = PATH; //The old tail (the head of a snake of length 1)
+  if (length > 1){
+    p->rows[s->y][s->x] = SNAKE_BODY;
+    p->rows[p->links[length - 1].y][p->links[length - 1].x] = SNAKE_TAIL;
+  }
+  p->rows[y][x] = SNAKE_HEAD;
 
-  //Determine if we should be moving right or left depending on the y coordinates (lines)
-  //we choose:
-  //Even lines (from top): move right
-  //Odd lines: move left
-  bool shouldMoveRight = ((headPos.y) % 2 == 0);
+  //What the speculation changes, to put it back if the prediction is wrong
+  p->played = a;
+  p->rng = ctx->rng;
+  p->resyncs = ctx->resyncs;
+  p->stats = ctx->moveStats.game;
+  p->mctsStats = ctx->mcts.stats;
 
-  action preferred_move; //The move that will get us in zigzag path
-  action secondary_move; //Move to use incase the zigzag is not possible
+  if (!p->started){
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->done, NULL);
+    p->started = (pthread_create(&p->thread, NULL, ponderWorker, ctx) == 0);
+    if (!p->started){//No thread: play without pondering
+      pthread_mutex_destroy(&p->lock);
+      pthread_cond_destroy(&p->wake);
+      pthread_cond_destroy(&p->done);
+      p->enabled = false;
+      return;
+    }
+  }
+  pthread_mutex_lock(&p->lock);
+  p->busy = true;
+  p->pending = true;
+  pthread_cond_signal(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+}
+
+/*
+  takePonder function:
+  This function waits for the worker, if a prediction was made, and compares the engine's state with it.
+  When it is the predicted state, the pondered decision is the move. Otherwise the context is put back as it was
+  before the speculation: in the same game the snake is resynced and the move decided here, and false is returned
+  at the beginning of a game (decideMove then starts it as usual).
+*/
+static bool takePonder(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action last_action, action *a){
+  Ponder *p = &ctx->ponder;
+  if (!p->pending) return false;
+  waitPonder(p);
+
+  bool same = (last_action == p->played && mapxsize == p->mapxsize && mapysize == p->mapysize);
+  int i = 0;
+  for (snake_list current = s; same && current != NULL; current = current->next, i++){
+    same = (i < p->linksCapacity && current->x == p->links[i].x && current->y == p->links[i].y
+            && (current->next == NULL) == (p->links[i].next == NULL));
+  }
+  for (int row = 0; same && row < mapysize; row++) same = (memcmp(map[row], p->rows[row], mapxsize) == 0);
+
+  if (same){
+    *a = p->decision;
+    if (ctx->moveStats.enabled) ctx->moveStats.game.ponderHits++;
+    return true;
+  }
+  undoPonder(ctx);
+  if (ctx->moveStats.enabled) ctx->moveStats.game.ponderMisses++;
+  if ((int)last_action < NORTH || (int)last_action > WEST || ctx->mapxsize != mapxsize || ctx->mapysize != mapysize) return false;
+  resyncContext(ctx, map, mapxsize, mapysize, s);
+  ctx->resyncs = p->resyncs;
+  beginFlight(ctx);
+  *a = chooseMove(ctx, map, mapxsize, mapysize, s, last_action);
+  return true;
+}
+
+/*
+  waitPonder function:
+  This function waits for the worker to decide the move of the prediction.
+*/
+static void waitPonder(Ponder *p){
+  pthread_mutex_lock(&p->lock);
+  while (p->busy) pthread_cond_wait(&p->done, &p->lock);
+  pthread_mutex_unlock(&p->lock);
+  p->pending = false;
+}
+
+/*
+  undoPonder function:
+  This function puts back what the speculation changed and the snake doesn't tell: the random generator and the counters.
+*/
+static void undoPonder(GameContext *ctx){
+  Ponder *p = &ctx->ponder;
+  ctx->rng = p->rng;
+  ctx->resyncs = p->resyncs;
+  ctx->moveStats.game = p->stats;
+  ctx->mcts.stats = p->mctsStats;
+  ctx->flight.current = NULL; //(the slot it was writing stays empty)
+  ctx->flight.state = ctx->flight.decisions;
+}
+
+/*
+  dropPonder function:
+  This function waits for the worker and discards its decision (the context is then as if nothing was pondered,
+  except for the snake, resynced at the next move).
+*/
+static void dropPonder(GameContext *ctx){
+  if (!ctx->ponder.pending) return;
+  waitPonder(&ctx->ponder);
+  undoPonder(ctx);
+}
+
+/*
+  stopPonder function:
+  This function stops the worker of a context and releases the predicted state.
+*/
+static void stopPonder(GameContext *ctx){
+  Ponder *p = &ctx->ponder;
+  if (p->started){
+    pthread_mutex_lock(&p->lock);
+    p->quit = true;
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    pthread_cond_destroy(&p->done);
+    p->started = false;
+  }
+  free(p->rows);
+  free(p->cells);
+  free(p->links);
+}
+#else
+/*
+  startPonder, takePonder, dropPonder and stopPonder functions:
+  Without PLAYER_PONDER there is no worker thread, nothing is pondered.
+*/
+static void startPonder(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action a){
+}
+
+static bool takePonder(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action last_action, action *a){
+  return false;
+}
+
+static void dropPonder(GameContext *ctx){
+}
+
+static void stopPonder(GameContext *ctx){
+}
+#endif
+
+/*
+  newMoveBatch function:
+  This function allocates a batch for up to capacity games (see player_api.h). It returns NULL if there is no memory.
+*/
+MoveBatch *newMoveBatch(int capacity){
+  if (capacity < 1) capacity = 1;
+  int lanes = (capacity + 3) & ~3;
+  MoveBatch *batch = calloc(1, sizeof(MoveBatch));
+  BatchScores *b = calloc(1, sizeof(BatchScores));
+  if (batch == NULL || b == NULL){
+    free(batch);
+    free(b);
+    return NULL;
+  }
+  batch->capacity = capacity;
+  batch->scores = b;
+  batch->contexts = calloc(capacity, sizeof(GameContext *));
+  batch->maps = calloc(capacity, sizeof(char **));
+  batch->mapxsizes = calloc(capacity, sizeof(int));
+  batch->mapysizes = calloc(capacity, sizeof(int));
+  batch->snakes = calloc(capacity, sizeof(snake_list));
+  batch->lastActions = calloc(capacity, sizeof(action));
+  batch->actions = calloc(capacity, sizeof(action));
+  b->deferred = calloc(capacity, sizeof(MoveScores));
+  b->games = calloc(capacity, sizeof(int));
+  b->lanes = lanes;
+
+  //The terms and weights in one block, the masks and moves in another
+  double *terms = calloc((size_t)lanes * 14, sizeof(double));
+  long long *masks = calloc((size_t)lanes * 5, sizeof(long long));
+  if (terms != NULL && masks != NULL){
+    b->distance = terms;
+    b->space = terms + 4 * lanes;
+    b->trap = terms + 8 * lanes;
+    b->distanceWeight = terms + 12 * lanes;
+    b->spaceWeight = terms + 13 * lanes;
+    b->valid = masks;
+    b->best = masks + 4 * lanes;
+  } else {
+    free(terms);
+    free(masks);
+  }
+
+  if (batch->contexts == NULL || batch->maps == NULL || batch->mapxsizes == NULL || batch->mapysizes == NULL
+      || batch->snakes == NULL || batch->lastActions == NULL || batch->actions == NULL
+      || b->deferred == NULL || b->games == NULL || b->distance == NULL){
+    freeMoveBatch(batch);
+    return NULL;
+  }
+  return batch;
+}
+
+/*
+  freeMoveBatch function:
+  This function releases a batch made by newMoveBatch (not the contexts it points to).
+*/
+void freeMoveBatch(MoveBatch *batch){
+  if (batch == NULL) return;
+  free(batch->contexts);
+  free(batch->maps);
+  free(batch->mapxsizes);
+  free(batch->mapysizes);
+  free(batch->snakes);
+  free(batch->lastActions);
+  free(batch->actions);
+  free(batch->scores->deferred);
+  free(batch->scores->games);
+  free(batch->scores->distance);
+  free(batch->scores->valid);
+  free(batch->scores);
+  free(batch);
+}
+
+/*
+  playerMoves function:
+  This function decides the moves of the games of a batch (see player_api.h). Each game goes through playerMove's
+  decision, except that when it comes down to scoring the 4 moves (the smart strategy, or the fallbacks to it),
+  the scores are left in the batch and all of them are computed afterwards by scoreBatch, 4 games at a time.
+  The moves are the ones playerMove would choose. The latency noted for a move leaves out that shared pass.
+*/
+void playerMoves(MoveBatch *batch){
+  BatchScores *b = batch->scores;
+  int deferred = 0; // games left to scoreBatch
+
+  for (int g = 0; g < batch->count; g++){
+    GameContext *ctx = batch->contexts[g];
+    bool timed = ctx->moveStats.enabled;
+    long long start = timed ? monotonicNanoseconds() : 0;
+
+    ctx->deferred = &b->deferred[deferred];
+    ctx->deferredMove = false;
+    action a = decideMove(ctx, batch->maps[g], batch->mapxsizes[g], batch->mapysizes[g], batch->snakes[g], batch->lastActions[g]);
+    ctx->deferred = NULL;
+    if (ctx->deferredMove){
+      b->games[deferred++] = g;
+    } else {
+      batch->actions[g] = a;
+      printMove(ctx, a);
+      recordFlight(ctx, a, false);
+    }
+
+    if (timed && ctx->moveStats.enabled){
+      noteLatency(&ctx->moveStats.game, monotonicNanoseconds() - start);
+    }
+  }
+  if (deferred == 0) return;
+
+  gatherScores(b, deferred);
+  scoreBatch(b, deferred);
+  for (int j = 0; j < deferred; j++){
+    int g = b->games[j];
+    batch->actions[g] = (action)b->best[j];
+    printMove(batch->contexts[g], batch->actions[g]);
+    recordFlight(batch->contexts[g], batch->actions[g], false);
+  }
+}
+
+/*
+  decideMove function:
+  This function brings the context up to date with the move the engine just applied, and returns the move
+  of the context's strategy (left to the batch if ctx->deferred is set and the move comes down to scoring).
+*/
+static action decideMove(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action last_action){
+  //Bring the game context up to date with the move the engine just applied (O(1), except when a new bonus appears)
+  updateContext(ctx, map, mapxsize, mapysize, s, last_action);
+  beginFlight(ctx);
+  return chooseMove(ctx, map, mapxsize, mapysize, s, last_action);
+}
+
+/*
+  chooseMove function:
+  This function returns the move of the context's strategy, the context being up to date with the engine's state.
+*/
+static action chooseMove(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action last_action){
+  //Coordinates of the snake's head---------------------------------------------------------------------------
+  Position headPos = ctx->headPos;
+
+  if (DEBUG){//Print the coordinates of the of the head
+    printf("X coordinates of the head = %d\nY coordinates of the head = %d\n", headPos.x, headPos.y);
+  }
+  //----------------------------------------------------------------------------------------------------------
+
+  //Coordinates of the snake's tail---------------------------------------------------------------------------
+  Position tailPos = ctx->tailPos;
+
+  if (DEBUG){//Print the coordinates of the tail
+    printf("X coordinates of the tail = %d\nY coordinates of the tail = %d\n", tailPos.x, tailPos.y);
+  }
+  //----------------------------------------------------------------------------------------------------------
+
+  //Coordinates of the Bonus----------------------------------------------------------------------------------
+  Position bonusPos = ctx->bonusPos;
+
+  if (DEBUG){ //Print the coordinates of the bonus
+    printf("X coordinates of the bonus = %d\nY coordinates of the bonus = %d\n", bonusPos.x, bonusPos.y);
+  }
+  //-----------------------------------------------------------------------------------------------------------
+
+  action solved; //Small levels solved offline (solver.c): the move of the policy table comes first
+  if (ctx->policy.enabled && policyMove(ctx, &solved)){
+    notePick(ctx, PICK_POLICY);
+    return solved;
+  }
+
+  if (ctx->strategy == HAMILTON_STRATEGY){
+    return hamiltonStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  } else if (ctx->strategy == MCTS_STRATEGY){
+    return mctsStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  } else if (ctx->lookahead){
+    return lookaheadStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  }
+  return smartStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+}
+
+/*
+  printMove function:
+  This function prints the move chosen (in DEBUG mode).
+*/
+static void printMove(const GameContext *ctx, action a){
+  if (DEBUG) {
+    int distToBonus = abs(ctx->headPos.x - ctx->bonusPos.x) + abs(ctx->headPos.y - ctx->bonusPos.y);
+    printf("Snake length: %d, Distance to bonus: %d - Moving: ", ctx->length, distToBonus);
+    printAction(a);
+    printf("\n");
+  }
+}
+
+//Helper functions
+/*
+  printAction function:
+  This function prints the input action name on screen.
+*/
+static void printAction(action a) {
+  switch(a) {
+  case NORTH:
+    printf("NORTH");
+    break;
+  case EAST:
+    printf("EAST");
+    break;
+  case SOUTH:
+    printf("SOUTH");
+    break;
+  case WEST:
+    printf("WEST");
+    break;
+  }
+}
+
+/*
+  randomAction function:
+  This function draws a random action with the context's own generator (splitmix64) instead of rand(),
+  so that games played at the same time on several threads don't share any state.
+*/
+static action randomAction(GameContext *ctx){
+  unsigned long long z = (ctx->rng += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  return (action)(z >> 62); //Top two bits: NORTH, EAST, SOUTH or WEST
+}
+
+/*
+  parseStrategy function:
+  This function reads a strategy name: "smart", "hamilton", "mcts" or "lookahead" (the smart strategy with the lookahead).
+  It returns false if the name is unknown.
+*/
+static bool parseStrategy(const char *name, strategy *s, bool *lookahead){
+  if (strcmp(name, "smart") == 0){
+    *s = SMART_STRATEGY;
+    *lookahead = false;
+  } else if (strcmp(name, "hamilton") == 0){
+    *s = HAMILTON_STRATEGY;
+    *lookahead = false;
+  } else if (strcmp(name, "mcts") == 0){
+    *s = MCTS_STRATEGY;
+    *lookahead = false;
+  } else if (strcmp(name, "lookahead") == 0){
+    *s = SMART_STRATEGY;
+    *lookahead = true;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+  actionValid funtion:
+  This function checks if the action is valid from a cell, i.e. if it doesn't put the snake's head
+  into a wall, the snake's body or the snake's tail (read from the grid).
+*/
+static bool actionValid(GameContext *ctx, action a, int cell){
+  if (ctx->moveStats.enabled) ctx->moveStats.game.validChecks++;
+  return !(ctx->grid.cells[cell + ctx->grid.offsets[a]] & GRID_BLOCKED);
+}
+
+/*
+  moveValid function:
+  This function checks if the head can play an action: the same as actionValid, plus the move into the tail
+  cell, that the engine allows since the tail moves away (the bonus is never on the tail, so the snake doesn't eat).
+*/
+static bool moveValid(GameContext *ctx, action a, int head){
+  int tail = ctx->tailPos.y * ctx->mapxsize + ctx->tailPos.x;
+  return (ctx->length > 1 && head + ctx->grid.offsets[a] == tail) || actionValid(ctx, a, head);
+}
+
+/*
+  findBonus function:
+  This function looks for the bonus in the map (we start from 1 and subtract 1 to not waste time looking in the walls)
+  and returns whether it was found. Each row is searched with memchr, many bytes at a time: it is the only part
+  of a move that grows with the map (once per bonus eaten), so it matters on large maps.
+*/
+static bool findBonus(char **map, int mapxsize, int mapysize, Position *bonusPos){
+  for (int row = 1; row < mapysize - 1; row++){
+    const char *found = memchr(map[row] + 1, BONUS, mapxsize - 2);
+    if (found != NULL){
+      bonusPos->x = (int)(found - map[row]);
+      bonusPos->y = row;
+      return true; //Bonus found, stop looking
+    }
+  }
+  return false;
+}
+
+/*
+  buildGrid function:
+  This function fills the grid and the free mask from the engine's map (at a resync: afterwards updateContext keeps them up to date).
+*/
+static void buildGrid(GameContext *ctx, char **map){
+  if (ctx->grid.cells == NULL) return;
+  memset(ctx->bits.free, 0, ctx->bits.words * sizeof(uint64_t));
+  for (int i = 0; i < ctx->paths.cells; i++){
+    char c = map[ctx->paths.cellY[i]][ctx->paths.cellX[i]];
+    if (c == WALL || c == SNAKE_BODY || c == SNAKE_TAIL) ctx->grid.cells[i] = GRID_OCCUPIED | GRID_BLOCKED;
+    else if (!cellFree(c)) ctx->grid.cells[i] = GRID_OCCUPIED;
+    else ctx->grid.cells[i] = 0;
+    if (ctx->grid.cells[i] == 0) setCellBit(ctx->bits.free, i, true);
+    ctx->flight.walls[i] = (c == WALL) ? WALL : PATH;
+  }
+}
+
+/*
+  resyncContext function:
+  This function rebuilds the game context from scratch: the snake list is copied into the ring buffer
+  (which is (re)allocated when the map size changes), the grid is rebuilt, the map is scanned for the bonus
+  and the distances to the bonus are computed.
+  It is used at the beginning of a game, and whenever the incremental update disagrees with the engine.
+*/
+static void resyncContext(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s){
+  if (ctx->body == NULL || ctx->mapxsize != mapxsize || ctx->mapysize != mapysize){
+    ctx->mapxsize = mapxsize;
+    ctx->mapysize = mapysize;
+    setupBuffers(ctx);
+  }
+
+  //Copy the snake, from the head to the tail
+  ctx->first = 0;
+  ctx->length = 0;
+  for (snake_list current = s; current != NULL && ctx->length < ctx->capacity; current = current->next){
+    ctx->body[ctx->length].x = current->x;
+    ctx->body[ctx->length].y = current->y;
+    ctx->length++;
+  }
+  ctx->headPos = ctx->body[0];
+  ctx->tailPos = ctx->body[ctx->length - 1];
+  buildGrid(ctx, map);
+
+  ctx->bonusFound = findBonus(map, mapxsize, mapysize, &ctx->bonusPos);
+  if (!ctx->bonusFound) ctx->bonusPos = ctx->tailPos; //No bonus (the map is full), chase the tail
+  ctx->bonusField.valid = false; //Built when a move reads it
+  ctx->bonusField.read = false;
+  ctx->resyncs++;
+}
+
+/*
+  updateContext function:
+  This function updates the game context after the engine applied last_action, without walking the snake list:
+    -the new head is the old head moved by last_action,
+    -if the old head reached the bonus, the snake grew and the tail stayed, otherwise the tail cell is popped,
+    -the bonus is looked for in the map only after it has been eaten (or if it disappeared).
+  The result is checked against the cells that changed (new head, second link, new tail): on a mismatch,
+  or at the beginning of a game (last_action is -1), the context is resynced from the engine's state.
+*/
+static void updateContext(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action last_action){
+  int dx[4] = {0, 1, 0, -1};
+  int dy[4] = {-1, 0, 1, 0};
+
+  if ((int)last_action < NORTH || (int)last_action > WEST || ctx->body == NULL
+      || ctx->mapxsize != mapxsize || ctx->mapysize != mapysize){//New game
+    if (!ctx->strategyChosen){
+      const char *name = getenv("SNAKE_STRATEGY");
+      if (name == NULL || !parseStrategy(name, &ctx->strategy, &ctx->lookahead)){
+        ctx->strategy = SMART_STRATEGY;
+        ctx->lookahead = false;
+      }
+      const char *lookahead = getenv("SNAKE_LOOKAHEAD");
+      if (lookahead != NULL && strcmp(lookahead, "on") == 0) ctx->lookahead = true;
+    }
+    endGameStats(ctx);
+    memset(ctx->flight.records, 0, sizeof(ctx->flight.records));
+    ctx->flight.current = NULL;
+    ctx->flight.decisions = ctx->flight.state = 0;
+    if (!ctx->moveStats.chosen){
+      const char *stats = getenv("SNAKE_STATS");
+      ctx->moveStats.enabled = ctx->moveStats.print = (stats != NULL && strcmp(stats, "on") == 0);
+    }
+    if (!ctx->mcts.budgetChosen){
+      const char *budget = getenv("SNAKE_MCTS_BUDGET");
+      const char *playouts = getenv("SNAKE_MCTS_PLAYOUTS");
+      ctx->mcts.budget = (budget != NULL) ? strtol(budget, NULL, 10) : 1000;
+      ctx->mcts.maxPlayouts = (playouts != NULL) ? strtol(playouts, NULL, 10) : 0;
+      if (ctx->mcts.budget <= 0 && ctx->mcts.maxPlayouts <= 0) ctx->mcts.budget = 1000;
+    }
+    const char *table = getenv("SNAKE_MCTS_TABLE");
+    ctx->mcts.tableEnabled = (table == NULL || strcmp(table, "off") != 0);
+    if (ctx->mcts.ownTable != NULL){//A new game: the states of the last one are forgotten (the games don't depend on each other)
+      memset(ctx->mcts.ownTable->entries, 0, (ctx->mcts.ownTable->mask + 1) * sizeof(TranspositionEntry));
+    }
+    const char *kernel = getenv("SNAKE_BITBOARD");
+    ctx->bits.simd = (kernel == NULL || strcmp(kernel, "scalar") != 0);
+    const char *kernels = getenv("SNAKE_KERNELS");
+    ctx->genericKernels = (kernels != NULL && strcmp(kernels, "generic") == 0);
+    if (!ctx->paramsChosen){//Default constants, or the ones tuned for this map size
+      const char *paramsFile = getenv("SNAKE_PARAMS");
+      defaultStrategyParams(&ctx->params);
+      if (paramsFile != NULL) readStrategyParams(paramsFile, mapxsize, mapysize, &ctx->params);
+    }
+    ctx->bonusField.used = (ctx->strategy == SMART_STRATEGY);
+    ctx->resyncs = 0;
+    resyncContext(ctx, map, mapxsize, mapysize, s);
+    selectKernels(ctx);
+    ctx->levelDirectory = getenv("SNAKE_LEVELS");
+#ifdef PLAYER_PONDER
+    const char *ponder = getenv("SNAKE_PONDER");
+    ctx->ponder.enabled = (ponder != NULL && strcmp(ponder, "on") == 0);
+#endif
+    if (ctx->strategy == HAMILTON_STRATEGY) prepareCycle(&ctx->cycle, ctx->levelDirectory, map, mapxsize, mapysize);
+    const char *policy = getenv("SNAKE_POLICY");
+    ctx->policy.enabled = (policy == NULL || strcmp(policy, "off") != 0);
+    if (ctx->policy.enabled) preparePolicy(&ctx->policy, ctx->levelDirectory, map, mapxsize, mapysize);
+    return;
+  }
+
+  Position newHead = {ctx->headPos.x + dx[last_action], ctx->headPos.y + dy[last_action]};
+  bool ate = ctx->bonusFound && newHead.x == ctx->bonusPos.x && newHead.y == ctx->bonusPos.y;
+
+  int newLength = ctx->length + (ate ? 1 : 0);
+
+  //The engine's state must match the expected move
+  if (s->x != newHead.x || s->y != newHead.y || newLength > ctx->capacity
+      || (newLength > 1 && (s->next == NULL || s->next->x != ctx->headPos.x || s->next->y != ctx->headPos.y))){
+    resyncContext(ctx, map, mapxsize, mapysize, s);
+    return;
+  }
+
+  Position oldHead = ctx->headPos, oldTail = ctx->tailPos;
+
+  //Push the new head
+  ctx->first = (ctx->first + ctx->capacity - 1) % ctx->capacity;
+  ctx->body[ctx->first] = newHead;
+  ctx->headPos = newHead;
+
+  //Pop the tail, unless the snake grew
+  ctx->length = newLength;
+  ctx->tailPos = ctx->body[(ctx->first + ctx->length - 1) % ctx->capacity];
+
+  if (map[ctx->tailPos.y][ctx->tailPos.x] != (ctx->length == 1 ? SNAKE_HEAD : SNAKE_TAIL)){//Lost track of the tail
+    resyncContext(ctx, map, mapxsize, mapysize, s);
+    return;
+  }
+
+  //Grid: the freed tail, the old head (now body or tail, unless the snake is a single cell) and the new head
+  unsigned char *grid = ctx->grid.cells;
+  int freedCell = oldTail.y * mapxsize + oldTail.x, headCell = newHead.y * mapxsize + newHead.x;
+  if (!ate) grid[freedCell] = 0;
+  if (ctx->length > 1) grid[oldHead.y * mapxsize + oldHead.x] = GRID_OCCUPIED | GRID_BLOCKED;
+  grid[headCell] = GRID_OCCUPIED;
+  if (!ate) setCellBit(ctx->bits.free, freedCell, true);
+  setCellBit(ctx->bits.free, headCell, false);
+
+  //Bonus: only look for it when it moved (then its distance field is dropped, otherwise it is repaired if it was read)
+  if (!ctx->bonusField.read) ctx->bonusField.valid = false;
+  ctx->bonusField.read = false;
+  if (ate || !ctx->bonusFound || map[ctx->bonusPos.y][ctx->bonusPos.x] != BONUS){
+    ctx->bonusFound = findBonus(map, mapxsize, mapysize, &ctx->bonusPos);
+    if (!ctx->bonusFound) ctx->bonusPos = ctx->tailPos;
+    ctx->bonusField.valid = false;
+  } else {
+    blockFieldCell(ctx, headCell);
+    freeFieldCell(ctx, freedCell);
+  }
+}
+
+/*
+  arenaAlloc function:
+  This function carves a buffer out of the arena (16 bytes aligned). When measuring, it only counts the bytes.
+*/
+static void *arenaAlloc(Arena *arena, size_t bytes){
+  size_t start = (arena->used + 15) & ~(size_t)15;
+  arena->used = start + bytes;
+  if (arena->base == NULL || arena->used > arena->size) return NULL;
+  return arena->base + start;
+}
+
+/*
+  layoutBuffers function:
+  This function carves every buffer that depends on the map size out of the arena, always in the same order.
+*/
+static void layoutBuffers(GameContext *ctx){
+  int cells = ctx->mapxsize * ctx->mapysize;
+  Arena *arena = &ctx->arena;
+
+  ctx->capacity = cells; //The snake can't be longer than the map
+  ctx->body = arenaAlloc(arena, cells * sizeof(Position));
+
+  ctx->paths.cells = cells;
+  ctx->paths.queue = arenaAlloc(arena, cells * sizeof(int));
+  ctx->paths.heap = arenaAlloc(arena, 4 * (size_t)cells * sizeof(unsigned long long)); //A cell can be pushed once per neighbor
+  ctx->paths.dist = arenaAlloc(arena, cells * sizeof(int));
+  ctx->paths.parent = arenaAlloc(arena, cells * sizeof(int));
+  ctx->paths.seen = arenaAlloc(arena, cells * sizeof(unsigned));
+  ctx->paths.cellX = arenaAlloc(arena, cells * sizeof(int));
+  ctx->paths.cellY = arenaAlloc(arena, cells * sizeof(int));
+  ctx->grid.cells = arenaAlloc(arena, cells);
+  ctx->flight.walls = arenaAlloc(arena, cells);
+  ctx->bonusField.dist = arenaAlloc(arena, cells * sizeof(int));
+  ctx->bonusField.queue = arenaAlloc(arena, cells * sizeof(int));
+  ctx->bonusField.seeds = arenaAlloc(arena, cells * sizeof(unsigned long long));
+  ctx->bonusField.stamp = arenaAlloc(arena, cells * sizeof(unsigned));
+  Bitboard *bb = &ctx->bits;
+  bb->rowWords = ctx->mapxsize / 64;
+  bb->rowBits = ctx->mapxsize % 64;
+  bb->words = ((cells + 63) / 64 + 3) & ~3;
+  bb->padding = (bb->rowWords + 2 + 3) & ~3; //A shift by one row reads rowWords + 1 words away
+  size_t maskBytes = (bb->words + 2 * bb->padding) * sizeof(uint64_t);
+  uint64_t *masks[4];
+  for (int i = 0; i < 4; i++){
+    masks[i] = arenaAlloc(arena, maskBytes);
+    if (masks[i] != NULL) masks[i] += bb->padding;
+  }
+  bb->free = masks[0];
+  bb->virtualFree = masks[1];
+  bb->reach = masks[2];
+  bb->next = masks[3];
+
+  ctx->path = arenaAlloc(arena, cells * sizeof(int));
+  ctx->virtualCells = arenaAlloc(arena, cells * sizeof(int));
+  ctx->overlayStamp = arenaAlloc(arena, cells * sizeof(unsigned));
+  ctx->overlayCells = arenaAlloc(arena, cells);
+}
+
+/*
+  setupBuffers function:
+  This function (re)allocates the arena for the current map size: the layout is done once to measure it,
+  then once more to carve the buffers out of the new memory. Nothing is allocated afterwards, until the map size changes.
+*/
+static void setupBuffers(GameContext *ctx){
+  free(ctx->arena.base);
+  ctx->arena.base = NULL;
+  ctx->arena.size = 0;
+  ctx->arena.used = 0;
+  layoutBuffers(ctx); //Measure
+
+  size_t size = ctx->arena.used;
+  ctx->arena.base = calloc(size, 1);
+  ctx->arena.size = (ctx->arena.base != NULL) ? size : 0;
+  ctx->arena.used = 0;
+  layoutBuffers(ctx); //Carve (the pointers are NULL if the allocation failed)
+  ctx->paths.generation = 0;
+  ctx->overlayGeneration = 0;
+  ctx->bonusField.generation = 0;
+  ctx->grid.offsets[NORTH] = -ctx->mapxsize;
+  ctx->grid.offsets[EAST] = 1;
+  ctx->grid.offsets[SOUTH] = ctx->mapxsize;
+  ctx->grid.offsets[WEST] = -1;
+  for (int i = 0; ctx->arena.base != NULL && i < ctx->paths.cells; i++){
+    ctx->paths.cellX[i] = i % ctx->mapxsize;
+    ctx->paths.cellY[i] = i / ctx->mapxsize;
+  }
+  selectKernels(ctx);
+}
+
+/*
+  cellFree function:
+  This function tells whether the snake's head could go through a cell (an empty path or the bonus).
+*/
+static bool cellFree(char c){
+  return c == PATH || c == BONUS;
+}
+
+/*
+  newSearch function:
+  This function starts a new generation of the search buffers, which invalidates every dist/parent at once.
+  The stamps are only cleared when the generation counter wraps around.
+*/
+static void newSearch(PathFinder *pf){
+  pf->generation++;
+  if (pf->generation == 0){
+    for (int i = 0; i < pf->cells; i++) pf->seen[i] = 0;
+    pf->generation = 1;
+  }
+}
+
+/*
+  bfsVisit function:
+  This function is one neighbor of a BFS step: a free cell not reached yet is queued one move further than cell.
+  It is inlined in the kernels, where the offset of the move is a constant.
+*/
+KERNEL_INLINE void bfsVisit(PathFinder *pf, const unsigned char *cells, int cell, int next, const int *goals, int ngoals,
+                            int *tail, int *pending){
+  if (pf->seen[next] == pf->generation || (cells[next] & GRID_OCCUPIED)) return;
+  pf->seen[next] = pf->generation;
+  pf->dist[next] = pf->dist[cell] + 1;
+  pf->parent[next] = cell;
+  pf->queue[(*tail)++] = next;
+  for (int g = 0; g < ngoals; g++) if (goals[g] == next) (*pending)--;
+}
+
+/*
+  bfsKernel function:
+  This function is the body of bfsDistances for a map mapxsize cells wide (a constant in the kernels of SIZE_KERNELS).
+*/
+KERNEL_INLINE int bfsKernel(PathFinder *pf, const unsigned char *cells, int mapxsize, int start, const int *goals, int ngoals){
+  int head = 0, tail = 0; //Queue bounds
+  int pending = 0; //Goals not reached yet
+
+  newSearch(pf);
+  pf->seen[start] = pf->generation;
+  pf->dist[start] = 0;
+  pf->parent[start] = start;
+  pf->queue[tail++] = start;
+  for (int i = 0; i < ngoals; i++) if (goals[i] != start) pending++;
+
+  while (head < tail && (ngoals == 0 || pending > 0)){
+    int cell = pf->queue[head++];
+    bfsVisit(pf, cells, cell, cell - mapxsize, goals, ngoals, &tail, &pending); //NORTH
+    bfsVisit(pf, cells, cell, cell + 1, goals, ngoals, &tail, &pending); //EAST
+    bfsVisit(pf, cells, cell, cell + mapxsize, goals, ngoals, &tail, &pending); //SOUTH
+    bfsVisit(pf, cells, cell, cell - 1, goals, ngoals, &tail, &pending); //WEST
+  }
+  return tail;
+}
+
+/*
+  bfsDistances function:
+  This function runs a breadth first search from the start cell over the free cells of the grid,
+  so that pathDistance then gives the number of moves between the start and any cell reached.
+  The search stops as soon as every goal cell has been reached (or when there is nothing left to explore),
+  so asking for the few cells around the head usually explores only part of the map.
+  It returns the number of cells reached. It is the generic kernel: the map size is read from the grid.
+*/
+static int bfsDistances(PathFinder *pf, const Grid *grid, int start, const int *goals, int ngoals){
+  return bfsKernel(pf, grid->cells, grid->offsets[SOUTH], start, goals, ngoals);
+}
+
+/*
+  pathDistance function:
+  This function returns the distance found by the last search for a cell, or -1 if the cell was not reached.
+*/
+static int pathDistance(const PathFinder *pf, int cell){
+  return pf->seen[cell] == pf->generation ? pf->dist[cell] : -1;
+}
+
+/*
+  heapEntry function:
+  This function packs an A* frontier entry (21 bits per field) so that entries sort by estimated length,
+  then by moves so far, deepest first (which avoids exploring all the equally good cells of open areas), then by cell.
+*/
+static unsigned long long heapEntry(int estimate, int moves, int cell){
+  return (unsigned long long)estimate << 42 | (unsigned long long)(0x1FFFFF - moves) << 21 | (unsigned long long)cell;
+}
+
+/*
+  findPath function:
+  This function looks for a shortest path of free cells between two positions, with a BFS or with A*
+  (Manhattan distance as heuristic, which never overestimates on a grid, so the path found is a shortest one).
+  The goal may be a blocked cell (e.g. the tail): only the cells in between must be free.
+  It returns the length of the path and the first move to make, or -1 when the goal can't be reached.
+  The path itself can be read backwards from the goal with the parent buffer.
+*/
+static int findPath(PathFinder *pf, char **map, int mapxsize, Position from, Position to, bool astar, action *firstMove){
+  action moves[4] = {NORTH, EAST, SOUTH, WEST};
+  int offsets[4] = {-mapxsize, 1, mapxsize, -1};
+  int start = from.y * mapxsize + from.x;
+  int goal = to.y * mapxsize + to.x;
+  int found = -1;
+
+  newSearch(pf);
+  pf->seen[start] = pf->generation;
+  pf->dist[start] = 0;
+  pf->parent[start] = start;
+  if (start == goal) return 0; //Already there
+
+  if (!astar){
+    int head = 0, tail = 0;
+    pf->queue[tail++] = start;
+    while (head < tail && found < 0){
+      int cell = pf->queue[head++];
+      for (int i = 0; i < 4; i++){
+        int next = cell + offsets[i];
+        if (pf->seen[next] == pf->generation) continue;
+        if (next != goal && !cellFree(map[pf->cellY[next]][pf->cellX[next]])) continue;
+        pf->seen[next] = pf->generation;
+        pf->dist[next] = pf->dist[cell] + 1;
+        pf->parent[next] = cell;
+        pf->queue[tail++] = next;
+        if (next == goal) found = pf->dist[next];
+      }
+    }
+  } else {
+    int size = 0; //Heap size
+    pf->heap[size++] = heapEntry(abs(from.x - to.x) + abs(from.y - to.y), 0, start);
+    while (size > 0 && found < 0){
+      //Pop the cell with the smallest estimated length
+      unsigned long long top = pf->heap[0];
+      unsigned long long last = pf->heap[--size];
+      int i = 0;
+      while (2 * i + 1 < size){
+        int child = 2 * i + 1;
+        if (child + 1 < size && pf->heap[child + 1] < pf->heap[child]) child++;
+        if (last <= pf->heap[child]) break;
+        pf->heap[i] = pf->heap[child];
+        i = child;
+      }
+      pf->heap[i] = last;
+
+      int cell = (int)(top & 0x1FFFFF);
+      if (cell == goal){
+        found = pf->dist[cell];
+        break;
+      }
+      if (0x1FFFFF - (int)(top >> 21 & 0x1FFFFF) > pf->dist[cell]) continue; //Outdated entry, the cell was reached by a shorter path since
+
+      for (int d = 0; d < 4; d++){
+        int next = cell + offsets[d];
+        if (next != goal && !cellFree(map[pf->cellY[next]][pf->cellX[next]])) continue;
+        int dist = pf->dist[cell] + 1;
+        if (pf->seen[next] == pf->generation && pf->dist[next] <= dist) continue;
+        pf->seen[next] = pf->generation;
+        pf->dist[next] = dist;
+        pf->parent[next] = cell;
+
+        //Push it with its estimated length (moves so far + Manhattan distance left)
+        unsigned long long entry = heapEntry(dist + abs(pf->cellX[next] - to.x) + abs(pf->cellY[next] - to.y), dist, next);
+        int j = size++;
+        while (j > 0 && pf->heap[(j - 1) / 2] > entry){
+          pf->heap[j] = pf->heap[(j - 1) / 2];
+          j = (j - 1) / 2;
+        }
+        pf->heap[j] = entry;
+      }
+    }
+  }
+
+  if (found < 0) return found; //Not reachable
+
+  //Walk back from the goal to the cell right after the start
+  int cell = goal;
+  while (pf->parent[cell] != start) cell = pf->parent[cell];
+  for (int i = 0; i < 4; i++) if (cell == start + offsets[i]) *firstMove = moves[i];
+  return found;
+}
+
+/*
+  pathToBonus function:
+  This function returns the length of the shortest path from the head to the bonus (-1 if there is none)
+  and the first move of that path.
+*/
+static int pathToBonus(GameContext *ctx, char **map, action *firstMove){
+  if (!ctx->bonusFound) return -1;
+  return findPath(&ctx->paths, map, ctx->mapxsize, ctx->headPos, ctx->bonusPos, true, firstMove);
+}
+
+/*
+  pathToTail function:
+  This function returns the length of the shortest path from the head to the tail (-1 if there is none)
+  and the first move of that path.
+*/
+static int pathToTail(GameContext *ctx, char **map, action *firstMove){
+  if (ctx->length == 1) return -1;
+  return findPath(&ctx->paths, map, ctx->mapxsize, ctx->headPos, ctx->tailPos, true, firstMove);
+}
+
+/*
+  distancesToTarget function:
+  This function computes, for each free cell next to the head, the length of the shortest path to the target,
+  with a single BFS started from the target (the grid is not directed) that stops once these cells are reached.
+  The distances are then read with pathDistance.
+*/
+static void distancesToTarget(GameContext *ctx, Position headPos, Position target){
+  int mapxsize = ctx->mapxsize;
+  int head = headPos.y * mapxsize + headPos.x;
+  int goals[4], ngoals = 0;
+
+  for (int i = 0; i < 4; i++){
+    int next = head + ctx->grid.offsets[i];
+    if (!(ctx->grid.cells[next] & GRID_OCCUPIED)) goals[ngoals++] = next;
+  }
+  ctx->kernels.bfs(&ctx->paths, &ctx->grid, target.y * mapxsize + target.x, goals, ngoals);
+}
+
+/*
+  buildBonusField function:
+  This function computes the distances to the bonus from scratch, with a BFS from the bonus over the free cells of the grid.
+  Without a bonus (or without memory) the field is left invalid, and the strategies search their paths themselves.
+*/
+static void buildBonusField(GameContext *ctx){
+  DistanceField *f = &ctx->bonusField;
+  const int *offsets = ctx->grid.offsets;
+  int head = 0, tail = 0; //Queue bounds
+
+  f->valid = f->used && ctx->bonusFound && f->dist != NULL;
+  if (!f->valid) return;
+  for (int i = 0; i < ctx->paths.cells; i++) f->dist[i] = -1;
+
+  int bonus = ctx->bonusPos.y * ctx->mapxsize + ctx->bonusPos.x;
+  f->dist[bonus] = 0;
+  f->queue[tail++] = bonus;
+  while (head < tail){
+    int cell = f->queue[head++];
+    for (int i = 0; i < 4; i++){
+      int next = cell + offsets[i];
+      if (f->dist[next] >= 0 || (ctx->grid.cells[next] & GRID_OCCUPIED)) continue;
+      f->dist[next] = f->dist[cell] + 1;
+      f->queue[tail++] = next;
+    }
+  }
+}
+
+/*
+  blockFieldCell function:
+  This function repairs the field after a cell got occupied (the new head). The cells that depended on it are found
+  level by level from it: a cell one step further from the bonus loses its distance if none of its other neighbors
+  is one step closer (and still valid). Their distances are then searched again, starting from the distance
+  their valid neighbors give them, in increasing order (sorted seeds merged with the BFS queue, as in a Dijkstra search).
+  The rest of the field doesn't change, so a move that cuts no shortest path costs a handful of lookups.
+*/
+static void blockFieldCell(GameContext *ctx, int cell){
+  DistanceField *f = &ctx->bonusField;
+  const int *offsets = ctx->grid.offsets;
+  int head = 0, tail = 0, nseeds = 0;
+
+  if (!f->valid || f->dist[cell] < 0) return; //Not on any path to the bonus
+
+  f->generation++;
+  if (f->generation == 0){
+    for (int i = 0; i < ctx->paths.cells; i++) f->stamp[i] = 0;
+    f->generation = 1;
+  }
+
+  //Cells that lost every shortest path to the bonus (in the order of their old distance)
+  f->stamp[cell] = f->generation;
+  f->queue[tail++] = cell;
+  while (head < tail){
+    int u = f->queue[head++];
+    for (int i = 0; i < 4; i++){
+      int next = u + offsets[i];
+      if (f->stamp[next] == f->generation || f->dist[next] != f->dist[u] + 1) continue;
+      bool supported = false; //Another neighbor one step closer to the bonus
+      for (int j = 0; j < 4 && !supported; j++){
+        int m = next + offsets[j];
+        supported = (f->stamp[m] != f->generation && f->dist[m] == f->dist[next] - 1);
+      }
+      if (supported) continue;
+      f->stamp[next] = f->generation;
+      f->queue[tail++] = next;
+    }
+  }
+  for (int i = 0; i < tail; i++) f->dist[f->queue[i]] = -1;
+
+  //Distance each of them gets from its neighbors that kept theirs
+  for (int i = 1; i < tail; i++){
+    int u = f->queue[i];
+    int best = -1;
+    for (int j = 0; j < 4; j++){
+      int m = u + offsets[j];
+      if (f->stamp[m] != f->generation && f->dist[m] >= 0 && (best < 0 || f->dist[m] + 1 < best)) best = f->dist[m] + 1;
+    }
+    if (best >= 0) f->seeds[nseeds++] = (unsigned long long)best << 32 | (unsigned)u;
+  }
+  qsort(f->seeds, nseeds, sizeof(unsigned long long), compareSeeds);
+
+  //Spread them, always from the closest cell to the bonus: the next seed or the front of the queue
+  head = tail = 0;
+  int s = 0;
+  while (s < nseeds || head < tail){
+    int u;
+    if (head < tail && (s == nseeds || f->dist[f->queue[head]] <= (int)(f->seeds[s] >> 32))){
+      u = f->queue[head++];
+    } else {
+      u = (int)(f->seeds[s] & 0xFFFFFFFFULL);
+      int d = (int)(f->seeds[s++] >> 32);
+      if (f->dist[u] >= 0 && f->dist[u] <= d) continue; //Already reached as close
+      f->dist[u] = d;
+    }
+    for (int i = 0; i < 4; i++){
+      int next = u + offsets[i];
+      if (f->stamp[next] != f->generation || next == cell) continue; //Only the cells being searched again
+      if (f->dist[next] >= 0 && f->dist[next] <= f->dist[u] + 1) continue;
+      f->dist[next] = f->dist[u] + 1;
+      f->queue[tail++] = next;
+    }
+  }
+}
+
+/*
+  freeFieldCell function:
+  This function repairs the field after a cell got free (the old tail): it takes the distance its neighbors give it,
+  and the cells it brings closer to the bonus are updated with a BFS from it.
+*/
+static void freeFieldCell(GameContext *ctx, int cell){
+  DistanceField *f = &ctx->bonusField;
+  const int *offsets = ctx->grid.offsets;
+  int head = 0, tail = 0;
+
+  if (!f->valid || (ctx->grid.cells[cell] & GRID_OCCUPIED)) return;
+
+  for (int i = 0; i < 4; i++){
+    int m = cell + offsets[i];
+    if (f->dist[m] >= 0 && (f->dist[cell] < 0 || f->dist[m] + 1 < f->dist[cell])) f->dist[cell] = f->dist[m] + 1;
+  }
+  if (f->dist[cell] < 0) return; //Cut off from the bonus
+
+  f->queue[tail++] = cell;
+  while (head < tail){
+    int u = f->queue[head++];
+    for (int i = 0; i < 4; i++){
+      int next = u + offsets[i];
+      if (ctx->grid.cells[next] & GRID_OCCUPIED) continue;
+      if (f->dist[next] >= 0 && f->dist[next] <= f->dist[u] + 1) continue;
+      f->dist[next] = f->dist[u] + 1;
+      f->queue[tail++] = next;
+    }
+  }
+}
+
+/*
+  compareSeeds function:
+  This function orders the seeds of a repair (qsort), closest to the bonus first.
+*/
+static int compareSeeds(const void *a, const void *b){
+  unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  countValidMoves function:
+  This function counts the valid moves possible from a cell
+*/
+static int countValidMoves(GameContext *ctx, int cell){
+  const unsigned char *around = ctx->grid.cells + cell;
+  const int *offsets = ctx->grid.offsets;
+  if (ctx->moveStats.enabled) ctx->moveStats.game.neighborCounts++;
+
+  return !(around[offsets[NORTH]] & GRID_BLOCKED) + !(around[offsets[EAST]] & GRID_BLOCKED)
+    + !(around[offsets[SOUTH]] & GRID_BLOCKED) + !(around[offsets[WEST]] & GRID_BLOCKED);
+}
+
+/*
+  setCellBit and cellBit functions:
+  These functions write and read the bit of a cell in a mask.
+*/
+static void setCellBit(uint64_t *mask, int cell, bool on){
+  if (on) mask[cell >> 6] |= 1ULL << (cell & 63);
+  else mask[cell >> 6] &= ~(1ULL << (cell & 63));
+}
+
+static bool cellBit(const uint64_t *mask, int cell){
+  return (mask[cell >> 6] >> (cell & 63)) & 1;
+}
+
+/*
+  touchesCell function:
+  This function tells whether a cell is next to a cell of a mask (false for -1).
+*/
+static bool touchesCell(const GameContext *ctx, const uint64_t *mask, int cell){
+  if (cell < 0) return false;
+  for (int i = 0; i < 4; i++) if (cellBit(mask, cell + ctx->grid.offsets[i])) return true;
+  return false;
+}
+
+/*
+  fillStep function:
+  This function makes one step of a flood fill on the words [lo, hi) of the board: next = reach, plus the free cells
+  next to it. A shift by one row is a shift by rowWords words and rowBits bits; the bits coming from the word before
+  (or after) are shifted in two steps so that rowBits = 0 doesn't shift by 64. Then the fill runs along the rows
+  inside each word: EAST in one addition (the carry of a reached bit runs through the free bits above it),
+  WEST with a doubling fill (1, 2, 4 ... 32 cells), so a corridor along a row costs one step instead of one per cell.
+  It returns the number of cells in next. It is the generic kernel: the shifts of a row are read from the bitboard.
+*/
+static int fillStep(const Bitboard *bb, const uint64_t *free, int lo, int hi){
+  return fillStepKernel(bb, free, lo, hi, bb->rowWords, bb->rowBits);
+}
+
+/*
+  fillStepKernel function:
+  This function is the body of fillStep for rows of q words and s bits (constants in the kernels of SIZE_KERNELS).
+*/
+KERNEL_INLINE int fillStepKernel(const Bitboard *bb, const uint64_t *free, int lo, int hi, int q, int s){
+  const uint64_t *reach = bb->reach;
+  uint64_t *next = bb->next;
+  int count = 0;
+
+  for (int i = lo; i < hi; i++){
+    uint64_t r = reach[i];
+    uint64_t grown = r << 1 | reach[i - 1] >> 63 // EAST
+      | r >> 1 | reach[i + 1] << 63 // WEST
+      | reach[i - q] << s | (reach[i - q - 1] >> 1) >> (63 - s) // SOUTH
+      | reach[i + q] >> s | (reach[i + q + 1] << 1) << (63 - s); // NORTH
+    uint64_t f = free[i];
+    uint64_t n = r | (grown & f);
+    uint64_t seeds = n & f, west = seeds, open = f;
+    west |= open & (west >> 1); open &= open >> 1;
+    west |= open & (west >> 2); open &= open >> 2;
+    west |= open & (west >> 4); open &= open >> 4;
+    west |= open & (west >> 8); open &= open >> 8;
+    west |= open & (west >> 16); open &= open >> 16;
+    west |= open & (west >> 32);
+    next[i] = n | (((f + seeds) ^ f) & f) | west;
+    count += __builtin_popcountll(next[i]);
+  }
+  return count;
+}
+
+#if defined(__GNUC__)
+typedef uint64_t BitVector __attribute__((vector_size(32))); //4 words: AVX2 with -mavx2, two SSE2 registers otherwise
+
+/*
+  loadBits function:
+  This function loads 4 words of a mask from any word (the shifted words are not aligned on 4).
+  (The vector goes through a pointer: passing it by value would depend on whether AVX is enabled.)
+*/
+static void loadBits(BitVector *v, const uint64_t *words){
+  memcpy(v, words, sizeof(*v));
+}
+#endif
+
+/*
+  fillStepSimd function:
+  This function is fillStep working on 4 words at a time (lo and hi multiples of 4). Without the vector extension
+  of GCC, it is fillStep. It is the generic kernel, as fillStep.
+*/
+static int fillStepSimd(const Bitboard *bb, const uint64_t *free, int lo, int hi){
+  return fillStepSimdKernel(bb, free, lo, hi, bb->rowWords, bb->rowBits);
+}
+
+/*
+  fillStepSimdKernel function:
+  This function is the body of fillStepSimd for rows of q words and s bits.
+*/
+KERNEL_INLINE int fillStepSimdKernel(const Bitboard *bb, const uint64_t *free, int lo, int hi, int q, int s){
+#if defined(__GNUC__)
+  const uint64_t *reach = bb->reach;
+  uint64_t *next = bb->next;
+  int count = 0;
+
+  for (int i = lo; i < hi; i += 4){
+    BitVector r, before, after, above, aboveBefore, below, belowAfter, f;
+    loadBits(&r, reach + i);
+    loadBits(&before, reach + i - 1);
+    loadBits(&after, reach + i + 1);
+    loadBits(&above, reach + i - q);
+    loadBits(&aboveBefore, reach + i - q - 1);
+    loadBits(&below, reach + i + q);
+    loadBits(&belowAfter, reach + i + q + 1);
+    loadBits(&f, free + i);
+    BitVector grown = r << 1 | before >> 63 // EAST
+      | r >> 1 | after << 63 // WEST
+      | above << s | (aboveBefore >> 1) >> (63 - s) // SOUTH
+      | below >> s | (belowAfter << 1) << (63 - s); // NORTH
+    BitVector n = r | (grown & f);
+    BitVector seeds = n & f, west = seeds, open = f;
+    west |= open & (west >> 1); open &= open >> 1;
+    west |= open & (west >> 2); open &= open >> 2;
+    west |= open & (west >> 4); open &= open >> 4;
+    west |= open & (west >> 8); open &= open >> 8;
+    west |= open & (west >> 16); open &= open >> 16;
+    west |= open & (west >> 32);
+    n |= (((f + seeds) ^ f) & f) | west;
+    memcpy(next + i, &n, sizeof(n));
+    count += __builtin_popcountll(n[0]) + __builtin_popcountll(n[1]) + __builtin_popcountll(n[2]) + __builtin_popcountll(n[3]);
+  }
+  return count;
+#else
+  return fillStepKernel(bb, free, lo, hi, q, s);
+#endif
+}
+
+/*
+  SIZE_KERNELS macro, the kernels of a level size: the generic kernels compiled with the size as a constant.
+  sizeKernels lists them, selectKernels picks the ones of the map size.
+*/
+#define SIZE_KERNELS(X, Y) \
+  static int bfsDistances##X##x##Y(PathFinder *pf, const Grid *grid, int start, const int *goals, int ngoals){ \
+    return bfsKernel(pf, grid->cells, X, start, goals, ngoals); \
+  } \
+  static int fillStep##X##x##Y(const Bitboard *bb, const uint64_t *free, int lo, int hi){ \
+    return fillStepKernel(bb, free, lo, hi, X / 64, X % 64); \
+  } \
+  static int fillStepSimd##X##x##Y(const Bitboard *bb, const uint64_t *free, int lo, int hi){ \
+    return fillStepSimdKernel(bb, free, lo, hi, X / 64, X % 64); \
+  }
+#define SIZE_KERNELS_ENTRY(X, Y) {X, Y, bfsDistances##X##x##Y, fillStep##X##x##Y, fillStepSimd##X##x##Y, 0}
+
+// the sizes of the shipped levels (level-*.map)
+SIZE_KERNELS(10, 5)
+SIZE_KERNELS(20, 10)
+SIZE_KERNELS(40, 10)
+SIZE_KERNELS(80, 20)
+
+static const SizeKernels sizeKernels[] = {
+  SIZE_KERNELS_ENTRY(10, 5), SIZE_KERNELS_ENTRY(20, 10), SIZE_KERNELS_ENTRY(40, 10), SIZE_KERNELS_ENTRY(80, 20)
+};
+
+/*
+  selectKernels function:
+  This function picks the kernels of the map size (the generic ones for a size without its own, or when
+  SNAKE_KERNELS=generic), and computes the constants of the size. It runs when the buffers are set up and
+  at the beginning of each game, so the moves only make an indirect call.
+*/
+static void selectKernels(GameContext *ctx){
+  SizeKernels *k = &ctx->kernels;
+  *k = (SizeKernels){0, 0, bfsDistances, fillStep, fillStepSimd, 0};
+  for (size_t i = 0; !ctx->genericKernels && i < sizeof(sizeKernels) / sizeof(sizeKernels[0]); i++){
+    if (sizeKernels[i].mapxsize == ctx->mapxsize && sizeKernels[i].mapysize == ctx->mapysize) *k = sizeKernels[i];
+  }
+  k->innerCells = (ctx->mapxsize - 2) * (ctx->mapysize - 2);
+}
+
+/*
+  fillRegion function:
+  This function flood fills the cells of a free mask reachable from a cell (which doesn't have to be free),
+  one step (one BFS level) at a time, until the stop cell (-1: none) is next to the region, the region holds
+  limit cells besides the start, or nothing is added. Only the words the region can have reached are computed:
+  the range grows by one row on each side per step. The reach and next masks are empty outside that range, so
+  clearing it at the end leaves them empty for the next fill, instead of clearing the whole board at the start.
+*/
+static void fillRegion(GameContext *ctx, const uint64_t *free, int cell, int stop, int limit, Region *region){
+  Bitboard *bb = &ctx->bits;
+  int grow = bb->rowWords + 1; //Words a step can spread to on each side
+  int lo = cell >> 6, hi = lo + 1;
+  int count = 1;
+
+  setCellBit(bb->reach, cell, true); //The masks are empty (zeroed with the arena, then by each fill)
+  region->tail = (cell == stop || touchesCell(ctx, bb->reach, stop));
+
+  while (!region->tail && count - 1 < limit){
+    lo = (lo - grow > 0) ? lo - grow : 0;
+    hi = (hi + grow < bb->words) ? hi + grow : bb->words;
+    if (bb->simd){
+      lo &= ~3;
+      hi = (hi + 3) & ~3;
+    }
+    int added = (bb->simd ? ctx->kernels.fillStepSimd(bb, free, lo, hi) : ctx->kernels.fillStep(bb, free, lo, hi)) - count;
+
+    uint64_t *swap = bb->reach; //The new step becomes the region
+    bb->reach = bb->next;
+    bb->next = swap;
+    if (added == 0) break;
+    count += added;
+    region->tail = touchesCell(ctx, bb->reach, stop);
+  }
+  memset(bb->reach + lo, 0, (hi - lo) * sizeof(uint64_t));
+  memset(bb->next + lo, 0, (hi - lo) * sizeof(uint64_t));
+  region->size = count - 1;
+  if (ctx->moveStats.enabled) ctx->moveStats.game.regionCells += count;
+}
+
+/*
+  regionAround function:
+  This function tells how many free cells are reachable from a cell (where the head would be after a move),
+  and whether the tail is next to them. Counting everything is not needed: the fill stops as soon as the tail
+  is reached or the region holds limit cells (the snake fits), so only a dead end gets explored completely.
+*/
+static void regionAround(GameContext *ctx, int cell, int limit, Region *region){
+  int tail = (ctx->length > 1) ? ctx->tailPos.y * ctx->mapxsize + ctx->tailPos.x : -1;
+  fillRegion(ctx, ctx->bits.free, cell, tail, limit, region);
+}
+
+/*
+  trapPenalty function:
+  This function returns what the strategies take off the score of a move leading to a cell:
+  nothing if the snake fits in the region behind it or can follow its tail from there,
+  otherwise trapWeight for each cell missing (so the largest dead end is the least bad).
+*/
+static double trapPenalty(GameContext *ctx, int cell){
+  Region region;
+  if (ctx->params.trapWeight == 0) return 0;
+  regionAround(ctx, cell, ctx->length, &region);
+  if (region.tail || region.size >= ctx->length) return 0;
+  return ctx->params.trapWeight * (ctx->length - region.size);
+}
+
+/*
+  startScores function:
+  This function starts the scores of the 4 moves with the weights of a strategy: no move valid yet,
+  and a random fallback (drawn here, before the moves are looked at, as the strategies always did).
+*/
+static void startScores(GameContext *ctx, MoveScores *scores, double distanceWeight, double spaceWeight){
+  memset(scores, 0, sizeof(MoveScores));
+  scores->distanceWeight = distanceWeight;
+  scores->spaceWeight = spaceWeight;
+  scores->fallback = randomAction(ctx);
+}
+
+/*
+  moveScore function:
+  This function returns the score of a valid move. The terms are added in the order of the strategies,
+  scoreBatch gives the same scores to the bit.
+*/
+static double moveScore(const MoveScores *scores, int i){
+  double score = 0;
+  score -= scores->distance[i] * scores->distanceWeight;
+  score += scores->space[i] * scores->spaceWeight;
+  score -= scores->trap[i];
+  return score;
+}
+
+/*
+  bestScoredMove function:
+  This function returns the valid move with the best score (the first one on ties), or the fallback.
+*/
+static action bestScoredMove(const MoveScores *scores){
+  action best_move = scores->fallback;
+  double best_score = -999999;
+  for (int i = 0; i < 4; i++){
+    if (!scores->valid[i]) continue;
+    double score = moveScore(scores, i);
+    if (score > best_score){
+      best_score = score;
+      best_move = (action)i;
+    }
+  }
+  return best_move;
+}
+
+/*
+  scoreMoves function:
+  This function returns the move chosen from the scores of a strategy, or, in a batch (ctx->deferred is set),
+  leaves the scores there for scoreBatch and returns the fallback, which the batch replaces.
+*/
+static action scoreMoves(GameContext *ctx, const MoveScores *scores){
+  recordScores(ctx, scores);
+  if (ctx->deferred == NULL) return bestScoredMove(scores);
+  *ctx->deferred = *scores;
+  ctx->deferredMove = true;
+  return scores->fallback;
+}
+
+/*
+  gatherScores function:
+  This function lays out the scores left by the games of a batch as the arrays scoreBatch reads,
+  and fills the padding up to the next multiple of 4 with entries that have no valid move.
+*/
+static void gatherScores(BatchScores *b, int n){
+  int padded = (n + 3) & ~3;
+  for (int j = 0; j < padded; j++){
+    const MoveScores *scores = &b->deferred[j < n ? j : 0];
+    for (int i = 0; i < 4; i++){
+      int k = i * b->lanes + j;
+      b->valid[k] = (j < n && scores->valid[i]) ? -1 : 0;
+      b->distance[k] = scores->distance[i];
+      b->space[k] = scores->space[i];
+      b->trap[k] = scores->trap[i];
+    }
+    b->distanceWeight[j] = scores->distanceWeight;
+    b->spaceWeight[j] = scores->spaceWeight;
+    b->best[j] = scores->fallback;
+  }
+}
+
+#if defined(__GNUC__)
+typedef double ScoreVector __attribute__((vector_size(32))); // scores of 4 games
+typedef long long MaskVector __attribute__((vector_size(32))); // masks or moves of 4 games
+
+/*
+  loadScores function:
+  This function loads 4 doubles into a vector (through a pointer, see loadBits).
+*/
+static void loadScores(ScoreVector *v, const double *p){
+  memcpy(v, p, sizeof(ScoreVector));
+}
+
+/*
+  loadMasks function:
+  This function loads 4 masks into a vector.
+*/
+static void loadMasks(MaskVector *v, const long long *p){
+  memcpy(v, p, sizeof(MaskVector));
+}
+#endif
+
+/*
+  scoreBatch function:
+  This function chooses the moves of the n games gathered by gatherScores: the same computation as bestScoredMove,
+  term by term in the same order, on vectors of 4 games (GCC and Clang vector extensions, lowered to whatever
+  the target has), so the moves are exactly the ones bestScoredMove would choose.
+*/
+static void scoreBatch(BatchScores *b, int n){
+#if defined(__GNUC__)
+  const ScoreVector floor = {-999999, -999999, -999999, -999999};
+  for (int j = 0; j < n; j += 4){
+    ScoreVector distanceWeight, spaceWeight, best = floor;
+    MaskVector move;
+    loadScores(&distanceWeight, b->distanceWeight + j);
+    loadScores(&spaceWeight, b->spaceWeight + j);
+    loadMasks(&move, b->best + j);
+
+    for (int i = 0; i < 4; i++){
+      ScoreVector distance, space, trap;
+      MaskVector valid;
+      int k = i * b->lanes + j;
+      loadScores(&distance, b->distance + k);
+      loadScores(&space, b->space + k);
+      loadScores(&trap, b->trap + k);
+      loadMasks(&valid, b->valid + k);
+
+      ScoreVector score = (ScoreVector){0, 0, 0, 0} - distance * distanceWeight;
+      score += space * spaceWeight;
+      score -= trap;
+      MaskVector better = (MaskVector)(score > best) & valid;
+      best = (ScoreVector)(((MaskVector)score & better) | ((MaskVector)best & ~better));
+      move = (move & ~better) | ((MaskVector){i, i, i, i} & better);
+    }
+    memcpy(b->best + j, &move, sizeof(MaskVector));
+  }
+#else
+  for (int j = 0; j < n; j++){
+    b->best[j] = bestScoredMove(&b->deferred[j]);
+  }
+#endif
+}
+
+/*
+  zigzagStrategy function:
+  This function returns the action needed to go in a zigzag pattern while leaving a path on the bottom of the map
+  so the snake doesn't get trapped.
+*/
+static action zigzagStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, GameContext *ctx, action last_action){
+  
+  action moves[4] = {NORTH, EAST, SOUTH, WEST}; //Array to iterate through the moves without naming them everytime
+  int head = headPos.y * mapxsize + headPos.x; //Cell of the head in the grid (y * mapxsize + x)
+
+  //zigzag pattern: move right, go down at the edge of the map, move left, go down, repeat
+  //With this we can sweep the map and get the bonus in case it's too far away without getting trapped
+
+  //Check if we're at the right edge (near the right wall)
+  bool atRightEdge = (headPos.x >= mapxsize - 3); // Leave path for the snake to comeback -1 for the wall, -1 for the free path and -1 where the snake should be
+  //Check if we're at the left edge (near the right wall)
+  bool atLeftEdge = (headPos.x <= 2); //same logic because the map starts at 0
+  bool atBottomEdge = (headPos.y >= mapysize - 3); //Same logic
+  bool atTopEdge = (headPos.y <= 2); //Same logic
+
+  //Determine if we should be moving right or left depending on the y coordinates (lines)
+  //we choose:
+  //Even lines (from top): move right
+  //Odd lines: move left
+  bool shouldMoveRight = ((headPos.y) % 2 == 0);
+
+  action preferred_move; //The move that will get us in zigzag path
+  action secondary_move; //Move to use incase the zigzag is not possible
 
   //Special case 1
   //On the way to the top (the last action was NORTH)
@@ -331,202 +2556,1621 @@ static action zigzagStrategy(char **map, int mapxsize, int mapysize, Position he
     } else if (atLeftEdge){
       secondary_move = EAST; // move right
     } else {
-      secondary_move = WEST; //Go left when blocked
+      secondary_move = WEST; //Go left when blocked
+    }
+  }
+
+  //Special case 2
+  //At bottom edge, we should move up again
+  else if (atBottomEdge){
+    if (atRightEdge){
+      //We're in the right bottom corner, we should go up 
+      preferred_move = NORTH;
+      secondary_move = WEST;
+    } else if (atLeftEdge) {
+      //We're in the left bottom corner, we should go up
+      preferred_move = NORTH;
+      secondary_move = EAST;
+    } else {
+      //Bottom edge, but not in a corner, should continue moving horizontally until we hit a corner
+      if (shouldMoveRight){
+        preferred_move = EAST;
+        secondary_move = NORTH;
+      } else {
+        preferred_move = WEST; 
+        secondary_move = NORTH;
+      }
+    }
+  }
+  //Special case 3
+  //At top edge (after going back up) we should restart the zigzaging and going down again
+  else if (atTopEdge){
+    if (atLeftEdge){
+      preferred_move = SOUTH;
+      secondary_move = EAST;
+    } else if (atRightEdge){
+      preferred_move = SOUTH;
+      secondary_move = WEST;
+    } else {
+      //continue horizontal at the top until we're in a corner
+      if (shouldMoveRight){
+        preferred_move = EAST;
+        secondary_move = SOUTH;
+      } else {
+        preferred_move = WEST;
+        secondary_move = SOUTH;
+      }
+    }
+
+  }
+  // Default zigzag pattern (only if no special case handled above)
+  else {
+    if (shouldMoveRight){// We should move right
+      
+      if (atRightEdge){// We're close to the right edge, we should move down
+        preferred_move = SOUTH; //Zigzag path
+        secondary_move = EAST; // Continue right if not possible
+      } else { //We're far from the the right edge, we should continue moving right to make the zigzag pattern
+        preferred_move = EAST; //Zigzag path
+        secondary_move = SOUTH; // Go down if not possible
+      }
+
+    } else {// We should move left and follow same logic
+      if (atLeftEdge){ //Move down
+        preferred_move = SOUTH;
+        secondary_move = WEST;
+      } else { //Move left
+        preferred_move = WEST;
+        secondary_move = SOUTH;
+      }
+    }
+  }
+
+  //Try the preferred move first (unless it leads to a dead end the snake doesn't fit in)
+  if (moveValid(ctx, preferred_move, head) && trapPenalty(ctx, head + ctx->grid.offsets[preferred_move]) == 0){
+    return preferred_move;
+  }
+  //Else try secondary move
+  if (moveValid(ctx, secondary_move, head) && trapPenalty(ctx, head + ctx->grid.offsets[secondary_move]) == 0){
+    return secondary_move;
+  }
+
+  //In case both not valid (or dead ends), try any valid move with priority to moving away from bottom/top edges and towards bonus
+  MoveScores scores;
+  startScores(ctx, &scores, ctx->params.zigzagBonusWeight, ctx->params.zigzagSpaceWeight);
+
+  for (int i = 0; i < 4; i++){
+    if (moveValid(ctx, moves[i], head)){
+      int cell = head + ctx->grid.offsets[i];
+      int newX = ctx->paths.cellX[cell];
+      int newY = ctx->paths.cellY[cell];
+      scores.valid[i] = true;
+
+      //Distance to bonus 
+      scores.distance[i] = abs(newX - bonusPos.x) + abs(newY - bonusPos.y);
+
+      //Free space
+      scores.space[i] = countValidMoves(ctx, cell);
+
+      //Dead ends
+      scores.trap[i] = trapPenalty(ctx, cell);
+    }
+  }
+
+  return scoreMoves(ctx, &scores);
+}
+
+/*
+  aggressiveStrategy function:
+  This function returns the action to move towards the bonus, in an aggressive way: the distance to the bonus
+  weighs the most, the escape moves from the next cell add a bit of safety, and a move into a dead end the snake
+  doesn't fit in gets the trap penalty.
+*/
+static action aggressiveStrategy(char **map, int mapysize, int mapxsize, Position headPos, Position bonusPos, GameContext *ctx){
+  //Same coding logic to go through possible moves
+  action moves[4] = {NORTH, EAST, SOUTH, WEST};
+  int head = headPos.y * ctx->mapxsize + headPos.x;
+
+  //Real distances from the cells next to the head to the bonus (the distance field, or a search when there is no bonus)
+  if (!ctx->bonusField.valid) buildBonusField(ctx);
+  ctx->bonusField.read = true;
+  bool useField = ctx->bonusField.valid;
+  if (!useField) distancesToTarget(ctx, headPos, bonusPos);
+  int unreachable = mapxsize * mapysize;
+
+  MoveScores scores;
+  startScores(ctx, &scores, ctx->params.aggressiveBonusWeight, ctx->params.aggressiveSpaceWeight);
+
+  for (int i = 0; i < 4; i++){
+    if (!moveValid(ctx, moves[i], head)){
+      continue;
+    }
+
+    int cell = head + ctx->grid.offsets[i];
+    scores.valid[i] = true;
+
+    //More aggressive towards bonus (coefficient 200 by default)
+    int distToBonus = useField ? ctx->bonusField.dist[cell] : pathDistance(&ctx->paths, cell);
+    if (distToBonus < 0) distToBonus = unreachable;
+    scores.distance[i] = distToBonus;
+
+    //Add a bit of safety to not make it too risky by taking moves with better escape possibilities
+    scores.space[i] = countValidMoves(ctx, cell);
+
+    //But not into a dead end the snake doesn't fit in
+    scores.trap[i] = trapPenalty(ctx, cell);
+  }
+
+  return scoreMoves(ctx, &scores);
+}
+
+/*
+  smartStrategy function:
+  This function chooses which strategy to go with, between zigzag and aggressive based on the situation
+  We choose the aggressive strategy if:
+    -The snake is too small (length under 5)
+    -The snake's head is very close to the bonus (5 cells)
+  We choose the zigzag strategy if:
+    -The snake is very large (fills up 60% of the map at least)
+    -The bonus is very far away in comparison to the tail (over 1,5 x distance to the tail)
+  Otherwise (none of the cases before apply) we zigzag too: chasing the tail there circles it until the game times out
+*/
+static action smartStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, GameContext *ctx, action last_action){
+  int snakeLength = ctx->length;
+  const StrategyParams *params = &ctx->params; //Default thresholds in the comments below, tuned with tuner.c
+
+  //Calculate distances
+  int distHeadToBonus = abs(headPos.x - bonusPos.x) + abs(headPos.y - bonusPos.y);
+  int distHeadToTail = abs(headPos.x - tailPos.x) + abs(headPos.y - tailPos.y);
+
+  //Snake is small (length <= 5) => aggressive
+  if (snakeLength <= params->aggressiveLength){
+    notePick(ctx, PICK_AGGRESSIVE_SMALL);
+    return aggressiveStrategy(map, mapysize, mapxsize, headPos, bonusPos, ctx);
+  }
+
+  //Snake's head is close to the bonus (under 5 cells) => aggressive
+  if (distHeadToBonus <= params->bonusRadius){
+    notePick(ctx, PICK_AGGRESSIVE_CLOSE);
+    return aggressiveStrategy(map, mapysize, mapxsize, headPos, bonusPos, ctx);
+  }
+
+  //Snake is big (fills up 60% of the map at least) => zigzag (can be brought down to minimize snake chasing tail)
+  int totalCells = ctx->kernels.innerCells; //No walls
+  if (snakeLength > totalCells * params->fillRatio){
+    notePick(ctx, PICK_ZIGZAG_FULL);
+    return zigzagStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  }
+
+  //Snake's head is too far away from the bonus (> 1,5x distance to tail) => zigzag
+  //This prevents the snake from chasing his tail in circles when the bonus is far
+  if (distHeadToBonus > distHeadToTail * params->distanceRatio && snakeLength > params->aggressiveLength){
+    notePick(ctx, PICK_ZIGZAG_FAR);
+    return zigzagStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  }
+
+  //None of the cases above fit for the current situation => default, zigzag
+  notePick(ctx, PICK_ZIGZAG_DEFAULT);
+  return zigzagStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+}
+
+/*
+  startVirtualSnake function:
+  This function starts a virtual snake identical to the real one.
+*/
+static void startVirtualSnake(VirtualSnake *vs, const GameContext *ctx){
+  vs->body = ctx->body;
+  vs->first = ctx->first;
+  vs->capacity = ctx->capacity;
+  vs->mapxsize = ctx->mapxsize;
+  vs->realCells = ctx->length;
+  vs->pushed = ctx->virtualCells;
+  vs->npushed = 0;
+  vs->popped = 0;
+  vs->length = ctx->length;
+}
+
+/*
+  virtualTail function:
+  This function returns the cell of the virtual snake's tail: the oldest real cell left, or else the oldest pushed cell.
+*/
+static int virtualTail(const VirtualSnake *vs){
+  if (vs->realCells > 0){
+    Position p = vs->body[(vs->first + vs->realCells - 1) % vs->capacity];
+    return p.y * vs->mapxsize + p.x;
+  }
+  return vs->pushed[vs->popped];
+}
+
+/*
+  virtualTailNext function:
+  This function returns the cell of the virtual snake next to its tail, toward the head (the snake has 2 cells or more).
+*/
+static int virtualTailNext(const VirtualSnake *vs){
+  if (vs->realCells > 1){
+    Position p = vs->body[(vs->first + vs->realCells - 2) % vs->capacity];
+    return p.y * vs->mapxsize + p.x;
+  }
+  return vs->pushed[vs->popped + (vs->realCells > 0 ? 0 : 1)];
+}
+
+/*
+  advanceVirtualSnake function:
+  This function moves the virtual snake's head to a cell: the tail moves away unless the snake grows.
+  It returns the cell the tail left (-1 if the snake grew), the board is up to the caller.
+*/
+static int advanceVirtualSnake(VirtualSnake *vs, int cell, bool grow){
+  int freed = -1;
+  if (!grow){//The tail moves away
+    freed = virtualTail(vs);
+    if (vs->realCells > 0) vs->realCells--;
+    else vs->popped++;
+  } else {
+    vs->length++;
+  }
+  vs->pushed[vs->npushed++] = cell;
+  return freed;
+}
+
+/*
+  moveVirtualSnake function:
+  This function moves the virtual snake's head to a cell, on a copy of the free mask, as the engine would:
+  the tail cell is freed unless the snake grows, and the cell of the new head is taken.
+*/
+static void moveVirtualSnake(VirtualSnake *vs, uint64_t *free, int cell, bool grow){
+  int freed = advanceVirtualSnake(vs, cell, grow);
+  if (freed >= 0) setCellBit(free, freed, true);
+  setCellBit(free, cell, false);
+}
+
+/*
+  planPath function:
+  This function copies the path found by the last search (read backwards from the goal with the parent buffer)
+  into the path buffer, in the order of the moves. It returns the number of moves.
+*/
+static int planPath(GameContext *ctx, int goal){
+  const PathFinder *pf = &ctx->paths;
+  int length = pathDistance(pf, goal);
+  int cell = goal;
+  for (int i = length - 1; i >= 0; i--){
+    ctx->path[i] = cell;
+    cell = pf->parent[cell];
+  }
+  return length;
+}
+
+/*
+  safePathToBonus function:
+  This function checks that going to the bonus won't seal the snake in:
+  the shortest path to the bonus is played by a virtual snake on a copy of the free mask, then the tail of the virtual snake
+  must still be reachable from its head (a snake that can follow its tail can't get trapped), which a flood fill tells.
+  It returns true, with the first move of the path, when the bonus can be safely eaten.
+*/
+static bool safePathToBonus(GameContext *ctx, char **map, action *firstMove){
+  int mapxsize = ctx->mapxsize;
+  int bonus = ctx->bonusPos.y * mapxsize + ctx->bonusPos.x;
+  action move = NORTH; //Set by pathToBonus when there is a path
+
+  //Path to the bonus on the real board
+  int length = pathToBonus(ctx, map, &move);
+  if (length <= 0) return false;
+  planPath(ctx, bonus);
+
+  //Copy of the free mask (a few dozen words)
+  memcpy(ctx->bits.virtualFree, ctx->bits.free, ctx->bits.words * sizeof(uint64_t));
+
+  //The virtual snake follows the path, and grows on the bonus
+  VirtualSnake vs;
+  startVirtualSnake(&vs, ctx);
+  for (int i = 0; i < length; i++){
+    moveVirtualSnake(&vs, ctx->bits.virtualFree, ctx->path[i], ctx->path[i] == bonus);
+  }
+
+  //Can it still reach its tail?
+  Region region;
+  fillRegion(ctx, ctx->bits.virtualFree, ctx->path[length - 1], virtualTail(&vs), ctx->paths.cells, &region);
+  if (!region.tail) return false;
+
+  *firstMove = move;
+  return true;
+}
+
+/*
+  lookaheadStrategy function:
+  This function goes for the bonus only when the virtual snake shows it is safe (see safePathToBonus).
+  Otherwise it chases its tail, choosing among the moves from which the tail can still be reached the one
+  that is the furthest from it, to stretch the body and make room. If the tail can't be reached at all,
+  the smart strategy decides.
+*/
+static action lookaheadStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, GameContext *ctx, action last_action){
+  action moves[4] = {NORTH, EAST, SOUTH, WEST};
+  action a;
+
+  if (safePathToBonus(ctx, map, &a)){
+    notePick(ctx, PICK_LOOKAHEAD_BONUS);
+    return a;
+  }
+
+  //Tail chasing: distances from the tail to the cells next to the head
+  //(the tail cell itself is a valid move for the engine, since the tail moves away at the same time)
+  distancesToTarget(ctx, headPos, tailPos);
+  int head = headPos.y * mapxsize + headPos.x;
+  int tail = tailPos.y * mapxsize + tailPos.x;
+  int bestDist = -1;
+  for (int i = 0; i < 4; i++){
+    int cell = head + ctx->grid.offsets[i];
+    bool ontoTail = (cell == tail && ctx->length > 1);
+    if (!ontoTail && !actionValid(ctx, moves[i], head)) continue;
+    int dist = pathDistance(&ctx->paths, cell);
+    if (dist > bestDist){
+      bestDist = dist;
+      a = moves[i];
+    }
+  }
+  if (bestDist >= 0){
+    notePick(ctx, PICK_LOOKAHEAD_TAIL);
+    return a;
+  }
+
+  return smartStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+}
+
+/*
+  levelSignature function:
+  This function hashes the position of the walls of the map (FNV-1a), to recognize a level already seen.
+*/
+static unsigned long levelSignature(char **map, int mapxsize, int mapysize){
+  unsigned long hash = 2166136261UL;
+  for (int y = 0; y < mapysize; y++)
+    for (int x = 0; x < mapxsize; x++){
+      hash ^= (map[y][x] == WALL);
+      hash *= 16777619UL;
+    }
+  return hash;
+}
+
+/*
+  buildRectangleCycle function:
+  This function builds the cycle of a level whose free cells are exactly the inside of the border.
+  With an even number of rows, the cycle sweeps the rows in a zigzag, leaving the first column free,
+  then comes back up along that column:
+    ->->->->->-v
+    ^ v<-<-<-<-<
+    ^ ->->->->-v
+    ^-<-<-<-<-<-
+  With an odd number of rows but an even number of columns, the same pattern is used with rows and columns swapped.
+  Both odd: there is no Hamiltonian cycle (the grid is bipartite with one more cell of one color).
+*/
+static bool buildRectangleCycle(HamiltonCycle *cycle, char **map, int mapxsize, int mapysize){
+  int w = mapxsize - 2; //Inside of the border
+  int h = mapysize - 2;
+
+  //Every cell inside the border must be free, every cell of the border a wall
+  for (int y = 0; y < mapysize; y++)
+    for (int x = 0; x < mapxsize; x++){
+      bool border = (x == 0 || y == 0 || x == mapxsize - 1 || y == mapysize - 1);
+      if ((map[y][x] == WALL) != border) return false;
+    }
+  if (w < 2 || h < 2 || (w % 2 == 1 && h % 2 == 1)) return false;
+
+  int previous = -1, start = -1;
+  int cells = w * h;
+  for (int i = 0; i < cells; i++){
+    int x, y; //Position of the i-th cell along the cycle
+    if (h % 2 == 0){
+      if (i < h * (w - 1)){//Zigzag on the rows, without the first column
+        int row = i / (w - 1), step = i % (w - 1);
+        y = 1 + row;
+        x = (row % 2 == 0) ? 2 + step : w - step;
+      } else {//Back up along the first column
+        x = 1;
+        y = h - (i - h * (w - 1));
+      }
+    } else {
+      if (i < w * (h - 1)){//Zigzag on the columns, without the first row
+        int col = i / (h - 1), step = i % (h - 1);
+        x = 1 + col;
+        y = (col % 2 == 0) ? 2 + step : h - step;
+      } else {//Back along the first row
+        y = 1;
+        x = w - (i - w * (h - 1));
+      }
+    }
+    int cell = y * mapxsize + x;
+    if (previous >= 0) cycle->next[previous] = cell;
+    else start = cell;
+    previous = cell;
+  }
+  cycle->next[previous] = start; //Close the cycle
+
+  return numberCycle(cycle, start, cells);
+}
+
+/*
+  buildBlockCycle function:
+  This function builds a cycle for levels with inner walls, when the free cells can be grouped in 2x2 blocks
+  (aligned on the inside of the border). A spanning tree of the blocks is built with a depth first search,
+  then the cycle goes around the tree: each block is circled counterclockwise, and the two sides of
+  a tree edge between two blocks are opened to link their circles:
+    TL v  < TR       TL moves WEST if linked to the left block,  SOUTH otherwise
+       v    ^        BL moves SOUTH if linked to the block below, EAST otherwise
+    BL >  > BR       BR moves EAST if linked to the right block, NORTH otherwise
+                     TR moves NORTH if linked to the block above, WEST otherwise
+*/
+static bool buildBlockCycle(HamiltonCycle *cycle, char **map, int mapxsize, int mapysize){
+  int w = mapxsize - 2, h = mapysize - 2;
+  if (w < 2 || h < 2 || w % 2 == 1 || h % 2 == 1) return false;
+
+  int bw = w / 2, bh = h / 2; //Size of the map of blocks
+  int blocks = bw * bh;
+  int freeCells = 0, freeBlocks = 0, first = -1;
+  char *blockFree = calloc(blocks, 1);
+  char *linked = calloc(blocks, 1); //Bit 0: linked to the right block, bit 1: linked to the block below
+  char *visited = calloc(blocks, 1);
+  int *stack = malloc(blocks * sizeof(int));
+  bool ok = (blockFree != NULL && linked != NULL && visited != NULL && stack != NULL);
+
+  //Walls on the border only, and blocks either completely free or completely walled
+  for (int y = 0; ok && y < mapysize; y++)
+    for (int x = 0; ok && x < mapxsize; x++){
+      bool border = (x == 0 || y == 0 || x == mapxsize - 1 || y == mapysize - 1);
+      if (border){
+        ok = (map[y][x] == WALL);
+      } else if (map[y][x] != WALL){
+        freeCells++;
+      }
+    }
+  for (int b = 0; ok && b < blocks; b++){
+    int x = 1 + 2 * (b % bw), y = 1 + 2 * (b / bw);
+    int walls = (map[y][x] == WALL) + (map[y][x + 1] == WALL) + (map[y + 1][x] == WALL) + (map[y + 1][x + 1] == WALL);
+    if (walls != 0 && walls != 4) ok = false;
+    blockFree[b] = (walls == 0);
+    if (blockFree[b]){
+      freeBlocks++;
+      if (first < 0) first = b;
+    }
+  }
+
+  //Spanning tree of the free blocks (depth first search)
+  int top = 0, reached = 0;
+  if (ok && first >= 0){
+    stack[top++] = first;
+    visited[first] = 1;
+    reached = 1;
+  }
+  while (ok && top > 0){
+    int b = stack[top - 1];
+    int bx = b % bw, by = b / bw;
+    int neighbors[4] = {by > 0 ? b - bw : -1, bx < bw - 1 ? b + 1 : -1, by < bh - 1 ? b + bw : -1, bx > 0 ? b - 1 : -1};
+    int i;
+    for (i = 0; i < 4; i++){
+      int n = neighbors[i];
+      if (n < 0 || !blockFree[n] || visited[n]) continue;
+      if (i == NORTH) linked[n] |= 2; //Edge stored on the top/left block
+      if (i == EAST) linked[b] |= 1;
+      if (i == SOUTH) linked[b] |= 2;
+      if (i == WEST) linked[n] |= 1;
+      visited[n] = 1;
+      reached++;
+      stack[top++] = n;
+      break;
+    }
+    if (i == 4) top--; //Every neighbor already visited, backtrack
+  }
+  ok = ok && reached > 0 && reached == freeBlocks;
+
+  //Successor of each free cell
+  for (int b = 0; ok && b < blocks; b++){
+    if (!blockFree[b]) continue;
+    int bx = b % bw, by = b / bw;
+    int x = 1 + 2 * bx, y = 1 + 2 * by;
+    bool right = linked[b] & 1, down = linked[b] & 2;
+    bool left = bx > 0 && (linked[b - 1] & 1), up = by > 0 && (linked[b - bw] & 2);
+    int tl = y * mapxsize + x, tr = tl + 1, bl = tl + mapxsize, br = bl + 1;
+    cycle->next[tl] = left ? tl - 1 : bl;
+    cycle->next[bl] = down ? bl + mapxsize : br;
+    cycle->next[br] = right ? br + 1 : tr;
+    cycle->next[tr] = up ? tr - mapxsize : tl;
+  }
+  if (ok){
+    int bx = first % bw, by = first / bw;
+    ok = numberCycle(cycle, (1 + 2 * by) * mapxsize + 1 + 2 * bx, freeCells);
+  }
+
+  free(blockFree);
+  free(linked);
+  free(visited);
+  free(stack);
+  return ok;
+}
+
+/*
+  numberCycle function:
+  This function follows the successors from the start cell, numbering the cells along the way,
+  and checks that it comes back to the start after going through all the free cells exactly once.
+*/
+static bool numberCycle(HamiltonCycle *cycle, int start, int freeCells){
+  int cell = start;
+  for (int i = 0; i < freeCells; i++){
+    if (cycle->order[cell] >= 0) return false; //Cell already visited: not a single cycle
+    cycle->order[cell] = i;
+    cell = cycle->next[cell];
+  }
+  cycle->length = freeCells;
+  return cell == start;
+}
+
+/*
+  releaseCycle function:
+  This function releases the tables of a cycle (unmaps the compiled level they come from, if they do).
+*/
+static void releaseCycle(HamiltonCycle *cycle){
+  if (cycle->mapping != NULL){
+    munmap(cycle->mapping, cycle->mappingSize);
+  } else {
+    free(cycle->next);
+    free(cycle->order);
+  }
+  cycle->mapping = NULL;
+  cycle->next = NULL;
+  cycle->order = NULL;
+}
+
+/*
+  computeCycle function:
+  This function allocates the tables of a cycle and builds the cycle of a level,
+  trying the zigzag of a rectangle first, then the 2x2 blocks. It returns false if there is no memory.
+*/
+static bool computeCycle(HamiltonCycle *cycle, char **map, int mapxsize, int mapysize){
+  int cells = mapxsize * mapysize;
+  cycle->next = malloc(cells * sizeof(int));
+  cycle->order = malloc(cells * sizeof(int));
+  cycle->found = false;
+  if (cycle->next == NULL || cycle->order == NULL) return false;
+
+  for (int i = 0; i < cells; i++) cycle->order[i] = -1;
+  cycle->found = buildRectangleCycle(cycle, map, mapxsize, mapysize);
+  if (!cycle->found){
+    for (int i = 0; i < cells; i++) cycle->order[i] = -1;
+    cycle->found = buildBlockCycle(cycle, map, mapxsize, mapysize);
+  }
+  return true;
+}
+
+/*
+  levelArtifactPath function:
+  This function writes the name of the compiled level of a map in a directory.
+*/
+static void levelArtifactPath(char *path, size_t size, const char *directory, int mapxsize, int mapysize, unsigned long signature){
+  snprintf(path, size, "%s/level-%dx%d-%016lx.lvl", directory, mapxsize, mapysize, signature);
+}
+
+/*
+  levelArtifactTables function:
+  This function returns the offset of the cycle tables in a compiled level (after the header and the walls).
+*/
+static size_t levelArtifactTables(int cells){
+  return (sizeof(LevelArtifact) + (size_t)cells + 7) & ~(size_t)7;
+}
+
+/*
+  loadLevelArtifact function:
+  This function maps the compiled level of a map, if there is one in the directory, and points the tables
+  of the cycle into it. The artifact is only used if it was made for this map (size, signature and every wall)
+  by this version on this kind of machine, and if its tables stay inside the map: a wrong one is never trusted.
+*/
+static bool loadLevelArtifact(HamiltonCycle *cycle, const char *directory, char **map, int mapxsize, int mapysize, unsigned long signature){
+  char path[4096];
+  levelArtifactPath(path, sizeof(path), directory, mapxsize, mapysize, signature);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  void *base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(LevelArtifact)){
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) return false;
+
+  const LevelArtifact *header = base;
+  int cells = mapxsize * mapysize;
+  size_t tables = levelArtifactTables(cells);
+  bool ok = memcmp(header->magic, "SNAKELVL", 8) == 0 && header->version == LEVEL_ARTIFACT_VERSION
+            && header->byteOrder == LEVEL_ARTIFACT_BYTE_ORDER && header->mapxsize == mapxsize && header->mapysize == mapysize
+            && header->signature == signature && header->size == (unsigned long long)st.st_size
+            && header->size == tables + 2 * (size_t)cells * sizeof(int) && header->length >= 0 && header->length <= cells;
+
+  const unsigned char *walls = (const unsigned char *)base + sizeof(LevelArtifact);
+  int *next = (int *)((char *)base + tables);
+  int *order = next + cells;
+  //Checked row by row without branches, so the loops stay as cheap as reading the tables
+  int bad = 0;
+  for (int y = 0; ok && y < mapysize; y++){
+    const unsigned char *row = walls + (size_t)y * mapxsize;
+    for (int x = 0; x < mapxsize; x++) bad |= row[x] ^ (map[y][x] == WALL);
+  }
+  for (int i = 0; ok && header->found && i < cells; i++){
+    bad |= (unsigned)next[i] >= (unsigned)cells;
+    bad |= (unsigned)(order[i] + 1) > (unsigned)header->length;
+  }
+  ok = ok && bad == 0;
+  if (!ok){
+    munmap(base, (size_t)st.st_size);
+    return false;
+  }
+
+  cycle->mapping = base;
+  cycle->mappingSize = (size_t)st.st_size;
+  cycle->next = next; //Read only: the cycle is never changed once built
+  cycle->order = order;
+  cycle->found = header->found;
+  cycle->length = header->length;
+  return true;
+}
+
+/*
+  compileLevel function:
+  This function writes the compiled level of a map in a directory (see LevelArtifact), and its name in path.
+  The file is written under a temporary name then renamed, so a player never maps a half written artifact.
+  It returns false if it can't be written.
+*/
+bool compileLevel(char **map, int mapxsize, int mapysize, const char *directory, char *path, size_t pathSize){
+  HamiltonCycle cycle;
+  memset(&cycle, 0, sizeof(cycle));
+  unsigned long signature = levelSignature(map, mapxsize, mapysize);
+  if (!computeCycle(&cycle, map, mapxsize, mapysize)){
+    releaseCycle(&cycle);
+    return false;
+  }
+
+  int cells = mapxsize * mapysize;
+  size_t tables = levelArtifactTables(cells);
+  LevelArtifact header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "SNAKELVL", 8);
+  header.version = LEVEL_ARTIFACT_VERSION;
+  header.byteOrder = LEVEL_ARTIFACT_BYTE_ORDER;
+  header.mapxsize = mapxsize;
+  header.mapysize = mapysize;
+  header.signature = signature;
+  header.found = cycle.found;
+  header.length = cycle.found ? cycle.length : 0;
+  header.size = tables + 2 * (size_t)cells * sizeof(int);
+
+  //Header, walls and padding in one block, then the tables
+  unsigned char *front = calloc(tables, 1);
+  char temporary[4096];
+  levelArtifactPath(path, pathSize, directory, mapxsize, mapysize, signature);
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *file = (front != NULL) ? fopen(temporary, "wb") : NULL;
+  bool ok = (file != NULL);
+  if (ok){
+    memcpy(front, &header, sizeof(header));
+    for (int i = 0; i < cells; i++) front[sizeof(header) + i] = (map[i / mapxsize][i % mapxsize] == WALL);
+    ok = fwrite(front, 1, tables, file) == tables
+         && fwrite(cycle.next, sizeof(int), cells, file) == (size_t)cells
+         && fwrite(cycle.order, sizeof(int), cells, file) == (size_t)cells;
+    ok = (fclose(file) == 0) && ok;
+    ok = ok && rename(temporary, path) == 0;
+    if (!ok) remove(temporary);
+  }
+  free(front);
+  releaseCycle(&cycle);
+  return ok;
+}
+
+/*
+  prepareCycle function:
+  This function makes sure the cycle matches the level being played.
+  It is only recomputed when the level changes (different size or walls), so it costs nothing in the following games,
+  and not even in the first one when the level was compiled in the directory (levelc.c): the tables are then mapped.
+*/
+static void prepareCycle(HamiltonCycle *cycle, const char *directory, char **map, int mapxsize, int mapysize){
+  unsigned long signature = levelSignature(map, mapxsize, mapysize);
+  if (cycle->next != NULL && cycle->mapxsize == mapxsize && cycle->mapysize == mapysize && cycle->signature == signature){
+    return; //Same level as the previous game
+  }
+
+  releaseCycle(cycle);
+  cycle->mapxsize = mapxsize;
+  cycle->mapysize = mapysize;
+  cycle->signature = signature;
+  if (directory != NULL && loadLevelArtifact(cycle, directory, map, mapxsize, mapysize, signature)) return;
+  computeCycle(cycle, map, mapxsize, mapysize);
+}
+
+/*
+  actionTowards function:
+  This function returns the action leading from a cell to one of its neighbors (cells given by their index).
+*/
+static action actionTowards(int from, int to, int mapxsize){
+  if (to == from - mapxsize) return NORTH;
+  if (to == from + 1) return EAST;
+  if (to == from + mapxsize) return SOUTH;
+  return WEST;
+}
+
+/*
+  hamiltonStrategy function:
+  This function follows the Hamiltonian cycle of the level, taking shortcuts toward the bonus when they are safe.
+  Cells are compared by their distance ahead of the head along the cycle (rel = ordinal - ordinal of the head, modulo the length).
+  As long as the snake only follows the cycle or takes the shortcuts below, its body is ordered along the cycle
+  from the tail to the head, so every cell strictly between the head and the tail (0 < rel < rel of the tail) is free.
+  Moving to such a cell keeps that property, and from there following the cycle can never hit the body:
+  the head only catches up with the tail when the snake fills the whole level. So a shortcut is safe if it lands
+  before the tail, and the best one lands as far as possible without going past the bonus.
+  Each move is a handful of table lookups. Without a cycle for this level (or if the snake is not ordered along the cycle),
+  the smart strategy is used instead.
+*/
+static action hamiltonStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, GameContext *ctx, action last_action){
+  const HamiltonCycle *cycle = &ctx->cycle;
+  action moves[4] = {NORTH, EAST, SOUTH, WEST};
+  const int *offsets = ctx->grid.offsets; //Index changes when moving in each direction
+
+  if (!cycle->found){
+    return smartStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  }
+
+  int n = cycle->length;
+  int head = headPos.y * mapxsize + headPos.x;
+  int headOrder = cycle->order[head];
+  int tailRel = (ctx->length == 1) ? n : (cycle->order[tailPos.y * mapxsize + tailPos.x] - headOrder + n) % n;
+  int bonusRel = ctx->bonusFound ? (cycle->order[bonusPos.y * mapxsize + bonusPos.x] - headOrder + n) % n : 0;
+
+  //Default: the successor on the cycle (always possible while the snake is ordered along the cycle)
+  int best = cycle->next[head];
+  int bestRel = 1;
+
+  for (int i = 0; i < 4; i++){
+    int cell = head + offsets[i];
+    if (cycle->order[cell] < 0 || !actionValid(ctx, moves[i], head)) continue; //Wall or body
+
+    int rel = (cycle->order[cell] - headOrder + n) % n;
+    if (rel >= tailRel) continue; //Would get ahead of the tail: unsafe
+    if (bonusRel > 0 && rel > bonusRel) continue; //Would skip the bonus
+
+    if (rel > bestRel){//Further along the cycle, closer to the bonus
+      best = cell;
+      bestRel = rel;
     }
   }
 
-  //Special case 2
-  //At bottom edge, we should move up again
-  else if (atBottomEdge){
-    if (atRightEdge){
-      //We're in the right bottom corner, we should go up 
-      preferred_move = NORTH;
-      secondary_move = WEST;
-    } else if (atLeftEdge) {
-      //We're in the left bottom corner, we should go up
-      preferred_move = NORTH;
-      secondary_move = EAST;
-    } else {
-      //Bottom edge, but not in a corner, should continue moving horizontally until we hit a corner
-      if (shouldMoveRight){
-        preferred_move = EAST;
-        secondary_move = NORTH;
-      } else {
-        preferred_move = WEST; 
-        secondary_move = NORTH;
-      }
+  action a = actionTowards(head, best, mapxsize);
+  if (best == cycle->next[head] && !actionValid(ctx, a, head)
+      && !(tailRel == 1 && ctx->length > 1)){//Successor blocked (not by the tail, that moves away): the body is not ordered
+    return smartStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  }
+  notePick(ctx, PICK_HAMILTON);
+  return a;
+}
+
+/*
+  policyPath function:
+  This function writes the name of the policy table of a map in a directory.
+*/
+static void policyPath(char *path, size_t size, const char *directory, int mapxsize, int mapysize, unsigned long signature){
+  snprintf(path, size, "%s/level-%dx%d-%016lx.pol", directory, mapxsize, mapysize, signature);
+}
+
+/*
+  policyEntriesOffset function:
+  This function returns the offset of the slots in a policy table (after the header and the walls).
+*/
+static size_t policyEntriesOffset(int cells){
+  return (sizeof(PolicyHeader) + (size_t)cells + 7) & ~(size_t)7;
+}
+
+/*
+  policySlot function:
+  This function returns the first slot probed for a key in a policy table (a mix of its bits, so that the keys
+  of snakes differing only in their last links spread over the table).
+*/
+static uint64_t policySlot(uint64_t key, uint64_t mask){
+  key ^= key >> 31;
+  key *= 0x7FB5D329728EA185ULL;
+  key ^= key >> 27;
+  key *= 0x81DADEF4BC2DD44DULL;
+  key ^= key >> 33;
+  return key & mask;
+}
+
+/*
+  releasePolicy function:
+  This function unmaps the policy table of a level.
+*/
+static void releasePolicy(PolicyTable *policy){
+  if (policy->mapping != NULL) munmap(policy->mapping, policy->mappingSize);
+  free(policy->rank);
+  policy->mapping = NULL;
+  policy->entries = NULL;
+  policy->rank = NULL;
+}
+
+/*
+  loadPolicy function:
+  This function maps the policy table of a map, if there is one in the directory. Like a compiled level, it is only
+  used if it was made for this map (size, signature and every wall) by this version on this kind of machine.
+  The slots are not read here (the file is only paged in as states are looked up): a move read from a damaged table
+  is checked before being played, and a lookup never probes more than every slot.
+*/
+static bool loadPolicy(PolicyTable *policy, const char *directory, char **map, int mapxsize, int mapysize, unsigned long signature){
+  char path[4096];
+  policyPath(path, sizeof(path), directory, mapxsize, mapysize, signature);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  void *base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(PolicyHeader)){
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) return false;
+
+  const PolicyHeader *header = base;
+  int cells = mapxsize * mapysize;
+  size_t entries = policyEntriesOffset(cells);
+  int *rank = malloc(cells * sizeof(int));
+  bool ok = rank != NULL && memcmp(header->magic, "SNAKEPOL", 8) == 0 && header->version == POLICY_VERSION
+            && header->byteOrder == LEVEL_ARTIFACT_BYTE_ORDER && header->mapxsize == mapxsize && header->mapysize == mapysize
+            && header->signature == signature && header->size == (unsigned long long)st.st_size
+            && header->slots >= 2 && (header->slots & (header->slots - 1)) == 0 && header->snakes <= header->slots / 2
+            && header->size == entries + header->slots * sizeof(PolicyEntry);
+
+  //Same walls as the map, and free cells numbered as the solver did
+  const unsigned char *walls = (const unsigned char *)base + sizeof(PolicyHeader);
+  int bad = 0, freeCells = 0;
+  for (int y = 0; ok && y < mapysize; y++){
+    const unsigned char *row = walls + (size_t)y * mapxsize;
+    for (int x = 0; x < mapxsize; x++){
+      bad |= row[x] ^ (map[y][x] == WALL);
+      rank[y * mapxsize + x] = (map[y][x] == WALL) ? -1 : freeCells++;
     }
   }
-  //Special case 3
-  //At top edge (after going back up) we should restart the zigzaging and going down again
-  else if (atTopEdge){
-    if (atLeftEdge){
-      preferred_move = SOUTH;
-      secondary_move = EAST;
-    } else if (atRightEdge){
-      preferred_move = SOUTH;
-      secondary_move = WEST;
-    } else {
-      //continue horizontal at the top until we're in a corner
-      if (shouldMoveRight){
-        preferred_move = EAST;
-        secondary_move = SOUTH;
-      } else {
-        preferred_move = WEST;
-        secondary_move = SOUTH;
-      }
-    }
+  ok = ok && bad == 0 && freeCells == header->cells && freeCells <= POLICY_MAX_CELLS;
+  if (!ok){
+    free(rank);
+    munmap(base, (size_t)st.st_size);
+    return false;
+  }
+
+  policy->mapping = base;
+  policy->mappingSize = (size_t)st.st_size;
+  policy->entries = (const PolicyEntry *)((char *)base + entries);
+  policy->mask = header->slots - 1;
+  policy->cells = header->cells;
+  policy->rank = rank;
+  return true;
+}
 
+/*
+  preparePolicy function:
+  This function makes sure the policy table matches the level being played. The directory is only searched
+  when the level changes, so the following games on the same level cost nothing.
+*/
+static void preparePolicy(PolicyTable *policy, const char *directory, char **map, int mapxsize, int mapysize){
+  unsigned long signature = levelSignature(map, mapxsize, mapysize);
+  if (policy->searched && policy->mapxsize == mapxsize && policy->mapysize == mapysize && policy->signature == signature){
+    return; //Same level as the previous game
   }
-  // Default zigzag pattern (only if no special case handled above)
-  else {
-    if (shouldMoveRight){// We should move right
-      
-      if (atRightEdge){// We're close to the right edge, we should move down
-        preferred_move = SOUTH; //Zigzag path
-        secondary_move = EAST; // Continue right if not possible
-      } else { //We're far from the the right edge, we should continue moving right to make the zigzag pattern
-        preferred_move = EAST; //Zigzag path
-        secondary_move = SOUTH; // Go down if not possible
-      }
 
-    } else {// We should move left and follow same logic
-      if (atLeftEdge){ //Move down
-        preferred_move = SOUTH;
-        secondary_move = WEST;
-      } else { //Move left
-        preferred_move = WEST;
-        secondary_move = SOUTH;
-      }
-    }
+  releasePolicy(policy);
+  policy->mapxsize = mapxsize;
+  policy->mapysize = mapysize;
+  policy->signature = signature;
+  policy->searched = true;
+  if (directory != NULL) loadPolicy(policy, directory, map, mapxsize, mapysize, signature);
+}
+
+/*
+  policyMove function:
+  This function looks the current state up in the policy table of the level: the key of the snake (O(length))
+  leads to its slot, and the move for the bonus is read from it. It returns false if the table doesn't have the
+  state (or gives a move that isn't valid), the strategies then choose the move.
+*/
+static bool policyMove(GameContext *ctx, action *a){
+  const PolicyTable *policy = &ctx->policy;
+  if (policy->entries == NULL || !ctx->bonusFound || ctx->length > policy->cells) return false;
+
+  int mapxsize = ctx->mapxsize;
+  int head = ctx->headPos.y * mapxsize + ctx->headPos.x, cell = head;
+  uint64_t key = (uint64_t)(ctx->length - 1) | (uint64_t)policy->rank[head] << POLICY_KEY_HEAD;
+  for (int i = 1; i < ctx->length; i++){
+    Position p = ctx->body[(ctx->first + i) % ctx->capacity];
+    int next = p.y * mapxsize + p.x;
+    key |= (uint64_t)actionTowards(cell, next, mapxsize) << (POLICY_KEY_LINKS + 2 * (i - 1));
+    cell = next;
   }
 
-  //Try the preferred move first 
-  if (actionValid(preferred_move, map, headPos.x, headPos.y)){
-    return preferred_move;
+  uint64_t slot = policySlot(key, policy->mask);
+  for (uint64_t probes = 0; probes <= policy->mask; probes++, slot = (slot + 1) & policy->mask){
+    const PolicyEntry *entry = &policy->entries[slot];
+    if (entry->key == POLICY_EMPTY) return false;
+    if (entry->key != key) continue;
+    int bonus = policy->rank[ctx->bonusPos.y * mapxsize + ctx->bonusPos.x];
+    *a = (action)((entry->moves >> (2 * bonus)) & 3);
+    return moveValid(ctx, *a, head); //The solved moves follow the tail into the cell it leaves
   }
-  //Else try secondary move
-  if (actionValid(secondary_move, map, headPos.x, headPos.y)){
-    return secondary_move;
+  return false;
+}
+
+/*
+  monotonicSeconds function:
+  This function returns a monotonic time in seconds (for the budget of the MCTS moves).
+*/
+static double monotonicSeconds(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+  approximateLog function:
+  This function returns the natural logarithm of x > 0 (to about 1e-9), without the math library
+  (the game is linked without -lm): x = m * 2^e, then a short series for log(m).
+*/
+static double approximateLog(double x){
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  int e = (int)((bits >> 52) & 0x7FF) - 1023;
+  bits = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL; //m in [1, 2)
+  double m;
+  memcpy(&m, &bits, sizeof(m));
+  if (m > 1.41421356237309505){//m in [0.707, 1.414): faster series
+    m /= 2;
+    e++;
   }
+  double t = (m - 1) / (m + 1), t2 = t * t;
+  double series = t * (2 + t2 * (2.0 / 3 + t2 * (2.0 / 5 + t2 * (2.0 / 7 + t2 * (2.0 / 9)))));
+  return e * 0.693147180559945309 + series;
+}
+
+/*
+  approximateSqrt function:
+  This function returns the square root of x >= 0, without the math library (Newton's method).
+*/
+static double approximateSqrt(double x){
+  if (x <= 0) return 0;
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  bits = (bits >> 1) + 0x1FF8000000000000ULL; //Halve the exponent: first guess within a factor of 2
+  double r;
+  memcpy(&r, &bits, sizeof(r));
+  for (int i = 0; i < 5; i++) r = (r + x / r) / 2;
+  return r;
+}
 
-  //In case both not valid, try any valid move with priority to moving away from bottom/top edges and towards bonus
-  action best_move = rand()%4;
-  int best_score = -999999;
+/*
+  startPlayout function:
+  This function starts a playout from the real state: a new overlay generation makes every cell read
+  from the real map again (the stamps are only cleared when the generation number wraps around).
+*/
+static void startPlayout(GameContext *ctx, Playout *pl){
+  ctx->overlayGeneration++;
+  if (ctx->overlayGeneration == 0){
+    for (int i = 0; i < ctx->paths.cells; i++) ctx->overlayStamp[i] = 0;
+    ctx->overlayGeneration = 1;
+  }
+  startVirtualSnake(&pl->snake, ctx);
+  pl->head = ctx->headPos.y * ctx->mapxsize + ctx->headPos.x;
+  pl->bonus = ctx->bonusFound ? ctx->bonusPos.y * ctx->mapxsize + ctx->bonusPos.x : -1;
+  pl->steps = 0;
+  pl->eatenAt = -1;
+}
 
-  for (int i = 0; i < 4; i++){
-    if (actionValid(moves[i], map, headPos.x, headPos.y)){
-      int newX = headPos.x + dx[i];
-      int newY = headPos.y + dy[i];
+/*
+  overlayCell function:
+  This function reads the grid flags of a cell as the current playout sees them: written by the playout, or else the real grid.
+*/
+static unsigned char overlayCell(const GameContext *ctx, int cell){
+  if (ctx->overlayStamp[cell] == ctx->overlayGeneration) return ctx->overlayCells[cell];
+  return ctx->grid.cells[cell];
+}
 
-      int score = 0;
+/*
+  playoutMoves function:
+  This function returns the moves the engine would accept in the playout's state, as a mask (bit i for action i):
+  an empty path, the bonus, or the tail (which moves away at the same time).
+*/
+static int playoutMoves(const GameContext *ctx, const Playout *pl){
+  int tail = (pl->snake.length > 1) ? virtualTail(&pl->snake) : -1;
+  int mask = 0;
+  for (int i = 0; i < 4; i++){
+    int cell = pl->head + ctx->grid.offsets[i];
+    if (!(overlayCell(ctx, cell) & GRID_OCCUPIED) || cell == tail) mask |= 1 << i;
+  }
+  return mask;
+}
 
-      //Distance to bonus 
-      int distToBonus = abs(newX - bonusPos.x) + abs(newY - bonusPos.y);
-      score -= distToBonus * 10;
+/*
+  playoutStep function:
+  This function plays a move in the playout. Only the freed tail cell and the new head are written to the overlay:
+  the rest of the body is not free either way.
+*/
+static void playoutStep(GameContext *ctx, Playout *pl, int cell){
+  bool grow = (cell == pl->bonus);
+  int freed = advanceVirtualSnake(&pl->snake, cell, grow);
+  if (freed >= 0){
+    ctx->overlayStamp[freed] = ctx->overlayGeneration;
+    ctx->overlayCells[freed] = 0;
+  }
+  ctx->overlayStamp[cell] = ctx->overlayGeneration;
+  ctx->overlayCells[cell] = GRID_OCCUPIED;
+  if (grow){
+    pl->bonus = -1;
+    pl->eatenAt = pl->steps;
+  }
+  pl->head = cell;
+  pl->steps++;
+}
 
-      //Free space
-      int freeNeighbors = countValidMoves(map, newX, newY);
-      score += freeNeighbors * 50;
+/*
+  rolloutMove function:
+  This function chooses the move of a playout outside of the tree (mask of the valid moves, not empty):
+  mostly the one closest to the bonus, otherwise a random one, so that the playouts stay cheap but not blind.
+*/
+static int rolloutMove(GameContext *ctx, const Playout *pl, int valid){
+  int mapxsize = ctx->mapxsize;
+  action a = randomAction(ctx);
 
-      if (score > best_score){
-        best_score = score;
-        best_move = moves[i];
+  if (pl->bonus >= 0 && randomAction(ctx) != NORTH){//3 times out of 4: greedy
+    int best = -1, bestDist = 0;
+    for (int i = 0; i < 4; i++){
+      if (!(valid & (1 << i))) continue;
+      int cell = pl->head + ctx->grid.offsets[i];
+      int dist = abs(ctx->paths.cellX[cell] - pl->bonus % mapxsize) + abs(ctx->paths.cellY[cell] - pl->bonus / mapxsize);
+      if (best < 0 || dist < bestDist){
+        best = i;
+        bestDist = dist;
       }
+    }
+    return best;
+  }
+  while (!(valid & (1 << a))) a = (a + 1) % 4;
+  return a;
+}
+
+/*
+  playoutReward function:
+  This function scores the end of a playout, between 0 and 1:
+    -dead before eating: 0, dead after eating: 0.1 (the bonus is worth little if it kills us),
+    -alive after eating: 0.6 to 1 (the sooner the better),
+    -alive without eating: 0.3 to 0.4 (the closer to the bonus the better).
+*/
+static double playoutReward(const GameContext *ctx, const Playout *pl, bool alive){
+  int mapxsize = ctx->mapxsize;
+  double horizon = ctx->mapxsize + ctx->mapysize;
+
+  if (!alive) return (pl->eatenAt >= 0) ? 0.1 : 0;
+  if (pl->eatenAt >= 0) return 0.6 + 0.4 * (1 - pl->eatenAt / horizon);
+  if (pl->bonus < 0) return 0.35; //No bonus on the map
+  int dist = abs(ctx->paths.cellX[pl->head] - pl->bonus % mapxsize) + abs(ctx->paths.cellY[pl->head] - pl->bonus / mapxsize);
+  return 0.3 + 0.1 * (1 - dist / horizon);
+}
+
+/*
+  zobristKey function:
+  This function returns the Zobrist key of a cell holding a kind of thing (ZOBRIST_*). The key is a hash
+  of the two (splitmix64), so the keys take no memory and are the same in every context.
+*/
+static uint64_t zobristKey(int cell, int kind){
+  uint64_t z = (uint64_t)cell * 8 + (uint64_t)kind + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/*
+  linkDirection function:
+  This function returns the action going from a cell to a neighbor cell.
+*/
+static int linkDirection(const GameContext *ctx, int from, int to){
+  int a = 0;
+  while (a < 3 && from + ctx->grid.offsets[a] != to) a++;
+  return a;
+}
+
+/*
+  snakeHash function:
+  This function computes the Zobrist key of the current state: the head, each other cell of the body with the
+  direction of the next cell toward the head (which gives the order of the cells), the bonus, and the map size.
+  It walks the snake once; the keys of the states searched from there are then updated in O(1) (playoutHash).
+*/
+static uint64_t snakeHash(const GameContext *ctx){
+  int mapxsize = ctx->mapxsize;
+  int toward = ctx->headPos.y * mapxsize + ctx->headPos.x;
+  uint64_t hash = zobristKey(toward, ZOBRIST_HEAD) ^ zobristKey(ctx->paths.cells, ZOBRIST_BONUS + 1);
+  for (int i = 1; i < ctx->length; i++){
+    Position p = ctx->body[(ctx->first + i) % ctx->capacity];
+    int cell = p.y * mapxsize + p.x;
+    hash ^= zobristKey(cell, ZOBRIST_LINK + linkDirection(ctx, cell, toward));
+    toward = cell;
+  }
+  if (ctx->bonusFound) hash ^= zobristKey(ctx->bonusPos.y * mapxsize + ctx->bonusPos.x, ZOBRIST_BONUS);
+  return hash;
+}
+
+/*
+  playoutHash function:
+  This function returns the Zobrist key of the playout's state after its head moves to a cell, from the key before:
+  the head moves, the old head becomes a link toward it, and the tail's link goes away unless the bonus is eaten
+  (then the bonus goes away: the next one can't be known).
+*/
+static uint64_t playoutHash(const GameContext *ctx, const Playout *pl, uint64_t hash, int cell){
+  hash ^= zobristKey(pl->head, ZOBRIST_HEAD) ^ zobristKey(cell, ZOBRIST_HEAD)
+          ^ zobristKey(pl->head, ZOBRIST_LINK + linkDirection(ctx, pl->head, cell));
+  if (cell == pl->bonus) return hash ^ zobristKey(cell, ZOBRIST_BONUS);
+  int tail = virtualTail(&pl->snake);
+  int next = (pl->snake.length > 1) ? virtualTailNext(&pl->snake) : cell; //(a single cell: the link added above)
+  return hash ^ zobristKey(tail, ZOBRIST_LINK + linkDirection(ctx, tail, next));
+}
 
+/*
+  loadWord and storeWord functions:
+  These functions read and write a word of a transposition table that other threads may be using: atomically
+  (relaxed, nothing else is ordered by them) with GCC and clang, otherwise as volatile words.
+*/
+static uint64_t loadWord(const uint64_t *word){
+#if defined(__GNUC__)
+  return __atomic_load_n(word, __ATOMIC_RELAXED);
+#else
+  return *(const volatile uint64_t *)word;
+#endif
+}
+
+static void storeWord(uint64_t *word, uint64_t value){
+#if defined(__GNUC__)
+  __atomic_store_n(word, value, __ATOMIC_RELAXED);
+#else
+  *(volatile uint64_t *)word = value;
+#endif
+}
+
+/*
+  probeTable function:
+  This function looks for a state in a transposition table, and gives its packed statistics (see TranspositionEntry).
+*/
+static bool probeTable(const TranspositionTable *table, uint64_t key, uint64_t *data){
+  const TranspositionEntry *bucket = &table->entries[key & table->mask & ~(size_t)1];
+  for (int i = 0; i < 2; i++){
+    uint64_t d = loadWord(&bucket[i].data);
+    if (d != 0 && (loadWord(&bucket[i].check) ^ d) == key){
+      *data = d;
+      return true;
     }
   }
+  return false;
+}
 
-  return best_move;
+/*
+  storeTable function:
+  This function writes the statistics of a state in its bucket: over its own entry if it is there, otherwise
+  in the first entry if it has fewer visits or is from an older search (the entry it held moves to the second one),
+  otherwise in the second entry. The data is written before the check, so a reader never trusts half an entry.
+*/
+static void storeTable(TranspositionTable *table, uint64_t key, uint64_t data){
+  TranspositionEntry *bucket = &table->entries[key & table->mask & ~(size_t)1];
+  int slot = -1;
+  for (int i = 0; i < 2 && slot < 0; i++){
+    if ((loadWord(&bucket[i].check) ^ loadWord(&bucket[i].data)) == key) slot = i;
+  }
+  if (slot < 0){
+    uint64_t first = loadWord(&bucket[0].data);
+    slot = 1;
+    if ((first >> 56) != (data >> 56) || (first & 0xFFFFFFFF) <= (data & 0xFFFFFFFF)){
+      slot = 0;
+      storeWord(&bucket[1].data, first);
+      storeWord(&bucket[1].check, loadWord(&bucket[0].check));
+    }
+  }
+  storeWord(&bucket[slot].data, data);
+  storeWord(&bucket[slot].check, key ^ data);
 }
 
 /*
-  aggressiveStrategy function:
-  This function returns the action to move towards the bonus, in an aggressive way,
-  meaning it doesn't take into account getting trapped, only checks if the move is valid.
-  (The same as the code snippet in the followTailStrategy and zigzagStrategy)
+  searchTable function:
+  This function returns the transposition table of the context's searches (NULL: none, or no memory).
 */
-static action aggressiveStrategy(char **map, int mapysize, int mapxsize, Position headPos, Position bonusPos){
-  //Same coding logic to go through possible moves
-  action moves[4] = {NORTH, EAST, SOUTH, WEST};
-  int dx[4] = {0, 1, 0, -1};
-  int dy[4] = {-1, 0, 1, 0};
+static TranspositionTable *searchTable(GameContext *ctx){
+  MctsSearch *m = &ctx->mcts;
+  if (m->table != NULL) return m->table;
+  if (!m->tableEnabled) return NULL;
+  if (m->ownTable == NULL) m->ownTable = newTranspositionTable(TRANSPOSITION_ENTRIES);
+  return m->ownTable;
+}
 
-  action best_move = rand()%4;
-  int best_score = -999999; 
+/*
+  newNode function:
+  This function sets up a node of the search tree for a state, with the statistics the table has for it
+  (its playouts of earlier searches, and its best move, tried first). It returns the visits found.
+*/
+static int newNode(MctsSearch *m, const TranspositionTable *table, int node, int parent, uint64_t hash){
+  MctsNode *n = &m->nodes[node];
+  uint64_t data;
+  n->parent = parent;
+  for (int i = 0; i < 4; i++) n->children[i] = -1;
+  n->hash = hash;
+  n->visits = 0;
+  n->value = 0;
+  n->hint = -1;
+  if (table != NULL && probeTable(table, hash, &data)){
+    long visits = (long)(data & 0xFFFFFFFF);
+    n->visits = (int)(visits < MCTS_MAX_SEEDED ? visits : MCTS_MAX_SEEDED);
+    n->value = n->visits * (double)((data >> 32) & 0xFFFF) / 65535;
+    n->hint = (int)((data >> 48) & 7) - 1;
+  }
+  return n->visits;
+}
 
-  for (int i = 0; i < 4; i++){
-    if (!actionValid(moves[i], map, headPos.x, headPos.y)){
-      continue;
+/*
+  saveTree function:
+  This function writes the statistics of the nodes of the tree searched (those with 2 playouts or more)
+  in the transposition table: playouts, mean reward, and most visited move.
+*/
+static void saveTree(const MctsSearch *m, TranspositionTable *table){
+  for (int i = 0; i < m->used; i++){
+    const MctsNode *n = &m->nodes[i];
+    if (n->visits < 2) continue;
+    int best = n->hint, bestVisits = 0;
+    for (int k = 0; k < 4; k++){
+      int child = n->children[k];
+      if (child >= 0 && m->nodes[child].visits > bestVisits){
+        bestVisits = m->nodes[child].visits;
+        best = k;
+      }
     }
+    uint64_t mean = (uint64_t)(n->value / n->visits * 65535 + 0.5);
+    if (mean > 0xFFFF) mean = 0xFFFF;
+    uint64_t data = (uint64_t)n->visits | mean << 32 | (uint64_t)(best + 1) << 48 | (uint64_t)(m->age & 0xFF) << 56;
+    storeTable(table, n->hash, data);
+  }
+}
 
-    int newX = headPos.x + dx[i];
-    int newY = headPos.y + dy[i];
+/*
+  mctsStrategy function:
+  This function runs a Monte Carlo tree search (UCT) from the current state until the budget of the move is spent
+  (time or number of playouts), then plays the most visited move. Each playout goes down the tree, adds one node,
+  then plays greedy/random moves up to mapxsize+mapysize moves in all, so each playout has a bounded cost and
+  the deadline is checked between two playouts.
+  Nodes are keyed by the Zobrist key of their state: a new node starts from the statistics the transposition table
+  has for its state (reached by another order of moves, or searched for an earlier move), and the nodes visited
+  enough are stored back after the search.
+*/
+static action mctsStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, GameContext *ctx, action last_action){
+  MctsSearch *m = &ctx->mcts;
+  action moves[4] = {NORTH, EAST, SOUTH, WEST};
+  const int *offsets = ctx->grid.offsets;
+  int horizon = mapxsize + mapysize;
+  double start = monotonicSeconds();
+  double deadline = start + m->budget * 1e-6;
 
-    int score = 0;
+  if (m->nodes == NULL) m->nodes = malloc(MCTS_NODES * sizeof(MctsNode));
+  if (m->nodes == NULL || ctx->overlayStamp == NULL){
+    return smartStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+  }
 
-    //More aggressive towards bonus (coefficient 200)
-    int distToBonus = abs(newX - bonusPos.x) + abs(newY - bonusPos.y);
-    score -= distToBonus * 200;
+  //No choice to make: no search
+  Playout pl;
+  startPlayout(ctx, &pl);
+  int rootMoves = playoutMoves(ctx, &pl);
+  if (rootMoves == 0 || (rootMoves & (rootMoves - 1)) == 0){
+    if (rootMoves == 0) return smartStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, ctx, last_action);
+    notePick(ctx, PICK_MCTS);
+    for (int i = 0; i < 4; i++) if (rootMoves == 1 << i) return moves[i];
+  }
 
-    //Add a bit of safety to not make it too risky by taking moves with better escape possibilities
-    int freeNeighbors = countValidMoves(map, newX, newY);
-    score += freeNeighbors * 30;
+  //Root: its statistics from the searches of the previous moves, if it was searched then
+  TranspositionTable *table = searchTable(ctx);
+  m->age++;
+  m->used = 1;
+  int reused = newNode(m, table, 0, -1, (table != NULL) ? snakeHash(ctx) : 0);
 
-    if (score > best_score){
-      best_score = score; 
-      best_move = moves[i];
+  long playouts = 0;
+  int depth = 0;
+  do {
+    startPlayout(ctx, &pl);
+    int node = 0;
+    bool alive = true;
+
+    //Down the tree: expand the first move not tried yet, or follow the best child (UCT)
+    while (pl.steps < horizon){
+      int valid = playoutMoves(ctx, &pl);
+      if (valid == 0){
+        alive = false;
+        break;
+      }
+      MctsNode *n = &m->nodes[node];
+      int untried = -1;
+      if (n->hint >= 0 && (valid & (1 << n->hint)) && n->children[n->hint] < 0) untried = n->hint; //Best move in the table first
+      for (int i = 0; i < 4 && untried < 0; i++) if ((valid & (1 << i)) && n->children[i] < 0) untried = i;
+      if (untried >= 0){
+        if (m->used == MCTS_NODES) break; //Tree full: play out from here
+        int cell = pl.head + offsets[untried];
+        int child = m->used++;
+        newNode(m, table, child, node, (table != NULL) ? playoutHash(ctx, &pl, n->hash, cell) : 0);
+        n->children[untried] = child;
+        playoutStep(ctx, &pl, cell);
+        node = child;
+        if (pl.steps > depth) depth = pl.steps;
+        break;
+      }
+      int best = -1;
+      double bestUct = -1;
+      double logVisits = approximateLog(n->visits);
+      for (int i = 0; i < 4; i++){
+        if (n->children[i] < 0) continue;
+        const MctsNode *c = &m->nodes[n->children[i]];
+        double uct = c->value / c->visits + MCTS_EXPLORATION * approximateSqrt(logVisits / c->visits);
+        if (uct > bestUct){
+          bestUct = uct;
+          best = i;
+        }
+      }
+      playoutStep(ctx, &pl, pl.head + offsets[best]);
+      node = n->children[best];
+    }
+
+    //Out of the tree: cheap moves up to the horizon
+    while (alive && pl.steps < horizon){
+      int valid = playoutMoves(ctx, &pl);
+      if (valid == 0){
+        alive = false;
+        break;
+      }
+      playoutStep(ctx, &pl, pl.head + offsets[rolloutMove(ctx, &pl, valid)]);
+    }
+
+    //Back up the reward to the root
+    double reward = playoutReward(ctx, &pl, alive);
+    for (int n = node; n >= 0; n = m->nodes[n].parent){
+      m->nodes[n].visits++;
+      m->nodes[n].value += reward;
     }
+    playouts++;
+  } while ((m->maxPlayouts == 0 || playouts < m->maxPlayouts) && (m->budget == 0 || monotonicSeconds() < deadline));
 
+  //Most visited move
+  action a = moves[0];
+  int bestVisits = -1;
+  for (int i = 0; i < 4; i++){
+    int child = m->nodes[0].children[i];
+    if (child >= 0 && m->nodes[child].visits > bestVisits){
+      bestVisits = m->nodes[child].visits;
+      a = moves[i];
+    }
   }
 
-  return best_move;
+  if (table != NULL) saveTree(m, table);
+
+  double elapsed = monotonicSeconds() - start;
+  m->stats.moves++;
+  m->stats.playouts += playouts;
+  m->stats.depth += depth;
+  m->stats.reused += reused;
+  m->stats.seconds += elapsed;
+  if (elapsed > m->stats.maxSeconds) m->stats.maxSeconds = elapsed;
+  notePick(ctx, PICK_MCTS);
+  if (DEBUG){
+    printf("MCTS: %ld playouts (%d from the table), %d nodes, depth %d in %.3f ms\n", playouts, reused, m->used, depth, elapsed * 1e3);
+  }
+  return a;
 }
 
 /*
-  smartStrategy function:
-  This function chooses which strategy to go with, between follow tail, zigzag and aggressive based on the situation
-  We choose the aggressive strategy if:
-    -The snake is too small (length under 5)
-    -The snake's head is very close to the bonus (5 cells)
-  We choose the zigzag strategy if:
-    -The snake is very large (fills up 60% of the map at least)
-    -The bonus is very far away in comparison to the tail (over 1,5 x distance to the tail)
-  We choose the follow tail strategy if:
-    None of the cases before apply to the snake, so we use the default strategy
-    and either go for the bonus or the tail to not get trapped
+  monotonicNanoseconds function:
+  This function returns a monotonic time in nanoseconds (for the instrumentation).
 */
-static action smartStrategy(char **map, int mapxsize, int mapysize, Position headPos, Position tailPos, Position bonusPos, snake_list s, action last_action){
-  int snakeLength = getSnakeLength(s);
-  // int mapSize = (mapxsize + mapysize) / 2; (will be used to optimize the hardcoded 5)
+static long long monotonicNanoseconds(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
 
-  //Calculate distances
-  int distHeadToBonus = abs(headPos.x - bonusPos.x) + abs(headPos.y - bonusPos.y);
-  int distHeadToTail = abs(headPos.x - tailPos.x) + abs(headPos.y - tailPos.y);
+/*
+  notePick function:
+  This function counts the decision that chose the move, when the instrumentation is on.
+*/
+static void notePick(GameContext *ctx, pick p){
+  if (ctx->moveStats.enabled) ctx->moveStats.game.picks[p]++;
+  if (ctx->flight.current != NULL) ctx->flight.current->pick = (uint8_t)p;
+}
 
-  //Snake is small (length <= 5) => aggressive
-  if (snakeLength <= 15){
-    return aggressiveStrategy(map, mapysize, mapxsize, headPos, bonusPos);
+/*
+  noteLatency function:
+  This function counts a move and its latency in its log-linear bucket:
+  under 4 ns one bucket per nanosecond, then the highest bit and the two bits after it give the bucket.
+*/
+static void noteLatency(MoveStats *stats, long long ns){
+  int bucket;
+  if (ns < 4){
+    bucket = (ns < 0) ? 0 : (int)ns;
+  } else {
+    int msb = 63 - __builtin_clzll((unsigned long long)ns);
+    bucket = 4 * (msb - 1) + (int)((ns >> (msb - 2)) & 3);
+    if (bucket >= MOVE_STATS_BUCKETS) bucket = MOVE_STATS_BUCKETS - 1;
   }
+  stats->calls++;
+  stats->latency[bucket]++;
+  if (ns > stats->maxLatency) stats->maxLatency = ns;
+}
 
-  //Snake's head is close to the bonus (under 5 cells) => aggressive
-  if (distHeadToBonus <= 5){
-    return aggressiveStrategy(map, mapysize, mapxsize, headPos, bonusPos);
+/*
+  endGameStats function:
+  This function closes the counters of a game: its summary is printed if asked, then they go to the totals.
+*/
+static void endGameStats(GameContext *ctx){
+  Instrumentation *ins = &ctx->moveStats;
+  if (ins->game.calls == 0) return;
+  if (ins->print) printMoveStats(stderr, "Game stats", &ins->game);
+  mergeMoveStats(&ins->total, &ins->game);
+  memset(&ins->game, 0, sizeof(ins->game));
+}
+
+/*
+  printLastGameStats function:
+  This function prints the summary of the last game played through snake(), at exit.
+*/
+static void printLastGameStats(void){
+  dropPonder(&gameContext); //(the move pondered after the last one is never played)
+  endGameStats(&gameContext);
+}
+
+/*
+  storeSequence function:
+  This function writes the sequence of a flight record: the other fields of the slot are written after it is cleared
+  and before it is set, for a signal handler on the same thread (the fences keep the compiler from moving them)
+  as for a reader on another thread (release).
+*/
+static void storeSequence(uint32_t *sequence, uint32_t value){
+#if defined(__GNUC__)
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  __atomic_store_n(sequence, value, __ATOMIC_RELEASE);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+#else
+  *(volatile uint32_t *)sequence = value;
+#endif
+}
+
+/*
+  beginFlight function:
+  This function starts the flight record of the decision about to be made, in the oldest slot of the ring.
+  The strategies then note their pick and scores in it, and recordFlight completes it with the move.
+*/
+static void beginFlight(GameContext *ctx){
+  FlightRecorder *f = &ctx->flight;
+  FlightRecord *r = &f->records[f->decisions & (FLIGHT_RECORDS - 1)];
+  storeSequence(&r->sequence, 0);
+  r->pick = FLIGHT_NO_PICK;
+  r->flags = 0;
+  f->current = r;
+  f->state = f->decisions + 1;
+}
+
+/*
+  recordScores function:
+  This function copies the scores of the 4 moves into the flight record (the last strategy scoring them is the one
+  whose move is played).
+*/
+static void recordScores(GameContext *ctx, const MoveScores *scores){
+  FlightRecord *r = ctx->flight.current;
+  if (r == NULL) return;
+  for (int i = 0; i < 4; i++) r->scores[i] = scores->valid[i] ? (float)moveScore(scores, i) : -1e30f;
+  r->flags |= FLIGHT_SCORED;
+}
+
+/*
+  recordFlight function:
+  This function completes the flight record of a decision with the state it was made in and the move chosen.
+*/
+static void recordFlight(GameContext *ctx, action a, bool pondered){
+  FlightRecorder *f = &ctx->flight;
+  FlightRecord *r = f->current;
+  if (r == NULL) return;
+  int mapxsize = ctx->mapxsize;
+  r->head = ctx->headPos.y * mapxsize + ctx->headPos.x;
+  r->tail = ctx->tailPos.y * mapxsize + ctx->tailPos.x;
+  r->bonus = ctx->bonusFound ? ctx->bonusPos.y * mapxsize + ctx->bonusPos.x : -1;
+  r->length = ctx->length;
+  r->action = (uint8_t)a;
+  r->strategy = (uint8_t)ctx->strategy;
+  if (pondered) r->flags |= FLIGHT_PONDERED;
+  f->decisions++;
+  storeSequence(&r->sequence, f->decisions);
+  f->current = NULL;
+}
+
+/*
+  writeAll function:
+  This function writes a whole buffer to a file descriptor (write may write less, or be interrupted).
+*/
+static bool writeAll(int fd, const void *buffer, size_t size){
+  const char *bytes = buffer;
+  while (size > 0){
+    ssize_t n = write(fd, bytes, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    bytes += n;
+    size -= (size_t)n;
   }
+  return true;
+}
 
-  //Snake is big (fills up 60% of the map at least) => zigzag (can be brought down to minimize snake chasing tail)
-  int totalCells = (mapxsize - 2) * (mapysize - 2); //No walls
-  if (snakeLength > totalCells * 0.6){
-    return zigzagStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, last_action);
+/*
+  dumpFlightRecorder function:
+  This function writes the flight recorder of a context to a file (see player_api.h). It only calls functions that are
+  safe in a signal handler (open, write, close) and allocates nothing, so a crash can still be dumped.
+  It returns false if the context has played no game, or if the file can't be written.
+*/
+bool dumpFlightRecorder(const GameContext *ctx, const char *filename){
+  const FlightRecorder *f = &ctx->flight;
+  if (f->walls == NULL || ctx->body == NULL) return false;
+
+  FlightHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "SNAKEFLT", sizeof(header.magic));
+  header.version = FLIGHT_VERSION;
+  header.byteOrder = 0x01020304u;
+  header.mapxsize = ctx->mapxsize;
+  header.mapysize = ctx->mapysize;
+  header.length = ctx->length;
+  header.decision = f->state;
+  header.records = FLIGHT_RECORDS;
+
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok = writeAll(fd, &header, sizeof(header)) && writeAll(fd, f->walls, (size_t)ctx->mapxsize * ctx->mapysize);
+  int32_t cells[256]; //The snake goes out by chunks of cells (nothing can be allocated here)
+  int n = 0;
+  for (int i = 0; ok && i < ctx->length; i++){
+    Position p = ctx->body[(ctx->first + i) % ctx->capacity];
+    cells[n++] = p.y * ctx->mapxsize + p.x;
+    if (n == 256 || i == ctx->length - 1){
+      ok = writeAll(fd, cells, n * sizeof(int32_t));
+      n = 0;
+    }
   }
+  ok = ok && writeAll(fd, f->records, sizeof(f->records));
+  return close(fd) == 0 && ok;
+}
 
-  //Snake's head is too far away from the bonus (> 1,5x distance to tail) => zigzag
-  //This prevents the snake from chasing his tail in circles when the bonus is far
-  if (distHeadToBonus > distHeadToTail * 1.5 && snakeLength > 15){
-    return zigzagStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, last_action);
+/*
+  armFlightDump function:
+  This function sets up the dumps of snake()'s flight recorder: at exit (the end of the game, as the engine doesn't
+  tell it) and on a fatal signal, to the file named by SNAKE_FLIGHT (snake.flight by default, off: no dump).
+  A signal that already has a handler is left to it.
+*/
+static void armFlightDump(void){
+  const char *path = getenv("SNAKE_FLIGHT");
+  if (path == NULL) path = "snake.flight";
+  if (strcmp(path, "off") == 0 || strlen(path) >= sizeof(flightPath)) return;
+  strcpy(flightPath, path);
+  atexit(dumpLastFlight);
+
+  int fatal[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = flightSignal;
+  action.sa_flags = SA_RESETHAND; //The handler runs once, then the signal does what it would have done
+  sigemptyset(&action.sa_mask);
+  for (size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++){
+    struct sigaction old;
+    if (sigaction(fatal[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL) sigaction(fatal[i], &action, NULL);
   }
+}
+
+/*
+  dumpLastFlight function:
+  This function dumps snake()'s flight recorder at exit.
+*/
+static void dumpLastFlight(void){
+  dropPonder(&gameContext); //(the move pondered after the last one is never played)
+  dumpFlightRecorder(&gameContext, flightPath);
+}
 
-  //None of the cases above fit for the current situation => default, follow tail strategy
-  followTailStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, s); //to get no warnings saying followTailStrategy not used
-  return zigzagStrategy(map, mapxsize, mapysize, headPos, tailPos, bonusPos, last_action);
-}
\ No newline at end of file
+/*
+  flightSignal function:
+  This function dumps snake()'s flight recorder when the program crashes, then lets the signal kill it.
+*/
+static void flightSignal(int sig){
+  dumpFlightRecorder(&gameContext, flightPath);
+  raise(sig);
+}
@@ -0,0 +1,165 @@
+#ifndef PLAYER_API_H
+#define PLAYER_API_H
+
+#include <stdbool.h> // bool
+#include <stdint.h> // int32_t, uint32_t
+#include <stdio.h> // FILE, size_t
+
+#include "snake_def.h" // action, snake_list
+
+/*
+  Reentrant interface of the AI of player.c.
+  snake() plays with a single context hidden in player.c; these functions let a program own as many contexts
+  as it wants (e.g. one per thread), each with its own buffers, level cache and random generator.
+  A context must only be used by one thread at a time.
+*/
+typedef struct GameContext GameContext;
+
+/*
+  Transposition table of the MCTS strategy: the statistics of the states searched, by Zobrist key of the state
+  (head, body cells in order and bonus). Each context has its own, cleared at each game; a table made with
+  newTranspositionTable can instead be shared by contexts searching the same game, even from several threads
+  (the table has no lock: a torn entry is detected and ignored). It must outlive the contexts using it.
+*/
+typedef struct TranspositionTable TranspositionTable;
+
+/*
+  StrategyParams struct, the thresholds and scoring weights of the smart strategy and of the strategies it picks from.
+  The defaults are the values the strategies were written with. Sets tuned per map size can be saved in a file
+  (one line per map size, see writeStrategyParams) and loaded by the player with SNAKE_PARAMS=file.
+*/
+typedef struct {
+  double aggressiveLength; // smart: snakes up to this length play aggressive (15)
+  double bonusRadius; // smart: a bonus this close (Manhattan distance) is taken aggressively (5)
+  double fillRatio; // smart: zigzag once the snake fills this part of the map (0.6)
+  double distanceRatio; // smart: zigzag when the bonus is this many times further than the tail (1.5)
+  double zigzagBonusWeight; // zigzag: weight of the distance to the bonus (10)
+  double zigzagSpaceWeight; // zigzag: weight of the free neighbors (50)
+  double aggressiveBonusWeight; // aggressive: weight of the distance to the bonus (200)
+  double aggressiveSpaceWeight; // aggressive: weight of the free neighbors (30)
+  double trapWeight; // zigzag and aggressive: penalty per cell missing for the snake to fit where a move leads (1000, 0: not checked)
+} StrategyParams;
+
+/*
+  MctsStats struct, totals of the moves played by the MCTS strategy with a context
+*/
+typedef struct {
+  long moves; // moves searched
+  long playouts; // playouts run
+  double seconds; // time spent searching
+  double maxSeconds; // longest search of a move
+  long depth; // sum over the searches of the depth of the tree
+  long reused; // playouts of earlier searches found in the transposition table for the roots
+} MctsStats;
+
+/*
+  MoveStats struct, what the instrumentation of a context counted (SNAKE_STATS=on, or enableMoveStats).
+  Latencies are counted in log-linear buckets of nanoseconds: 4 buckets per power of 2, so a percentile read
+  from the histogram is within 19% of the real value. Nothing is allocated and nothing is printed while playing.
+*/
+#define MOVE_STATS_BUCKETS 160 // latency buckets (4 per power of 2, up to 2^40 ns)
+#define MOVE_STATS_PICKS 10 // decisions counted in picks (see moveStatsPickName)
+
+typedef struct {
+  long calls; // moves decided
+  long latency[MOVE_STATS_BUCKETS]; // moves per latency bucket
+  long maxLatency; // slowest move, in nanoseconds
+  long picks[MOVE_STATS_PICKS]; // moves per decision (which strategy chose the move)
+  long validChecks; // calls of actionValid
+  long neighborCounts; // calls of countValidMoves
+  long regionCells; // cells visited by the region analysis
+  long ponderHits; // moves decided ahead by the pondering worker (SNAKE_PONDER=on)
+  long ponderMisses; // moves it mispredicted (decided again)
+} MoveStats;
+
+/*
+  Flight recorder: every context keeps its last FLIGHT_RECORDS decisions in a ring, always (a decision costs a few stores),
+  to see after the fact how a game was lost without running it with DEBUG. dumpFlightRecorder writes them to a file
+  with the level and the snake of the last decision; snake()'s context is dumped at exit and on a fatal signal
+  (to the file named by SNAKE_FLIGHT, snake.flight by default, off: never). flight.c renders a dump as map frames.
+  A dump is a FlightHeader, the level (mapxsize * mapysize chars, row by row), the snake (length cells from the head,
+  y * mapxsize + x), then the FLIGHT_RECORDS slots of the ring as they are in memory (sort them by sequence).
+*/
+#define FLIGHT_RECORDS 256 // decisions kept by a context (a power of 2)
+#define FLIGHT_VERSION 1 // version of the dumps
+#define FLIGHT_NO_PICK 255 // pick of a decision no strategy counted (see moveStatsPickName)
+#define FLIGHT_SCORED 1 // flag of a decision made by scoring the moves (scores holds them)
+#define FLIGHT_PONDERED 2 // flag of a decision made ahead by the pondering worker
+
+typedef struct {
+  char magic[8]; // "SNAKEFLT"
+  uint32_t version; // FLIGHT_VERSION
+  uint32_t byteOrder; // 0x01020304 written as a native integer
+  int32_t mapxsize; // size of the level
+  int32_t mapysize;
+  int32_t length; // snake length (cells of the snake that follow the level)
+  uint32_t decision; // decision whose state the snake is (the last one recorded, or the one being made)
+  uint32_t records; // slots that follow the snake (FLIGHT_RECORDS)
+} FlightHeader;
+
+typedef struct {
+  uint32_t sequence; // number of the decision in the game, from 1 (0: empty, or being written when dumped)
+  int32_t head; // cells (y * mapxsize + x) of the head, the tail and the bonus (-1: none) when deciding
+  int32_t tail;
+  int32_t bonus;
+  int32_t length; // snake length
+  float scores[4]; // score of each move, NORTH to WEST, with FLIGHT_SCORED (invalid moves: -1e30)
+  uint8_t action; // move chosen
+  uint8_t pick; // decision that chose it (see moveStatsPickName), FLIGHT_NO_PICK if none was counted
+  uint8_t flags; // FLIGHT_SCORED, FLIGHT_PONDERED
+  uint8_t strategy; // strategy of the game: 0 smart, 1 hamilton, 2 mcts
+} FlightRecord;
+
+/*
+  MoveBatch struct, many games whose moves are decided together by playerMoves, as one array per argument of
+  playerMove (entry g of each array is game g). Each game has its own context, and gets the move playerMove would
+  give it: the decisions that come down to scoring the 4 moves are scored for all the games at once, with vectors.
+  A batch is made once with newMoveBatch, then the caller fills count entries before each call.
+*/
+typedef struct BatchScores BatchScores; // scratch of playerMoves
+
+typedef struct {
+  int capacity; // entries of the arrays
+  int count; // games to decide in the next call (at most capacity)
+  GameContext **contexts; // context of each game (a context can't be twice in a batch)
+  char ***maps; // arguments of playerMove for each game
+  int *mapxsizes;
+  int *mapysizes;
+  snake_list *snakes;
+  action *lastActions;
+  action *actions; // moves chosen by playerMoves
+  BatchScores *scores; // scratch of playerMoves
+} MoveBatch;
+
+GameContext *newGameContext(unsigned long long seed);
+void freeGameContext(GameContext *ctx);
+void seedGameContext(GameContext *ctx, unsigned long long seed);
+unsigned long long getRandomState(GameContext *ctx);
+bool chooseStrategy(GameContext *ctx, const char *name);
+void setMctsBudget(GameContext *ctx, long microseconds, long playouts);
+void getMctsStats(GameContext *ctx, MctsStats *stats);
+int headPathToBonus(GameContext *ctx, char **map, action *firstMove);
+int headPathToTail(GameContext *ctx, char **map, action *firstMove);
+TranspositionTable *newTranspositionTable(size_t entries);
+void freeTranspositionTable(TranspositionTable *table);
+void shareTranspositionTable(GameContext *ctx, TranspositionTable *table);
+void enableMoveStats(GameContext *ctx, bool enabled);
+void getMoveStats(GameContext *ctx, MoveStats *stats);
+void mergeMoveStats(MoveStats *into, const MoveStats *from);
+const char *moveStatsPickName(int pick);
+void printMoveStats(FILE *file, const char *title, const MoveStats *stats);
+void defaultStrategyParams(StrategyParams *params);
+void setStrategyParams(GameContext *ctx, const StrategyParams *params);
+int strategyParamCount(void);
+const char *strategyParamName(int i);
+double *strategyParam(StrategyParams *params, int i);
+bool readStrategyParams(const char *filename, int mapxsize, int mapysize, StrategyParams *params);
+void writeStrategyParams(FILE *file, int mapxsize, int mapysize, const StrategyParams *params);
+bool compileLevel(char **map, int mapxsize, int mapysize, const char *directory, char *path, size_t pathSize);
+bool dumpFlightRecorder(const GameContext *ctx, const char *filename);
+action playerMove(GameContext *ctx, char **map, int mapxsize, int mapysize, snake_list s, action last_action);
+MoveBatch *newMoveBatch(int capacity);
+void freeMoveBatch(MoveBatch *batch);
+void playerMoves(MoveBatch *batch);
+
+#endif
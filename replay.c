@@ -0,0 +1,243 @@
+/*
+  Replayer of the recordings written by the simulator (simulator -record file, see snake_replay.h).
+  It lists the games of a recording, rebuilds the map and the snake of any move of a game from the keyframe
+  before it, re-runs the AI from that keyframe to reproduce a decision, or replays every game to check it.
+
+  Build:
+    gcc -std=c99 -Wall -O2 -o replay replay.c snake_sim.c snake_replay.c player.c
+  Usage:
+    ./replay [-game integer] [-move integer] [-decide on/off] [-verify on/off] recording level_file...
+  The level files are matched with the records by their content. Without -game, the games are listed;
+  -game n -move m prints the map of game n after m moves (the end of the game by default) and the action
+  played then; -decide on also asks the AI for that action, starting from the keyframe before the move
+  (the strategy comes from the same environment variables as when recording, e.g. SNAKE_STRATEGY).
+  -verify on replays every game to its end, checks it against its record, and reports the replay speed.
+*/
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t
+#include <stdio.h> // printf
+#include <stdlib.h> // calloc, free, strtol
+#include <string.h> // strcmp
+#include <time.h> // clock_gettime
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "player_api.h"
+#include "snake_sim.h"
+#include "snake_replay.h"
+
+/*
+  Settings of a run, read from the command line
+*/
+typedef struct {
+  long game; // game to show (-1: list the games)
+  long move; // move to show (-1: the end of the game)
+  bool decide; // whether the AI is asked for the action of the move
+  bool verify; // whether every game is replayed and checked
+} settings;
+
+/*
+  replay_level struct, a level file and a game on it to replay the records of that level
+*/
+typedef struct {
+  sim_level level; // the level
+  uint64_t signature; // its signature
+  sim_game game; // game used for the replays
+} replay_level;
+
+// prototypes of the local/private functions
+static bool read_parameters(int, char **, settings *, int *);
+static double now(void);
+static replay_level *find_level(replay_level *, int, const replay_game *);
+static bool verify_game(const replay_game *, sim_game *);
+static void show_move(const replay_game *, sim_game *, long, bool);
+
+static const char *actionNames[4] = {"NORTH", "EAST", "SOUTH", "WEST"};
+
+int main(int argc, char **argv){
+  settings set;
+  int first;
+
+  if (!read_parameters(argc, argv, &set, &first)){
+    printf("Usage: replay [-game integer] [-move integer] [-decide on/off] [-verify on/off] recording level_file...\n");
+    return 1;
+  }
+
+  replay_reader reader;
+  if (!replay_reader_open(&reader, argv[first])){
+    printf("Error: %s is not a recording\n", argv[first]);
+    return 1;
+  }
+  int nlevels = argc - first - 1;
+  replay_level *levels = calloc(nlevels > 0 ? nlevels : 1, sizeof(replay_level));
+  if (levels == NULL) return 1;
+  for (int i = 0; i < nlevels; i++){
+    if (!sim_level_read(&levels[i].level, argv[first + 1 + i])) return 1;
+    if (!sim_game_init(&levels[i].game, &levels[i].level, 0)) return 1;
+    levels[i].signature = replay_level_signature(&levels[i].level);
+  }
+
+  replay_game rg;
+  long games = 0, moves = 0, failed = 0, missing = 0;
+  double start = now();
+  while (replay_reader_next(&reader, &rg)){
+    long g = games++;
+    moves += rg.moves;
+    if (set.game >= 0 && g != set.game) continue;
+
+    replay_level *rl = find_level(levels, nlevels, &rg);
+    if (set.game < 0 && !set.verify){
+      printf("%6ld %s seed %llu: %s after %ld moves, score %ld, length %ld\n", g, rg.level, (unsigned long long)rg.seed,
+             sim_status_name(rg.status), rg.moves, rg.score, rg.length);
+    } else if (rl == NULL){
+      if (set.game >= 0) printf("Game %ld: no level file matches %s\n", g, rg.level);
+      missing++;
+    } else if (set.verify){
+      if (!verify_game(&rg, &rl->game)){
+        printf("Game %ld (%s seed %llu): the replay does not match the record\n", g, rg.level, (unsigned long long)rg.seed);
+        failed++;
+      }
+    } else {
+      show_move(&rg, &rl->game, set.move < 0 ? rg.moves : set.move, set.decide);
+    }
+  }
+  double elapsed = now() - start;
+
+  if (set.verify){
+    printf("%ld games, %ld moves replayed in %.3f s (%.0f moves/s): %ld failed, %ld without level file\n",
+           games, moves, elapsed, moves / elapsed, failed, missing);
+  } else if (set.game < 0){
+    printf("%ld games, %ld moves, %zu bytes (%.2f bytes/move)\n", games, moves, reader.size,
+           (double)reader.size / (moves > 0 ? moves : 1));
+  } else if (set.game >= games){
+    printf("The recording has %ld games\n", games);
+  }
+
+  for (int i = 0; i < nlevels; i++){
+    sim_game_free(&levels[i].game);
+    sim_level_free(&levels[i].level);
+  }
+  free(levels);
+  replay_reader_close(&reader);
+  return failed > 0;
+}
+
+/*
+  read_parameters function:
+  This function reads the options, the remaining arguments are the recording and the level files.
+*/
+static bool read_parameters(int argc, char **argv, settings *set, int *first){
+  set->game = -1;
+  set->move = -1;
+  set->decide = false;
+  set->verify = false;
+
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-game") == 0) set->game = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-move") == 0) set->move = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-decide") == 0) set->decide = (strcmp(argv[i + 1], "on") == 0);
+    else if (strcmp(argv[i], "-verify") == 0) set->verify = (strcmp(argv[i + 1], "on") == 0);
+    else return false;
+    i += 2;
+  }
+  *first = i;
+  return i < argc;
+}
+
+/*
+  now function:
+  This function returns a monotonic time in seconds.
+*/
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+  find_level function:
+  This function returns the level file a record was played on (NULL if it was not given).
+*/
+static replay_level *find_level(replay_level *levels, int nlevels, const replay_game *rg){
+  for (int i = 0; i < nlevels; i++){
+    if (levels[i].signature == rg->signature) return &levels[i];
+  }
+  return NULL;
+}
+
+/*
+  verify_game function:
+  This function replays a game from its first keyframe to its end, and checks the end against the record:
+  score, length, and how the game ended (the snake stuck, an invalid action, a win, or the move limits).
+*/
+static bool verify_game(const replay_game *rg, sim_game *game){
+  if (!replay_seek(rg, game, 0)) return false;
+  while (game->moves < rg->moves){
+    if (!replay_step(rg, game)) return false;
+  }
+  if (game->score != rg->score || game->length != rg->length) return false;
+
+  switch (rg->status){
+  case GAME_STUCK: return sim_begin_move(game) == GAME_STUCK;
+  case GAME_INVALID: return rg->tried != REPLAY_NO_ACTION && sim_begin_move(game) == GAME_RUNNING
+                            && sim_end_move(game, (action)rg->tried) == GAME_INVALID;
+  case GAME_WON: return game->status == GAME_WON;
+  default: return game->status == GAME_RUNNING; //Stopped by the limits of the simulator
+  }
+}
+
+/*
+  show_move function:
+  This function prints the map of a game after a number of moves, and the action the record has for the next move.
+  With decide, the AI replays the moves from the keyframe before (each decision is checked against the record),
+  then decides the move shown.
+*/
+static void show_move(const replay_game *rg, sim_game *game, long move, bool decide){
+  if (move > rg->moves) move = rg->moves;
+  printf("%s seed %llu: %s after %ld moves, score %ld, length %ld\n", rg->level, (unsigned long long)rg->seed,
+         sim_status_name(rg->status), rg->moves, rg->score, rg->length);
+
+  uint64_t airng;
+  long from = decide ? replay_keyframe_before(rg, move, &airng) : move;
+  if (from < 0){
+    printf("The record has no keyframe before move %ld\n", move);
+    return;
+  }
+  if (!replay_seek(rg, game, from)){
+    printf("The replay does not match the record before move %ld\n", from);
+    return;
+  }
+
+  GameContext *ctx = decide ? newGameContext(airng) : NULL;
+  long differences = 0;
+  for (; decide && ctx != NULL && game->moves <= move && game->moves < rg->moves; ){
+    action a = playerMove(ctx, game->map, game->level->xsize, game->level->ysize, sim_snake(game), game->last_action);
+    action recorded = replay_action(rg, game->moves);
+    if (game->moves == move){
+      printf("AI decision for move %ld: %s (recorded: %s)\n", move, actionNames[a], actionNames[recorded]);
+      break;
+    }
+    if (a != recorded) differences++;
+    if (!replay_step(rg, game)){
+      printf("The replay does not match the record at move %ld\n", game->moves);
+      freeGameContext(ctx);
+      return;
+    }
+  }
+  if (decide){
+    printf("Moves %ld to %ld replayed by the AI from the keyframe: %ld decisions differ from the record\n",
+           from, move, differences);
+  }
+  freeGameContext(ctx);
+
+  printf("Map after %ld moves (score %ld, length %d):\n", game->moves, game->score, game->length);
+  for (int y = 0; y < game->level->ysize; y++) printf("%s\n", game->map[y]);
+  if (move < rg->moves) printf("Next move: %s\n", actionNames[replay_action(rg, move)]);
+  else if (rg->status == GAME_INVALID && rg->tried != REPLAY_NO_ACTION) printf("Invalid action tried: %s\n", actionNames[rg->tried]);
+  else printf("End of the game: %s\n", sim_status_name(rg->status));
+}
@@ -0,0 +1,356 @@
+/*
+  Headless simulator: plays many games of a level with the AI of player.c, without rendering nor delays,
+  then reports the throughput (games/s, moves/s) and the distributions of scores and snake lengths.
+
+  Build:
+    gcc -std=c99 -Wall -O2 -o simulator simulator.c snake_sim.c snake_replay.c player.c
+  Usage:
+    ./simulator [-games integer] [-seed integer] [-moves integer] [-idle integer] [-debug on/off]
+                [-record file] [-keyframes integer] [-large on/off] [-fill percent] level_file...
+  The strategy is chosen by player.c, e.g. SNAKE_STRATEGY=hamilton ./simulator level-20x10.map
+  With -large on, levels up to SIM_LARGE_MAP_X_SIZE columns are read (the engine stops at 1000), and a table of the
+  time per move against the level size is printed at the end. -fill starts every game with a snake already holding
+  that percentage of the cells inside the border, laid in a zigzag of rows from the top left corner that leaves the
+  first column free (so that long snakes are timed without playing the millions of moves growing them). On such
+  levels SNAKE_STRATEGY=hamilton is the strategy whose moves do not depend on the level size: it follows a cycle
+  computed once per level, and the bonus is only searched for when it moves.
+  With -record, every game is written to a recording (see snake_replay.h, and replay.c to read it), with a keyframe
+  every -keyframes moves (256 by default). The AI of each game then has its own context seeded with the game's
+  seed (as in tournament.c), instead of snake()'s context seeded once, so that each game can be replayed alone.
+*/
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t
+#include <stdio.h> // printf, snprintf
+#include <stdlib.h> // malloc, free, qsort, strtol, strtod, srand
+#include <string.h> // strcmp
+#include <time.h> // clock_gettime, time
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "player_api.h"
+#include "snake_sim.h"
+#include "snake_replay.h"
+
+/*
+  Settings of a run, read from the command line
+*/
+typedef struct {
+  long games; // number of games per level
+  uint64_t seed; // seed of the first game, the following games use seed+1, seed+2, ...
+  long maxmoves; // move limit per game (0: none)
+  long maxidle; // limit of moves without eating (0: none, -1: 10 times the free cells of the level)
+  const char *record; // recording to write (NULL: none)
+  int keyframes; // moves between two keyframes of the recording
+  bool large; // read levels wider than the engine allows, and print the scaling table
+  double fill; // percentage of the cells inside the border held by the snake when a game starts (0: engine start)
+} settings;
+
+/*
+  What a level's games measured, for the scaling table
+*/
+typedef struct {
+  int xsize; // x size of the level
+  int ysize; // y size of the level
+  long startlength; // snake length when the games start
+  long maxlength; // longest snake at the end of a game
+  long moves; // moves played in all the games
+  double elapsed; // seconds spent playing them
+} level_result;
+
+// prototypes of the local/private functions
+static bool read_parameters(int, char **, settings *, int *);
+static double now(void);
+static int compare_longs(const void *, const void *);
+static void print_distribution(const char *, long *, long);
+static void play_recorded(sim_game *, GameContext *, replay_recorder *, const char *, uint64_t, long, long);
+static int *fill_order(const sim_level *, const char *, long *);
+static void fill_snake(sim_game *, const int *, int *, long);
+static void print_scaling(const level_result *, int);
+static bool run_level(const char *, const settings *, replay_recorder *, level_result *);
+
+int main(int argc, char **argv){
+  settings set;
+  int firstlevel;
+
+  if (!read_parameters(argc, argv, &set, &firstlevel)){
+    printf("Usage: simulator [-games integer] [-seed integer] [-moves integer] [-idle integer] [-debug on/off] "
+           "[-record file] [-keyframes integer] [-large on/off] [-fill percent] level_file...\n");
+    return 1;
+  }
+
+  replay_recorder rec;
+  if (set.record != NULL && !replay_recorder_open(&rec, set.record, set.keyframes)){
+    printf("Error: cannot write %s\n", set.record);
+    return 1;
+  }
+
+  level_result *results = malloc((argc - firstlevel) * sizeof(level_result));
+  if (results == NULL) return 1;
+  srand((unsigned)set.seed); //player.c seeds its random generator with rand()
+  for (int i = firstlevel; i < argc; i++){
+    if (!run_level(argv[i], &set, set.record != NULL ? &rec : NULL, &results[i - firstlevel])) return 1;
+  }
+  if (set.large) print_scaling(results, argc - firstlevel);
+  free(results);
+
+  if (set.record != NULL){
+    long games = rec.games;
+    if (!replay_recorder_close(&rec)){
+      printf("Error: the recording %s is incomplete\n", set.record);
+      return 1;
+    }
+    printf("%ld games recorded in %s\n", games, set.record);
+  }
+  return 0;
+}
+
+/*
+  read_parameters function:
+  This function reads the options, the remaining arguments are level files.
+*/
+static bool read_parameters(int argc, char **argv, settings *set, int *firstlevel){
+  set->games = 1000;
+  set->seed = (uint64_t)time(NULL);
+  set->maxmoves = 0;
+  set->maxidle = -1;
+  set->record = NULL;
+  set->keyframes = 256;
+  set->large = false;
+  set->fill = 0;
+
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-games") == 0) set->games = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-seed") == 0) set->seed = strtoull(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-moves") == 0) set->maxmoves = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-idle") == 0) set->maxidle = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-debug") == 0) DEBUG = (strcmp(argv[i + 1], "on") == 0);
+    else if (strcmp(argv[i], "-record") == 0) set->record = argv[i + 1];
+    else if (strcmp(argv[i], "-keyframes") == 0) set->keyframes = (int)strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-large") == 0) set->large = (strcmp(argv[i + 1], "on") == 0);
+    else if (strcmp(argv[i], "-fill") == 0) set->fill = strtod(argv[i + 1], NULL);
+    else return false;
+    i += 2;
+  }
+  *firstlevel = i;
+  return i < argc && set->games > 0 && set->keyframes > 0 && set->fill >= 0 && set->fill < 100;
+}
+
+/*
+  now function:
+  This function returns a monotonic time in seconds.
+*/
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compare_longs(const void *a, const void *b){
+  long x = *(const long *)a, y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  print_distribution function:
+  This function sorts the values, then prints their mean and percentiles.
+*/
+static void print_distribution(const char *name, long *values, long n){
+  double sum = 0;
+  for (long i = 0; i < n; i++) sum += values[i];
+  qsort(values, n, sizeof(long), compare_longs);
+  printf("  %-7s mean %9.2f  min %6ld  p10 %6ld  p25 %6ld  p50 %6ld  p75 %6ld  p90 %6ld  p99 %6ld  max %6ld\n",
+         name, sum / n, values[0], values[n / 10], values[n / 4], values[n / 2], values[n * 3 / 4],
+         values[n * 9 / 10], values[n * 99 / 100], values[n - 1]);
+}
+
+/*
+  play_recorded function:
+  This function plays a game that was just reset with the AI context, recording every turn
+  (a keyframe from time to time before the AI decides, then the action once applied).
+*/
+static void play_recorded(sim_game *game, GameContext *ctx, replay_recorder *rec, const char *level, uint64_t seed,
+                          long maxmoves, long maxidle){
+  seedGameContext(ctx, seed);
+  replay_recorder_start(rec, level, game, seed, seed);
+  while (sim_begin_move(game) == GAME_RUNNING){
+    replay_recorder_turn(rec, game, getRandomState(ctx));
+    action a = playerMove(ctx, game->map, game->level->xsize, game->level->ysize, sim_snake(game), game->last_action);
+    sim_end_move(game, a);
+    replay_recorder_move(rec, game, a);
+    sim_check_limits(game, maxmoves, maxidle);
+  }
+  replay_recorder_end(rec, game);
+}
+
+/*
+  fill_order function:
+  This function lists the cells inside the border in the order a filled snake takes them (for -fill): a zigzag of
+  rows from the second column, east on the first row, west on the next one, and so on, then back up the first column
+  (rows and columns swapped when the rows inside are odd but the columns even). It is the cycle the hamilton strategy
+  follows on open levels, so a filled snake lies on it. The snake lies on the first cells of the list, so the others
+  are free for the bonus. When both are odd, the first column is not a way back: *path is the number of cells
+  making a path (all the cells otherwise). It returns NULL (after printing why) if a wall stands inside the border.
+*/
+static int *fill_order(const sim_level *level, const char *filename, long *path){
+  int xsize = level->xsize, w = level->xsize - 2, h = level->ysize - 2;
+  bool rows = (h % 2 == 0 || w % 2 == 1);
+  long n = (long)w * h;
+  int *order = malloc(n * sizeof(int));
+  if (order == NULL) return NULL;
+
+  for (long i = 0; i < n; i++){
+    int x, y;
+    if (rows){
+      if (i < (long)h * (w - 1)){
+        int row = (int)(i / (w - 1)), step = (int)(i % (w - 1));
+        y = 1 + row;
+        x = (row % 2 == 0) ? 2 + step : w - step;
+      } else {
+        x = 1;
+        y = h - (int)(i - (long)h * (w - 1));
+      }
+    } else {
+      if (i < (long)w * (h - 1)){
+        int col = (int)(i / (h - 1)), step = (int)(i % (h - 1));
+        x = 1 + col;
+        y = (col % 2 == 0) ? 2 + step : h - step;
+      } else {
+        y = 1;
+        x = w - (int)(i - (long)w * (h - 1));
+      }
+    }
+    order[i] = y * xsize + x;
+    if (level->map[y][x] != PATH){
+      printf("Error: %s has walls inside its border, -fill needs an open level\n", filename);
+      free(order);
+      return NULL;
+    }
+  }
+  *path = (h % 2 == 1 && w % 2 == 1) ? (long)h * (w - 1) : n;
+  return order;
+}
+
+/*
+  fill_snake function:
+  This function puts a game that was just reset in its -fill position: the snake on the first length cells of the
+  order (the head on the last one), and the bonus on a random cell among the others.
+*/
+static void fill_snake(sim_game *game, const int *order, int *cells, long length){
+  long n = (long)(game->level->xsize - 2) * (game->level->ysize - 2);
+  for (long i = 0; i < length; i++) cells[i] = order[length - 1 - i];
+  long bonus = length + (long)((sim_random(&game->rng) >> 32) % (uint64_t)(n - length));
+  sim_game_set_snake(game, cells, (int)length, order[bonus]);
+}
+
+/*
+  print_scaling function:
+  This function prints the time per move of each level against its size, with the growth from the previous level
+  (a time per move growing slower than the cells means the moves cost less than a pass over the map).
+*/
+static void print_scaling(const level_result *results, int n){
+  printf("scaling:\n");
+  printf("  %-11s %10s %9s %9s %12s %9s %8s %10s\n",
+         "size", "cells", "start", "length", "moves", "ns/move", "x cells", "x ns/move");
+  for (int i = 0; i < n; i++){
+    const level_result *r = &results[i];
+    double cells = (double)r->xsize * r->ysize;
+    double ns = r->elapsed * 1e9 / (r->moves > 0 ? r->moves : 1);
+    char size[32];
+    snprintf(size, sizeof(size), "%dx%d", r->xsize, r->ysize);
+    printf("  %-11s %10.0f %9ld %9ld %12ld %9.1f", size, cells, r->startlength, r->maxlength, r->moves, ns);
+    if (i > 0){
+      const level_result *p = &results[i - 1];
+      double previous = p->elapsed * 1e9 / (p->moves > 0 ? p->moves : 1);
+      printf(" %8.2f %10.2f", cells / ((double)p->xsize * p->ysize), ns / previous);
+    }
+    printf("\n");
+  }
+}
+
+/*
+  run_level function:
+  This function plays all the games of a level (recording them if rec is not NULL), prints the report
+  and fills the result for the scaling table.
+*/
+static bool run_level(const char *filename, const settings *set, replay_recorder *rec, level_result *result){
+  sim_level level;
+  sim_game game;
+
+  if (!sim_level_load(&level, filename, set->large ? SIM_LARGE_MAP_X_SIZE : SIM_MAX_MAP_X_SIZE)) return false;
+  if (!sim_game_init(&game, &level, set->seed)){
+    sim_level_free(&level);
+    return false;
+  }
+
+  int *order = NULL, *cells = NULL;
+  long startlength = 1;
+  if (set->fill > 0){
+    long inside = (long)(level.xsize - 2) * (level.ysize - 2), path = 0;
+    startlength = (long)(set->fill * inside / 100);
+    if ((order = fill_order(&level, filename, &path)) != NULL && startlength > path) startlength = path;
+    if (startlength > inside - 1) startlength = inside - 1; //Room for the bonus
+    if (startlength < 1) startlength = 1;
+    if (order == NULL || (cells = malloc(startlength * sizeof(int))) == NULL){
+      free(order);
+      sim_game_free(&game);
+      sim_level_free(&level);
+      return false;
+    }
+  }
+
+  GameContext *ctx = NULL;
+  if (rec != NULL && (ctx = newGameContext(0)) == NULL){
+    sim_game_free(&game);
+    sim_level_free(&level);
+    return false;
+  }
+
+  long *scores = malloc(set->games * sizeof(long));
+  long *lengths = malloc(set->games * sizeof(long));
+  long outcomes[GAME_TIMEOUT + 1] = {0};
+  long moves = 0;
+  long maxidle = set->maxidle < 0 ? 10L * level.freecells : set->maxidle;
+
+  double start = now();
+  for (long g = 0; g < set->games; g++){
+    sim_game_reset(&game, set->seed + g);
+    if (order != NULL) fill_snake(&game, order, cells, startlength);
+    if (rec != NULL) play_recorded(&game, ctx, rec, filename, set->seed + g, set->maxmoves, maxidle);
+    else sim_play(&game, set->maxmoves, maxidle);
+    outcomes[game.status]++;
+    scores[g] = game.score;
+    lengths[g] = game.length;
+    moves += game.moves;
+  }
+  double elapsed = now() - start;
+
+  printf("%s (%dx%d, %d free cells, seed %llu)\n", filename, level.xsize, level.ysize, level.freecells,
+         (unsigned long long)set->seed);
+  printf("  %ld games, %ld moves in %.3f s: %.0f games/s, %.0f moves/s, %.1f ns/move\n",
+         set->games, moves, elapsed, set->games / elapsed, moves / elapsed, elapsed * 1e9 / (moves > 0 ? moves : 1));
+  printf("  outcomes: won %ld, stuck %ld, invalid %ld, timeout %ld\n",
+         outcomes[GAME_WON], outcomes[GAME_STUCK], outcomes[GAME_INVALID], outcomes[GAME_TIMEOUT]);
+  print_distribution("score", scores, set->games);
+  print_distribution("length", lengths, set->games);
+
+  result->xsize = level.xsize;
+  result->ysize = level.ysize;
+  result->startlength = startlength;
+  result->maxlength = lengths[set->games - 1]; //Sorted by print_distribution
+  result->moves = moves;
+  result->elapsed = elapsed;
+
+  free(order);
+  free(cells);
+  free(scores);
+  free(lengths);
+  freeGameContext(ctx);
+  sim_game_free(&game);
+  sim_level_free(&level);
+  return true;
+}
@@ -0,0 +1,453 @@
+/*
+  Recording and replay of games, see snake_replay.h.
+  The recorder appends to buffers in memory while a game is played (a few bytes per keyframe interval,
+  plus one byte per 4 moves) and writes the game as one record when it ends. The reader loads the whole
+  recording in memory: the records are read in place, without copies nor allocations.
+*/
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t, uint32_t, uint8_t
+#include <stdio.h> // FILE, fopen, fwrite, fread, fclose
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memcpy, memcmp, strlen
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "snake_sim.h"
+#include "snake_replay.h"
+
+// moves in the order of the action enum: NORTH, EAST, SOUTH, WEST
+static const int DX[4] = {0, 1, 0, -1};
+static const int DY[4] = {-1, 0, 1, 0};
+
+#define EVENT_SIZE 4 // bytes of a bonus event
+#define KEYFRAME_HEADER 53 // bytes of a keyframe before the directions of the snake
+
+// prototypes of the local/private functions
+static void put_bytes(replay_buffer *, const void *, size_t);
+static void put_u64(replay_buffer *, uint64_t);
+static void put_u32(replay_buffer *, uint32_t);
+static void put_u8(replay_buffer *, uint8_t);
+static uint64_t get_u64(const uint8_t *);
+static uint32_t get_u32(const uint8_t *);
+static int bonus_cell(const sim_game *);
+static void write_keyframe(replay_recorder *, const sim_game *, uint64_t);
+static bool restore_keyframe(const replay_game *, long, sim_game *);
+
+/*
+  put_bytes function:
+  This function appends bytes to a buffer, growing it by doubling.
+*/
+static void put_bytes(replay_buffer *b, const void *bytes, size_t n){
+  if (b->failed) return;
+  if (b->size + n > b->capacity){
+    size_t capacity = b->capacity > 0 ? b->capacity : 256;
+    while (capacity < b->size + n) capacity *= 2;
+    uint8_t *grown = realloc(b->data, capacity);
+    if (grown == NULL){
+      b->failed = true;
+      return;
+    }
+    b->data = grown;
+    b->capacity = capacity;
+  }
+  memcpy(b->data + b->size, bytes, n);
+  b->size += n;
+}
+
+/*
+  put_u64, put_u32 and put_u8 functions:
+  These functions append a number in little endian.
+*/
+static void put_u64(replay_buffer *b, uint64_t v){
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(v >> (8 * i));
+  put_bytes(b, bytes, 8);
+}
+
+static void put_u32(replay_buffer *b, uint32_t v){
+  uint8_t bytes[4];
+  for (int i = 0; i < 4; i++) bytes[i] = (uint8_t)(v >> (8 * i));
+  put_bytes(b, bytes, 4);
+}
+
+static void put_u8(replay_buffer *b, uint8_t v){
+  put_bytes(b, &v, 1);
+}
+
+/*
+  get_u64 and get_u32 functions:
+  These functions read a number written in little endian.
+*/
+static uint64_t get_u64(const uint8_t *p){
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+static uint32_t get_u32(const uint8_t *p){
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*
+  replay_level_signature function:
+  This function returns a hash (FNV-1a) of the size and the cells of a level, to match a record with its level file.
+*/
+uint64_t replay_level_signature(const sim_level *level){
+  uint64_t h = 0xcbf29ce484222325ULL;
+  h = (h ^ (uint64_t)level->xsize) * 0x100000001b3ULL;
+  h = (h ^ (uint64_t)level->ysize) * 0x100000001b3ULL;
+  for (int y = 0; y < level->ysize; y++){
+    for (int x = 0; x < level->xsize; x++){
+      h = (h ^ (unsigned char)level->map[y][x]) * 0x100000001b3ULL;
+    }
+  }
+  return h;
+}
+
+/*
+  bonus_cell function:
+  This function returns the cell of the bonus of a game (-1: none).
+*/
+static int bonus_cell(const sim_game *game){
+  if (game->bonusx < 0 || game->map[game->bonusy][game->bonusx] != BONUS) return -1;
+  return game->bonusy * game->level->xsize + game->bonusx;
+}
+
+/*
+  replay_recorder_open function:
+  This function creates a recording, with a keyframe every interval moves.
+*/
+bool replay_recorder_open(replay_recorder *rec, const char *filename, int interval){
+  memset(rec, 0, sizeof(replay_recorder));
+  rec->interval = interval > 0 ? interval : 256;
+  rec->file = fopen(filename, "wb");
+  if (rec->file == NULL) return false;
+  rec->failed = (fwrite(REPLAY_MAGIC, 1, 8, rec->file) != 8);
+  return !rec->failed;
+}
+
+/*
+  replay_recorder_close function:
+  This function closes a recording, and returns false if something could not be written.
+*/
+bool replay_recorder_close(replay_recorder *rec){
+  if (rec->file != NULL && fclose(rec->file) != 0) rec->failed = true;
+  free(rec->actions.data);
+  free(rec->events.data);
+  free(rec->table.data);
+  free(rec->keyframes.data);
+  rec->file = NULL;
+  return !rec->failed;
+}
+
+/*
+  replay_recorder_start function:
+  This function starts the record of a game that was just reset: the first bonus is its first event.
+*/
+void replay_recorder_start(replay_recorder *rec, const char *level, const sim_game *game, uint64_t seed, uint64_t aiseed){
+  replay_buffer *buffers[4] = {&rec->actions, &rec->events, &rec->table, &rec->keyframes};
+  for (int i = 0; i < 4; i++){
+    buffers[i]->size = 0;
+    buffers[i]->failed = false;
+  }
+  rec->level = level;
+  rec->seed = seed;
+  rec->aiseed = aiseed;
+  rec->tried = REPLAY_NO_ACTION;
+  rec->bonus = bonus_cell(game);
+  put_u32(&rec->events, (uint32_t)rec->bonus);
+}
+
+/*
+  write_keyframe function:
+  This function appends a keyframe of the game's current position.
+*/
+static void write_keyframe(replay_recorder *rec, const sim_game *game, uint64_t airng){
+  replay_buffer *b = &rec->keyframes;
+  put_u64(&rec->table, b->size);
+
+  put_u64(b, (uint64_t)game->moves);
+  put_u64(b, game->rng);
+  put_u64(b, airng);
+  put_u64(b, (uint64_t)game->score);
+  put_u64(b, (uint64_t)game->lastbonus);
+  put_u8(b, (int)game->last_action < 0 ? REPLAY_NO_ACTION : (uint8_t)game->last_action);
+  int bonus = bonus_cell(game);
+  put_u32(b, bonus < 0 ? REPLAY_NO_CELL : (uint32_t)bonus);
+  put_u32(b, (uint32_t)game->length);
+
+  //The head, then the direction from each cell of the snake to the next one, 4 per byte
+  const struct snake_link *link = sim_snake(game);
+  put_u32(b, (uint32_t)(link->y * game->level->xsize + link->x));
+  uint8_t packed = 0;
+  int n = 0;
+  for (; link->next != NULL; link = link->next){
+    const struct snake_link *next = link->next;
+    int d = (next->y < link->y) ? NORTH : (next->x > link->x) ? EAST : (next->y > link->y) ? SOUTH : WEST;
+    packed |= (uint8_t)(d << (2 * (n % 4)));
+    if (++n % 4 == 0){
+      put_u8(b, packed);
+      packed = 0;
+    }
+  }
+  if (n % 4 != 0) put_u8(b, packed);
+}
+
+/*
+  replay_recorder_turn function:
+  This function is called at each turn, before the AI decides (airng is the state of its random generator):
+  every interval moves, it takes a keyframe.
+*/
+void replay_recorder_turn(replay_recorder *rec, const sim_game *game, uint64_t airng){
+  if (game->moves % rec->interval == 0) write_keyframe(rec, game, airng);
+}
+
+/*
+  replay_recorder_move function:
+  This function records the action chosen at a turn, after the game applied it (an invalid action ends the game
+  without being applied, it is kept apart), and the new bonus if the snake ate.
+*/
+void replay_recorder_move(replay_recorder *rec, const sim_game *game, action a){
+  if (game->status == GAME_INVALID){
+    rec->tried = (uint8_t)a;
+    return;
+  }
+  long i = game->moves - 1;
+  if (i % 4 == 0) put_u8(&rec->actions, 0);
+  if (!rec->actions.failed) rec->actions.data[i / 4] |= (uint8_t)(a << (2 * (i % 4)));
+
+  int bonus = bonus_cell(game);
+  if (bonus >= 0 && bonus != rec->bonus) put_u32(&rec->events, (uint32_t)bonus);
+  rec->bonus = bonus;
+}
+
+/*
+  replay_recorder_end function:
+  This function writes the record of a game that ended (a record that could not be kept in memory is dropped).
+*/
+void replay_recorder_end(replay_recorder *rec, const sim_game *game){
+  replay_buffer header = {NULL, 0, 0, false};
+  size_t namelength = strlen(rec->level);
+  if (namelength > 255) namelength = 255;
+  if (rec->actions.failed || rec->events.failed || rec->table.failed || rec->keyframes.failed){
+    rec->failed = true;
+    return;
+  }
+
+  put_bytes(&header, "\0\0\0\0\0\0\0\0", 8); //Size of the record, written last
+  put_u8(&header, (uint8_t)namelength);
+  put_u8(&header, 0);
+  put_bytes(&header, rec->level, namelength);
+  put_u32(&header, (uint32_t)game->level->xsize);
+  put_u32(&header, (uint32_t)game->level->ysize);
+  put_u64(&header, replay_level_signature(game->level));
+  put_u64(&header, rec->seed);
+  put_u64(&header, rec->aiseed);
+  put_u8(&header, (uint8_t)game->status);
+  put_u8(&header, (uint8_t)rec->tried);
+  put_u64(&header, (uint64_t)game->moves);
+  put_u64(&header, (uint64_t)game->score);
+  put_u64(&header, (uint64_t)game->length);
+  put_u32(&header, (uint32_t)rec->interval);
+  put_u64(&header, rec->events.size / EVENT_SIZE);
+  put_bytes(&header, rec->events.data, rec->events.size);
+  put_u64(&header, rec->table.size / 8);
+  put_bytes(&header, rec->table.data, rec->table.size);
+  put_u64(&header, rec->keyframes.size);
+  if (header.failed){
+    free(header.data);
+    rec->failed = true;
+    return;
+  }
+
+  uint64_t size = header.size - 8 + rec->keyframes.size + rec->actions.size;
+  for (int i = 0; i < 8; i++) header.data[i] = (uint8_t)(size >> (8 * i));
+  if (fwrite(header.data, 1, header.size, rec->file) != header.size
+      || fwrite(rec->keyframes.data, 1, rec->keyframes.size, rec->file) != rec->keyframes.size
+      || fwrite(rec->actions.data, 1, rec->actions.size, rec->file) != rec->actions.size){
+    rec->failed = true;
+  }
+  free(header.data);
+  rec->games++;
+}
+
+/*
+  replay_reader_open function:
+  This function loads a recording in memory, and checks that it is one.
+*/
+bool replay_reader_open(replay_reader *reader, const char *filename){
+  reader->data = NULL;
+  reader->size = 0;
+  reader->offset = 8;
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) return false;
+
+  uint8_t block[65536];
+  size_t n;
+  replay_buffer b = {NULL, 0, 0, false};
+  while ((n = fread(block, 1, sizeof(block), f)) > 0) put_bytes(&b, block, n);
+  fclose(f);
+  if (b.failed || b.size < 8 || memcmp(b.data, REPLAY_MAGIC, 8) != 0){
+    free(b.data);
+    return false;
+  }
+  reader->data = b.data;
+  reader->size = b.size;
+  return true;
+}
+
+/*
+  replay_reader_close function:
+  This function releases the memory of a recording (the records read from it can't be used anymore).
+*/
+void replay_reader_close(replay_reader *reader){
+  free(reader->data);
+  reader->data = NULL;
+}
+
+/*
+  replay_reader_next function:
+  This function reads the next record of a recording, and returns false at the end (or on a truncated record).
+*/
+bool replay_reader_next(replay_reader *reader, replay_game *rg){
+  if (reader->data == NULL || reader->size - reader->offset < 8) return false;
+  const uint8_t *p = reader->data + reader->offset;
+  uint64_t size = get_u64(p);
+  if (size > reader->size - reader->offset - 8) return false;
+  const uint8_t *end = p + 8 + size;
+  p += 8;
+
+  //Fixed fields (bounds checked as a whole, then each variable part on its own)
+  if (end - p < 2) return false; //No room for the length of the level name
+  size_t namelength = p[0];
+  if ((size_t)(end - p) < 2 + namelength + 70) return false;
+  memcpy(rg->level, p + 2, namelength);
+  rg->level[namelength] = '\0';
+  p += 2 + namelength;
+  rg->xsize = (int)get_u32(p);
+  rg->ysize = (int)get_u32(p + 4);
+  rg->signature = get_u64(p + 8);
+  rg->seed = get_u64(p + 16);
+  rg->aiseed = get_u64(p + 24);
+  rg->status = (sim_status)p[32];
+  rg->tried = p[33];
+  if (rg->tried > WEST && rg->tried != REPLAY_NO_ACTION) return false;
+  rg->moves = (long)get_u64(p + 34);
+  rg->score = (long)get_u64(p + 42);
+  rg->length = (long)get_u64(p + 50);
+  rg->interval = (int)get_u32(p + 58);
+  rg->nevents = (long)get_u64(p + 62);
+  p += 70;
+
+  if ((uint64_t)(end - p) < (uint64_t)rg->nevents * EVENT_SIZE + 8) return false;
+  rg->events = p;
+  p += rg->nevents * EVENT_SIZE;
+  rg->nkeyframes = (long)get_u64(p);
+  p += 8;
+  if ((uint64_t)(end - p) < (uint64_t)rg->nkeyframes * 8 + 8) return false;
+  rg->table = p;
+  p += rg->nkeyframes * 8;
+  rg->keysize = get_u64(p);
+  p += 8;
+  if ((uint64_t)(end - p) < rg->keysize + (uint64_t)(rg->moves + 3) / 4 || rg->nkeyframes < 1 || rg->interval < 1) return false;
+  rg->keyframes = p;
+  rg->actions = p + rg->keysize;
+
+  reader->offset += 8 + size;
+  return true;
+}
+
+/*
+  replay_action function:
+  This function returns the action played at a move (0 .. moves - 1) of a record.
+*/
+action replay_action(const replay_game *rg, long move){
+  return (action)((rg->actions[move / 4] >> (2 * (move % 4))) & 3);
+}
+
+/*
+  replay_keyframe_before function:
+  This function returns the move of the last keyframe at or before a move, and the state of the AI's generator then
+  (-1 if the move is negative or the keyframe is outside the record). Keyframes are taken every interval moves,
+  from the first one.
+*/
+long replay_keyframe_before(const replay_game *rg, long move, uint64_t *airng){
+  if (move < 0) return -1;
+  long k = move / rg->interval;
+  if (k >= rg->nkeyframes) k = rg->nkeyframes - 1;
+  uint64_t offset = get_u64(rg->table + 8 * k);
+  if (rg->keysize < KEYFRAME_HEADER || offset > rg->keysize - KEYFRAME_HEADER) return -1;
+  const uint8_t *p = rg->keyframes + offset;
+  if (airng != NULL) *airng = get_u64(p + 16);
+  return (long)get_u64(p);
+}
+
+/*
+  restore_keyframe function:
+  This function puts a game (on the record's level) in the position of a keyframe.
+*/
+static bool restore_keyframe(const replay_game *rg, long k, sim_game *game){
+  uint64_t offset = get_u64(rg->table + 8 * k);
+  if (rg->keysize < KEYFRAME_HEADER || offset > rg->keysize - KEYFRAME_HEADER) return false;
+  const uint8_t *p = rg->keyframes + offset;
+  int length = (int)get_u32(p + 45);
+  if (length < 1 || length > game->capacity || offset + KEYFRAME_HEADER + (uint64_t)(length + 2) / 4 > rg->keysize) return false;
+  if (p[40] > WEST && p[40] != REPLAY_NO_ACTION) return false; //Last action
+
+  //Cells of the snake, from the head and the directions
+  int xsize = game->level->xsize;
+  int *cells = malloc(length * sizeof(int));
+  if (cells == NULL) return false;
+  cells[0] = (int)get_u32(p + 49);
+  for (int i = 1; i < length; i++){
+    int d = (p[KEYFRAME_HEADER + (i - 1) / 4] >> (2 * ((i - 1) % 4))) & 3;
+    cells[i] = cells[i - 1] + DY[d] * xsize + DX[d];
+  }
+  uint32_t bonus = get_u32(p + 41);
+  bool ok = sim_game_set_snake(game, cells, length, bonus == REPLAY_NO_CELL ? -1 : (int)bonus);
+  free(cells);
+  if (!ok) return false;
+
+  game->moves = (long)get_u64(p);
+  game->rng = get_u64(p + 8);
+  game->score = (long)get_u64(p + 24);
+  game->lastbonus = (long)get_u64(p + 32);
+  game->last_action = (p[40] == REPLAY_NO_ACTION) ? (action)-1 : (action)p[40];
+  return true;
+}
+
+/*
+  replay_step function:
+  This function applies the recorded action of the game's current move, and checks the outcome against the record:
+  the action must be valid, and a new bonus must be where the record says. It returns false otherwise.
+  (The bonus that appears when the snake reaches a length is the event numbered length - 1, no search needed.)
+*/
+bool replay_step(const replay_game *rg, sim_game *game){
+  if (game->moves >= rg->moves || game->status != GAME_RUNNING) return false;
+  long score = game->score;
+  if (sim_end_move(game, replay_action(rg, game->moves)) == GAME_INVALID) return false;
+  if (game->score == score || game->status != GAME_RUNNING) return true;
+
+  //The snake ate: the bonus appeared at its length - 1 (the first bonus is there when the snake has length 1)
+  long event = game->length - 1;
+  uint32_t cell = (uint32_t)(game->bonusy * game->level->xsize + game->bonusx);
+  return event < rg->nevents && get_u32(rg->events + event * EVENT_SIZE) == cell;
+}
+
+/*
+  replay_seek function:
+  This function puts a game (initialized on the record's level) in the position reached after a number of moves:
+  the keyframe before it is restored, then the recorded actions are applied (see replay_step).
+*/
+bool replay_seek(const replay_game *rg, sim_game *game, long move){
+  if (move < 0 || move > rg->moves) return false;
+  long k = move / rg->interval;
+  if (k >= rg->nkeyframes) k = rg->nkeyframes - 1;
+  if (!restore_keyframe(rg, k, game) || game->moves > move) return false;
+  while (game->moves < move){
+    if (!replay_step(rg, game)) return false;
+  }
+  return true;
+}
@@ -0,0 +1,120 @@
+#ifndef SNAKE_REPLAY_H
+#define SNAKE_REPLAY_H
+
+#include <stdbool.h> // bool
+#include <stdint.h> // uint64_t, uint8_t
+#include <stdio.h> // FILE
+
+#include "snake_def.h" // action
+#include "snake_sim.h" // sim_game, sim_level, sim_status
+
+/*
+  Compact recording of the games played with snake_sim.c, and their deterministic replay.
+  A game is recorded as its level (name, size and signature), its seeds, its actions packed in 2 bits each,
+  the bonus spawn events, and a keyframe every few moves: the snake packed as its head cell and 2-bit directions,
+  the bonus, the counters, and the random generators of the game and of the AI.
+  The replay restores the keyframe before a move then applies the recorded actions, so any move of any game
+  is rebuilt (map and snake list) with at most one keyframe interval of moves, and every bonus is checked
+  against the recorded events: a change of the rules shows up as a replay error.
+
+  File layout (little endian): "SNAKEREC", then one record per game:
+    u64 size of the rest of the record
+    u16 length of the level name, the name
+    u32 xsize, u32 ysize, u64 level signature, u64 game seed, u64 AI seed
+    u8 status, u8 action tried last (an invalid one, or REPLAY_NO_ACTION), u64 moves, u64 score, u64 length
+    u32 keyframe interval
+    u64 number of events, then the u32 cell (y * xsize + x) of each bonus, in order: the bonus appearing when
+      the snake reaches a length is the event length - 1
+    u64 number of keyframes, u64 offset of each one in the keyframe data, u64 size of the data, then per keyframe:
+      u64 moves, u64 game rng, u64 AI rng, u64 score, u64 lastbonus, u8 last action (REPLAY_NO_ACTION: none),
+      u32 bonus cell (REPLAY_NO_CELL: none), u32 length, u32 head cell, (length - 1) directions in 2 bits each
+    the actions, 2 bits each (action i in the bits 2 * (i % 4) of byte i / 4)
+*/
+
+#define REPLAY_MAGIC "SNAKEREC" // first 8 bytes of a recording
+#define REPLAY_NO_ACTION 0xff // no action (before the first move, or no invalid action tried)
+#define REPLAY_NO_CELL 0xffffffffu // no bonus on the map
+
+/*
+  replay_buffer struct, bytes appended to a growing block of memory
+*/
+typedef struct {
+  uint8_t *data; // the bytes
+  size_t size; // bytes used
+  size_t capacity; // bytes allocated
+  bool failed; // whether an allocation failed (the record is then dropped)
+} replay_buffer;
+
+/*
+  replay_recorder struct, a recording being written: the game being played is kept in memory,
+  then written as one record when it ends
+*/
+typedef struct {
+  FILE *file; // recording
+  int interval; // moves between two keyframes
+  const char *level; // name of the level of the current game
+  uint64_t seed; // seed of the current game
+  uint64_t aiseed; // seed of the AI of the current game
+  int tried; // invalid action tried last (REPLAY_NO_ACTION: none)
+  int bonus; // cell of the bonus after the last move (to notice when it moves)
+  replay_buffer actions; // packed actions
+  replay_buffer events; // bonus events
+  replay_buffer table; // offsets of the keyframes
+  replay_buffer keyframes; // keyframe data
+  long games; // records written
+  bool failed; // whether a write failed
+} replay_recorder;
+
+/*
+  replay_game struct, a record read from a recording (the pointers point into the reader's memory)
+*/
+typedef struct {
+  char level[256]; // name of the level
+  int xsize; // x size of the level
+  int ysize; // y size of the level
+  uint64_t signature; // signature of the level (replay_level_signature)
+  uint64_t seed; // seed of the game
+  uint64_t aiseed; // seed of the AI
+  sim_status status; // outcome
+  int tried; // invalid action tried last (REPLAY_NO_ACTION: none)
+  long moves; // moves played
+  long score; // final score
+  long length; // final snake length
+  int interval; // moves between two keyframes
+  long nevents; // bonus events
+  const uint8_t *events; // their data
+  long nkeyframes; // keyframes
+  const uint8_t *table; // their offsets
+  const uint8_t *keyframes; // their data
+  uint64_t keysize; // size of the keyframe data
+  const uint8_t *actions; // packed actions
+} replay_game;
+
+/*
+  replay_reader struct, a whole recording loaded in memory
+*/
+typedef struct {
+  uint8_t *data; // content of the file
+  size_t size; // its size
+  size_t offset; // beginning of the next record
+} replay_reader;
+
+uint64_t replay_level_signature(const sim_level *level);
+
+bool replay_recorder_open(replay_recorder *rec, const char *filename, int interval);
+bool replay_recorder_close(replay_recorder *rec);
+void replay_recorder_start(replay_recorder *rec, const char *level, const sim_game *game, uint64_t seed, uint64_t aiseed);
+void replay_recorder_turn(replay_recorder *rec, const sim_game *game, uint64_t airng);
+void replay_recorder_move(replay_recorder *rec, const sim_game *game, action a);
+void replay_recorder_end(replay_recorder *rec, const sim_game *game);
+
+bool replay_reader_open(replay_reader *reader, const char *filename);
+void replay_reader_close(replay_reader *reader);
+bool replay_reader_next(replay_reader *reader, replay_game *rg);
+
+action replay_action(const replay_game *rg, long move);
+long replay_keyframe_before(const replay_game *rg, long move, uint64_t *airng);
+bool replay_seek(const replay_game *rg, sim_game *game, long move);
+bool replay_step(const replay_game *rg, sim_game *game);
+
+#endif
@@ -0,0 +1,510 @@
+// compiler's header files
+#include <ctype.h> // isspace
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t
+#include <stdio.h> // FILE, fopen, getc, printf
+#include <stdlib.h> // malloc, realloc, free, abs
+#include <string.h> // memcpy
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "player.h"
+#include "snake_sim.h"
+
+// globals normally defined by the engine object (same values)
+const char DEAD_SNAKE_HEAD = '_';
+const char SNAKE_HEAD = '@';
+const char SNAKE_BODY = '#';
+const char SNAKE_TAIL = '+';
+const char WALL = '*';
+const char PATH = '.';
+const char BONUS = '$';
+
+bool DEBUG = false;
+
+// moves in the order of the action enum: NORTH, EAST, SOUTH, WEST
+static const int DX[4] = {0, 1, 0, -1};
+static const int DY[4] = {-1, 0, 1, 0};
+
+// prototypes of the local/private functions
+static char **map_alloc(int, int);
+static void random_coordinates(sim_game *, int *, int *);
+
+/*
+  sim_random function:
+  This function returns the next number of a splitmix64 generator.
+  Each game owns its generator, so that games are reproducible from their seed and independent from rand().
+*/
+uint64_t sim_random(uint64_t *state){
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/*
+  sim_status_name function:
+  This function returns a printable name for a game outcome.
+*/
+const char *sim_status_name(sim_status status){
+  switch(status){
+  case GAME_RUNNING: return "running";
+  case GAME_WON: return "won";
+  case GAME_STUCK: return "stuck";
+  case GAME_INVALID: return "invalid";
+  case GAME_TIMEOUT: return "timeout";
+  }
+  return "?";
+}
+
+/*
+  map_alloc function:
+  This function allocates a map as one block: the row pointers followed by the rows (each row ends with '\0').
+  A single free() releases it.
+*/
+static char **map_alloc(int xsize, int ysize){
+  char **map = malloc(ysize * sizeof(char *) + (size_t)ysize * (xsize + 1));
+  if (map == NULL) return NULL;
+  char *cells = (char *)(map + ysize);
+  for (int y = 0; y < ysize; y++){
+    map[y] = cells + (size_t)y * (xsize + 1);
+    map[y][xsize] = '\0';
+  }
+  return map;
+}
+
+/*
+  sim_level_read function:
+  This function reads a level file the same way as the engine's map_reader: one row per line, all rows of the same size,
+  between SIM_MIN_MAP_X_SIZE and SIM_MAX_MAP_X_SIZE columns and at least SIM_MIN_MAP_Y_SIZE rows.
+*/
+bool sim_level_read(sim_level *level, const char *filename){
+  return sim_level_load(level, filename, SIM_MAX_MAP_X_SIZE);
+}
+
+/*
+  sim_level_load function:
+  Same as sim_level_read, with up to maxxsize columns instead of the engine's SIM_MAX_MAP_X_SIZE (levels far larger
+  than the engine plays, for the headless runs). The file is streamed char by char into one buffer grown by doubling,
+  so a level of any size is read in time and memory linear in its size, without a row buffer of the largest width.
+*/
+bool sim_level_load(sim_level *level, const char *filename, int maxxsize){
+  char *rows = NULL; // rows read so far, xsize chars each
+  size_t used = 0, size = 0;
+  int xsize = 0, ysize = 0, len = 0;
+  bool ok = true;
+
+  FILE *f = fopen(filename, "r");
+  if (f == NULL){
+    printf("Error: file %s not found!\n", filename);
+    return false;
+  }
+
+  for (int c = getc(f); ok; c = getc(f)){
+    if (c == EOF || isspace(c)){ //End of a row (rows are separated by white space, as read by fscanf)
+      if (len == 0){
+        if (c == EOF) break;
+        continue;
+      }
+      if (ysize == 0){
+        xsize = len;
+      } else if (len != xsize){ //Every row must have the same size
+        printf("Error: %s is not well-formed (rows do not have same size)\n", filename);
+        ok = false;
+        break;
+      }
+      ysize++;
+      len = 0;
+      if (c == EOF) break;
+      continue;
+    }
+    if (++len > maxxsize) break; //Rejected below
+    if (used == size){
+      size_t grown_size = (size == 0) ? 4096 : 2 * size;
+      char *grown = realloc(rows, grown_size);
+      if (grown == NULL){
+        ok = false;
+        break;
+      }
+      rows = grown;
+      size = grown_size;
+    }
+    rows[used++] = (char)c;
+  }
+  fclose(f);
+  if (!ok){
+    free(rows);
+    return false;
+  }
+
+  if (len > maxxsize) xsize = len;
+  if (xsize < SIM_MIN_MAP_X_SIZE || xsize > maxxsize || ysize < SIM_MIN_MAP_Y_SIZE){
+    printf("Invalid game level!\nA level must have between %d and %d columns, and at least %d rows.\n",
+           SIM_MIN_MAP_X_SIZE, maxxsize, SIM_MIN_MAP_Y_SIZE);
+    free(rows);
+    return false;
+  }
+
+  level->map = map_alloc(xsize, ysize);
+  if (level->map == NULL){
+    free(rows);
+    return false;
+  }
+  level->xsize = xsize;
+  level->ysize = ysize;
+  level->freecells = 0;
+  level->winlength = (xsize - 2) * (ysize - 2);
+  for (int y = 0; y < ysize; y++){
+    memcpy(level->map[y], rows + (size_t)y * xsize, xsize);
+    for (int x = 0; x < xsize; x++){
+      if (level->map[y][x] == PATH) level->freecells++;
+      //The engine wins when every cell inside the border holds the snake, a wall there makes it impossible
+      if (level->map[y][x] == WALL && x > 0 && y > 0 && x < xsize - 1 && y < ysize - 1) level->winlength = -1;
+    }
+  }
+  free(rows);
+  return true;
+}
+
+/*
+  sim_level_free function:
+  This function releases the memory of a level.
+*/
+void sim_level_free(sim_level *level){
+  free(level->map);
+  level->map = NULL;
+}
+
+/*
+  random_coordinates function:
+  Same as the engine's random_coordinates, with the game's own generator instead of rand().
+*/
+static void random_coordinates(sim_game *game, int *x, int *y){
+  *x = (int)((sim_random(&game->rng) >> 32) % (uint64_t)game->level->xsize);
+  *y = (int)((sim_random(&game->rng) >> 32) % (uint64_t)game->level->ysize);
+}
+
+/*
+  sim_game_init function:
+  This function allocates everything a game needs (the map copy and one link per cell), then starts a first game.
+  No allocation happens afterwards, neither in sim_process_move nor in sim_game_reset.
+*/
+bool sim_game_init(sim_game *game, const sim_level *level, uint64_t seed){
+  int cells = level->xsize * level->ysize;
+
+  game->level = level;
+  game->capacity = cells;
+  game->player = NULL;
+  game->playerdata = NULL;
+  game->map = map_alloc(level->xsize, level->ysize);
+  game->links = malloc(cells * sizeof(struct snake_link));
+  game->body = malloc(cells * sizeof(struct snake_link *));
+  game->spare = malloc(cells * sizeof(struct snake_link *));
+  if (game->map == NULL || game->links == NULL || game->body == NULL || game->spare == NULL){
+    sim_game_free(game);
+    return false;
+  }
+  sim_game_reset(game, seed);
+  return true;
+}
+
+/*
+  sim_game_free function:
+  This function releases the memory of a game.
+*/
+void sim_game_free(sim_game *game){
+  free(game->map);
+  free(game->links);
+  free(game->body);
+  free(game->spare);
+  game->map = NULL;
+  game->links = NULL;
+  game->body = NULL;
+  game->spare = NULL;
+}
+
+/*
+  sim_game_set_player function:
+  This function makes the game ask a player function for its moves, instead of snake() (NULL goes back to snake()).
+  The player is kept by sim_game_reset.
+*/
+void sim_game_set_player(sim_game *game, sim_player player, void *data){
+  game->player = player;
+  game->playerdata = data;
+}
+
+/*
+  sim_game_reset function:
+  This function starts a new game on the same level, following the engine's game_init:
+  the head is placed on a random free cell, then the bonus on another random free cell.
+*/
+void sim_game_reset(sim_game *game, uint64_t seed){
+  const sim_level *level = game->level;
+  int x, y;
+
+  game->rng = seed;
+  for (y = 0; y < level->ysize; y++)
+    memcpy(game->map[y], level->map[y], level->xsize);
+
+  //All the links are unused
+  game->nspare = game->capacity;
+  for (int i = 0; i < game->capacity; i++)
+    game->spare[i] = &game->links[game->capacity - 1 - i];
+
+  //Snake of length 1
+  do {
+    random_coordinates(game, &x, &y);
+  } while (level->map[y][x] != PATH);
+  struct snake_link *head = game->spare[--game->nspare];
+  head->c = SNAKE_HEAD;
+  head->x = x;
+  head->y = y;
+  head->next = NULL;
+  game->first = 0;
+  game->body[0] = head;
+  game->length = 1;
+  game->map[y][x] = SNAKE_HEAD;
+
+  //Bonus (unlike the engine, it never starts under the head)
+  do {
+    random_coordinates(game, &x, &y);
+  } while (game->map[y][x] != PATH);
+  game->bonusx = x;
+  game->bonusy = y;
+  game->bonusttl = SIM_BONUS_TTL;
+  game->map[y][x] = BONUS;
+
+  game->score = 0;
+  game->moves = 0;
+  game->lastbonus = 0;
+  game->last_action = (action)-1;
+  game->status = GAME_RUNNING;
+}
+
+/*
+  sim_game_set_snake function:
+  This function puts a game in a given position: the snake on the cells listed from the head to the tail
+  (numbered y * xsize + x), and the bonus on a cell (-1: none). The counters, the last action and the generator
+  are left to the caller. It returns false if the cells are not a snake lying on free cells of the level.
+*/
+bool sim_game_set_snake(sim_game *game, const int *cells, int length, int bonus){
+  const sim_level *level = game->level;
+  int xsize = level->xsize;
+
+  if (length < 1 || length > game->capacity) return false;
+  for (int y = 0; y < level->ysize; y++)
+    memcpy(game->map[y], level->map[y], xsize);
+  game->nspare = game->capacity;
+  for (int i = 0; i < game->capacity; i++)
+    game->spare[i] = &game->links[game->capacity - 1 - i];
+
+  struct snake_link *previous = NULL;
+  for (int i = 0; i < length; i++){
+    int x = cells[i] % xsize, y = cells[i] / xsize;
+    if (cells[i] < 0 || y >= level->ysize || game->map[y][x] != PATH) return false;
+    if (previous != NULL && abs(x - previous->x) + abs(y - previous->y) != 1) return false;
+
+    struct snake_link *link = game->spare[--game->nspare];
+    link->c = (i == 0) ? SNAKE_HEAD : (i == length - 1) ? SNAKE_TAIL : SNAKE_BODY;
+    link->x = x;
+    link->y = y;
+    link->next = NULL;
+    if (previous != NULL) previous->next = link;
+    game->body[i] = link;
+    game->map[y][x] = link->c;
+    previous = link;
+  }
+  game->first = 0;
+  game->length = length;
+
+  game->bonusx = game->bonusy = -1;
+  if (bonus >= 0){
+    int x = bonus % xsize, y = bonus / xsize;
+    if (y >= level->ysize || game->map[y][x] != PATH) return false;
+    game->bonusx = x;
+    game->bonusy = y;
+    game->map[y][x] = BONUS;
+  }
+  game->bonusttl = SIM_BONUS_TTL;
+  game->status = GAME_RUNNING;
+  return true;
+}
+
+/*
+  sim_snake function:
+  This function returns the snake list of the game, from the head to the tail.
+*/
+snake_list sim_snake(const sim_game *game){
+  return game->body[game->first];
+}
+
+/*
+  sim_can_snake_go function:
+  Same rule as the engine's can_snake_go: the next cell must be a path, the bonus, or the current tail (that moves away).
+*/
+bool sim_can_snake_go(const sim_game *game, action a){
+  if ((unsigned)a > WEST) return false;
+
+  const struct snake_link *head = game->body[game->first];
+  const struct snake_link *tail = game->body[(game->first + game->length - 1) % game->capacity];
+  int x = head->x + DX[a];
+  int y = head->y + DY[a];
+  char c = game->map[y][x];
+
+  return c == PATH || c == BONUS || (x == tail->x && y == tail->y && game->length > 1);
+}
+
+/*
+  sim_is_stuck function:
+  This function checks whether the snake has no move left (the engine's "Snake is stuck!").
+*/
+bool sim_is_stuck(const sim_game *game){
+  return !sim_can_snake_go(game, NORTH) && !sim_can_snake_go(game, EAST)
+      && !sim_can_snake_go(game, SOUTH) && !sim_can_snake_go(game, WEST);
+}
+
+/*
+  sim_process_move function:
+  This function applies a valid move, as the engine's process_move followed by its winner and bonus checks.
+  Only the cells that change are written to the map:
+    -the old tail cell is given back to the level (unless the snake eats),
+    -the new head is drawn, the old head becomes body and the new last link becomes the tail.
+  The removed tail link is recycled as the new head, so the snake list is never reallocated.
+*/
+void sim_process_move(sim_game *game, action a){
+  struct snake_link *head = game->body[game->first];
+  int x = head->x + DX[a];
+  int y = head->y + DY[a];
+  bool eat = (x == game->bonusx && y == game->bonusy);
+  struct snake_link *link;
+
+  if (eat){ //The snake grows: new link, the tail stays
+    link = game->spare[--game->nspare];
+    game->length++;
+  } else { //The tail link moves to the front
+    link = game->body[(game->first + game->length - 1) % game->capacity];
+    game->map[link->y][link->x] = game->level->map[link->y][link->x];
+  }
+
+  game->first = (game->first + game->capacity - 1) % game->capacity;
+  game->body[game->first] = link;
+  link->c = SNAKE_HEAD;
+  link->x = x;
+  link->y = y;
+  if (link != head){
+    head->c = SNAKE_BODY;
+    link->next = head;
+  } else { //Snake of length 1 that did not eat
+    link->next = NULL;
+  }
+
+  struct snake_link *tail = game->body[(game->first + game->length - 1) % game->capacity];
+  if (tail != link){
+    tail->c = SNAKE_TAIL;
+    tail->next = NULL;
+  }
+
+  if (link != head) game->map[head->y][head->x] = head->c;
+  if (tail != link) game->map[tail->y][tail->x] = SNAKE_TAIL;
+  game->map[y][x] = SNAKE_HEAD;
+
+  game->moves++;
+  game->last_action = a;
+
+  if (!eat) return;
+
+  game->score += SIM_BONUS_SCORE;
+  game->lastbonus = game->moves;
+
+  //The engine's winner(): every cell inside the border holds the snake
+  //A snake filling every free cell of a level with inner walls also ends the game (the engine would loop forever)
+  if (game->length == game->level->winlength || game->length == game->level->freecells){
+    game->status = GAME_WON;
+    return;
+  }
+
+  //New bonus on a random free cell
+  do {
+    random_coordinates(game, &x, &y);
+  } while (game->map[y][x] != PATH);
+  game->bonusx = x;
+  game->bonusy = y;
+  game->map[y][x] = BONUS;
+}
+
+/*
+  sim_begin_move function:
+  This function starts a turn of the engine's main loop: game over if the snake is stuck.
+  It returns the status of the game, an action is expected (sim_end_move) while it is GAME_RUNNING.
+*/
+sim_status sim_begin_move(sim_game *game){
+  if (game->status != GAME_RUNNING) return game->status;
+
+  if (sim_is_stuck(game)){
+    if (DEBUG) printf("Snake is stuck!\n");
+    game->body[game->first]->c = DEAD_SNAKE_HEAD;
+    game->status = GAME_STUCK;
+  }
+  return game->status;
+}
+
+/*
+  sim_end_move function:
+  This function ends a turn started by sim_begin_move: the action chosen is checked then applied.
+*/
+sim_status sim_end_move(sim_game *game, action a){
+  if (!sim_can_snake_go(game, a)){
+    if (DEBUG) printf("Invalid action!\n");
+    game->body[game->first]->c = DEAD_SNAKE_HEAD;
+    game->status = GAME_INVALID;
+    return game->status;
+  }
+
+  sim_process_move(game, a);
+  return game->status;
+}
+
+/*
+  sim_play_move function:
+  This function plays one turn of the engine's main loop: game over if the snake is stuck,
+  otherwise snake() (or the game's player) is asked for an action, which is checked then applied.
+  (Games played in lockstep, whose actions are chosen together, call sim_begin_move and sim_end_move instead.)
+*/
+sim_status sim_play_move(sim_game *game){
+  if (sim_begin_move(game) != GAME_RUNNING) return game->status;
+
+  action a;
+  if (game->player != NULL){
+    a = game->player(game->playerdata, game->map, game->level->xsize, game->level->ysize, sim_snake(game), game->last_action);
+  } else {
+    a = snake(game->map, game->level->xsize, game->level->ysize, sim_snake(game), game->last_action);
+  }
+  return sim_end_move(game, a);
+}
+
+/*
+  sim_check_limits function:
+  This function stops a running game (GAME_TIMEOUT) that reached maxmoves moves, or maxidle moves without eating,
+  when these limits are positive. It returns the status of the game.
+*/
+sim_status sim_check_limits(sim_game *game, long maxmoves, long maxidle){
+  if (game->status == GAME_RUNNING
+      && ((maxmoves > 0 && game->moves >= maxmoves) || (maxidle > 0 && game->moves - game->lastbonus >= maxidle))){
+    game->status = GAME_TIMEOUT;
+  }
+  return game->status;
+}
+
+/*
+  sim_play function:
+  This function plays a game until it ends.
+  Since the engine has no move limit, a game is also stopped (GAME_TIMEOUT) after maxmoves moves,
+  or after maxidle moves without eating, when these limits are positive.
+*/
+sim_status sim_play(sim_game *game, long maxmoves, long maxidle){
+  while (sim_play_move(game) == GAME_RUNNING){
+    sim_check_limits(game, maxmoves, maxidle);
+  }
+  return game->status;
+}
@@ -0,0 +1,97 @@
+#ifndef SNAKE_SIM_H
+#define SNAKE_SIM_H
+
+#include <stdbool.h> // bool
+#include <stdint.h> // uint64_t
+
+#include "snake_def.h" // action, snake_list
+
+/*
+  Headless reimplementation of the game engine rules (snake-*-*.o), without rendering nor delays.
+  It links directly with player.c and provides the globals the engine normally defines
+  (SNAKE_HEAD, ..., BONUS and DEBUG), so snake() can be called in a tight loop.
+*/
+
+// engine constants (same values as in the prebuilt engine object)
+#define SIM_MIN_MAP_X_SIZE 10 // MIN_MAP_X_SIZE
+#define SIM_MAX_MAP_X_SIZE 1000 // MAX_MAP_X_SIZE
+#define SIM_LARGE_MAP_X_SIZE 65536 // largest x size read by sim_level_load for the headless runs (no engine limit)
+#define SIM_MIN_MAP_Y_SIZE 5 // MIN_MAP_Y_SIZE
+#define SIM_BONUS_SCORE 1 // BONUS_SCORE
+#define SIM_BONUS_TTL 100 // BONUS_TTL (stored by the engine, but never decremented)
+
+extern const char DEAD_SNAKE_HEAD; // ascii used for the head of a dead snake
+
+/*
+  sim_level struct, a level as read from a level-*.map file (walls and paths only)
+*/
+typedef struct {
+  char **map; // rows of the level
+  int xsize; // x size of the level
+  int ysize; // y size of the level
+  int freecells; // number of PATH cells
+  int winlength; // snake length at which the engine declares a win, -1 if the level cannot be won
+} sim_level;
+
+/*
+  Outcome of a game
+*/
+typedef enum {GAME_RUNNING, GAME_WON, GAME_STUCK, GAME_INVALID, GAME_TIMEOUT} sim_status;
+
+/*
+  sim_player, a function choosing the moves of a game in place of snake(): it gets the data given to sim_game_set_player
+  and the same arguments as snake(). It lets several games be played at once, each by its own player.
+*/
+typedef action (*sim_player)(void *data, char **map, int mapxsize, int mapysize, snake_list s, action last_action);
+
+/*
+  sim_game struct, the state of one game played on a level
+  The map handed to snake() and the snake list are updated in place after each move (O(1) per move),
+  instead of being rebuilt from scratch as the engine does.
+*/
+typedef struct {
+  const sim_level *level; // level being played
+  char **map; // level + snake + bonus, as given to snake()
+  struct snake_link *links; // one link per cell of the map, never reallocated
+  struct snake_link **body; // ring of links, from the head to the tail
+  struct snake_link **spare; // stack of unused links
+  int nspare; // number of unused links
+  int capacity; // size of the body ring
+  int first; // index of the head in the body ring
+  int length; // snake length
+  int bonusx; // x position of the bonus
+  int bonusy; // y position of the bonus
+  int bonusttl; // bonus time to live (see SIM_BONUS_TTL)
+  long score; // game score
+  long moves; // number of moves played
+  long lastbonus; // move at which the last bonus was eaten
+  action last_action; // last action made, -1 in the beginning
+  sim_status status; // outcome of the game
+  uint64_t rng; // state of the game's random generator
+  sim_player player; // function choosing the moves, NULL for snake()
+  void *playerdata; // data given to player
+} sim_game;
+
+bool sim_level_read(sim_level *level, const char *filename);
+bool sim_level_load(sim_level *level, const char *filename, int maxxsize);
+void sim_level_free(sim_level *level);
+
+bool sim_game_init(sim_game *game, const sim_level *level, uint64_t seed);
+void sim_game_reset(sim_game *game, uint64_t seed);
+void sim_game_free(sim_game *game);
+void sim_game_set_player(sim_game *game, sim_player player, void *data);
+bool sim_game_set_snake(sim_game *game, const int *cells, int length, int bonus);
+snake_list sim_snake(const sim_game *game);
+bool sim_can_snake_go(const sim_game *game, action a);
+bool sim_is_stuck(const sim_game *game);
+void sim_process_move(sim_game *game, action a);
+sim_status sim_begin_move(sim_game *game);
+sim_status sim_end_move(sim_game *game, action a);
+sim_status sim_play_move(sim_game *game);
+sim_status sim_check_limits(sim_game *game, long maxmoves, long maxidle);
+sim_status sim_play(sim_game *game, long maxmoves, long maxidle);
+
+uint64_t sim_random(uint64_t *state);
+const char *sim_status_name(sim_status status);
+
+#endif
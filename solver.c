@@ -0,0 +1,665 @@
+/*
+  Exhaustive solver of small levels: computes the best move of every state of a level (the snake, and the bonus
+  on any free cell) and writes them as a policy table (see PolicyHeader in player.c), that the AI maps and looks up
+  before its strategies. A player finds the table of the map it is given in the directory named by SNAKE_LEVELS,
+  like the compiled levels of levelc.c, e.g.
+    ./solver -o levels level-10x5.map
+    SNAKE_LEVELS=levels ./snake level-10x5.map
+  SNAKE_POLICY=off makes the player ignore the table.
+
+  The states are explored from every snake of length 1, length by length: the snakes of a length are the ones grown
+  by eating from the length below, then every snake reached from them by moves that don't eat. The snakes are kept
+  as sorted arrays of keys (policyKey in player.c: 64 bits, length, head and 2 bits per link), deduplicated by
+  sorting, and each round of the exploration is split among the threads.
+  The moves are then solved backward from the longest snakes. Eating leads to a longer snake, whose value is already
+  known (the bonus, plus the mean of its values over the cells the next bonus can appear on), while the moves that
+  don't eat keep the length and the bonus. So for one length and one bonus cell, the value of a snake is the best
+  value among the eating moves it can reach: a breadth-first search backward from them, best value first, gives it
+  to every snake with the move toward the closest one (the threads take a bonus cell each). The table played this
+  way gets the highest expected score, bonus cells being drawn uniformly.
+  The solver reports the snakes and states of each length, the memory used and the time of each phase, to see how
+  far up the levels can go: a level has at most POLICY_MAX_CELLS free cells, and the states grow about 2.5 times
+  per free cell.
+
+  Build:
+    gcc -std=c99 -Wall -O2 -pthread -o solver solver.c workpool.c snake_sim.c
+  Usage:
+    ./solver [-threads integer] [-o directory] level_file
+*/
+#include "player.c" // the AI, with the keys and the file format of the policy tables (so player.c is not linked)
+
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t, uint32_t
+#include <stdio.h> // printf, fprintf, fopen, snprintf
+#include <stdlib.h> // malloc, calloc, free, qsort, strtol
+#include <string.h> // strcmp, memcpy
+#include <time.h> // clock_gettime
+
+// main program's header files
+#include "snake_sim.h" // sim_level_read
+#include "workpool.h" // workpool_run
+
+#define CHUNK 4096 // snakes expanded per task of the exploration
+
+/*
+  Settings of a run, read from the command line
+*/
+typedef struct {
+  int threads; // number of workers
+  const char *directory; // directory the table is written to
+} settings;
+
+/*
+  key_list struct, a growing array of snake keys
+*/
+typedef struct {
+  uint64_t *keys; // the keys
+  long count; // keys used
+  long capacity; // keys allocated
+  bool failed; // whether an allocation failed
+} key_list;
+
+/*
+  layer struct, the snakes of one length
+*/
+typedef struct {
+  uint64_t *keys; // keys of the snakes, sorted
+  long count; // number of snakes
+  uint64_t *moves; // best move of each snake, 2 bits per rank of the bonus cell
+  float *gain; // expected score of eating into each snake: the bonus, plus its mean value over the next bonus cells
+} layer;
+
+/*
+  seed struct, a state whose snake can eat the bonus (where the backward search starts)
+*/
+typedef struct {
+  long snake; // index of the snake in its layer
+  float value; // value of eating
+  int move; // move eating the bonus
+} seed;
+
+/*
+  solver struct, the level and the states, shared by the workers (each task writes its own part only)
+*/
+typedef struct {
+  const settings *set; // settings
+  int cells; // free cells of the level
+  int neighbor[POLICY_MAX_CELLS][4]; // rank of the neighbor of each free cell in each direction (-1: wall)
+  layer layers[POLICY_MAX_CELLS]; // snakes of each length (1 to cells - 1: the last bonus wins the game)
+  int length; // length explored or solved
+  const uint64_t *frontier; // snakes expanded by the exploration round
+  long nfrontier; // their number
+  bool grow; // whether the round eats (snakes one longer) or only makes moves that don't eat
+  key_list *found; // snakes found by each worker in the round
+  float *values; // value of each state of the length solved (snake * cells + bonus rank, -1: not reached yet)
+  unsigned char *best; // best move of each state
+  seed **seeds; // eating states of each worker
+  long **queues; // search queue of each worker
+  size_t peak; // most bytes used by the states
+} solver;
+
+// prototypes of the local/private functions
+static bool read_parameters(int, char **, settings *, int *);
+static double now(void);
+static void push_key(key_list *, uint64_t);
+static int compare_keys(const void *, const void *);
+static long sort_keys(uint64_t *, long);
+static int snake_cells(const solver *, uint64_t, int *, uint32_t *);
+static long find_snake(const layer *, uint64_t);
+static size_t layer_bytes(const solver *);
+static void note_memory(solver *, size_t);
+static void explore_task(void *, int, long);
+static bool explore_round(solver *, const uint64_t *, long, bool, key_list *);
+static bool explore_layer(solver *, int, int *);
+static int compare_seeds(const void *, const void *);
+static int predecessors(const solver *, uint64_t, int, uint64_t *, int *);
+static void solve_task(void *, int, long);
+static bool solve_layer(solver *, int, double *);
+static bool write_table(solver *, const sim_level *, double, char *, size_t, size_t *);
+
+int main(int argc, char **argv){
+  settings set;
+  int file;
+  if (!read_parameters(argc, argv, &set, &file)){
+    printf("Usage: solver [-threads integer] [-o directory] level_file\n");
+    return 1;
+  }
+
+  sim_level level;
+  if (!sim_level_read(&level, argv[file])) return 1;
+  if (level.freecells < 2 || level.freecells > POLICY_MAX_CELLS){
+    printf("%s has %d free cells: only levels of 2 to %d free cells can be solved\n", argv[file], level.freecells, POLICY_MAX_CELLS);
+    sim_level_free(&level);
+    return 1;
+  }
+
+  //Free cells numbered by rank, in row-major order (as the player does)
+  solver s;
+  memset(&s, 0, sizeof(s));
+  s.set = &set;
+  int *rank = malloc((size_t)level.xsize * level.ysize * sizeof(int));
+  s.found = calloc(set.threads, sizeof(key_list));
+  s.seeds = calloc(set.threads, sizeof(seed *));
+  s.queues = calloc(set.threads, sizeof(long *));
+  if (rank == NULL || s.found == NULL || s.seeds == NULL || s.queues == NULL){
+    fprintf(stderr, "Not enough memory\n");
+    return 1;
+  }
+  for (int y = 0; y < level.ysize; y++)
+    for (int x = 0; x < level.xsize; x++) rank[y * level.xsize + x] = (level.map[y][x] == PATH) ? s.cells++ : -1;
+  int dx[4] = {0, 1, 0, -1};
+  int dy[4] = {-1, 0, 1, 0};
+  for (int y = 0; y < level.ysize; y++)
+    for (int x = 0; x < level.xsize; x++){
+      int r = rank[y * level.xsize + x];
+      for (int d = 0; r >= 0 && d < 4; d++){
+        int nx = x + dx[d], ny = y + dy[d];
+        bool inside = nx >= 0 && ny >= 0 && nx < level.xsize && ny < level.ysize;
+        s.neighbor[r][d] = inside ? rank[ny * level.xsize + nx] : -1;
+      }
+    }
+  free(rank);
+  printf("%s: %d free cells, %d threads\n", argv[file], s.cells, set.threads);
+
+  //Exploration, from length 1 up
+  double start = now();
+  long snakes = 0, states = 0;
+  printf("length   snakes     states  rounds\n");
+  for (int length = 1; length < s.cells; length++){
+    int rounds;
+    if (!explore_layer(&s, length, &rounds)){
+      fprintf(stderr, "Not enough memory to explore the snakes of length %d\n", length);
+      return 1;
+    }
+    long count = s.layers[length].count;
+    snakes += count;
+    states += count * (s.cells - length);
+    printf("%6d %8ld %10ld %7d\n", length, count, count * (long)(s.cells - length), rounds);
+  }
+  double explored = now() - start;
+  printf("Explored %ld snakes (%ld states) in %.3f s\n", snakes, states, explored);
+
+  //Values, from the longest snakes down
+  double score = 0;
+  start = now();
+  for (int length = s.cells - 1; length >= 1; length--){
+    if (!solve_layer(&s, length, &score)){
+      fprintf(stderr, "Not enough memory to solve the snakes of length %d\n", length);
+      return 1;
+    }
+  }
+  double solved = now() - start;
+  printf("Solved in %.3f s: expected score %.3f of %d\n", solved, score, s.cells - 1);
+
+  char path[4096];
+  size_t size = 0;
+  if (!write_table(&s, &level, score, path, sizeof(path), &size)){
+    fprintf(stderr, "Could not write the table of %s in %s\n", argv[file], set.directory);
+    return 1;
+  }
+  printf("Table: %.1f MB (%.1f bytes per state), written to %s\n", size / 1e6, (double)size / states, path);
+  printf("Peak memory of the states: %.1f MB (%.1f bytes per state)\n", s.peak / 1e6, (double)s.peak / states);
+
+  for (int length = 1; length < s.cells; length++){
+    free(s.layers[length].keys);
+    free(s.layers[length].moves);
+    free(s.layers[length].gain);
+  }
+  for (int w = 0; w < set.threads; w++) free(s.found[w].keys);
+  free(s.found);
+  free(s.seeds);
+  free(s.queues);
+  sim_level_free(&level);
+  return 0;
+}
+
+/*
+  read_parameters function:
+  This function reads the settings from the command line, and the index of the level file.
+*/
+static bool read_parameters(int argc, char **argv, settings *set, int *file){
+  set->threads = workpool_default_threads();
+  set->directory = ".";
+
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-threads") == 0) set->threads = (int)strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-o") == 0) set->directory = argv[i + 1];
+    else return false;
+    i += 2;
+  }
+  *file = i;
+  return i + 1 == argc && set->threads > 0;
+}
+
+/*
+  now function:
+  This function returns a monotonic time in seconds.
+*/
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+  push_key function:
+  This function appends a key to a list, doubling its capacity when it is full.
+*/
+static void push_key(key_list *list, uint64_t key){
+  if (list->count == list->capacity){
+    long capacity = list->capacity > 0 ? 2 * list->capacity : 1024;
+    uint64_t *keys = realloc(list->keys, capacity * sizeof(uint64_t));
+    if (keys == NULL){
+      list->failed = true;
+      return;
+    }
+    list->keys = keys;
+    list->capacity = capacity;
+  }
+  list->keys[list->count++] = key;
+}
+
+static int compare_keys(const void *a, const void *b){
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  sort_keys function:
+  This function sorts keys and removes the duplicates. It returns the number of keys left.
+*/
+static long sort_keys(uint64_t *keys, long count){
+  if (count == 0) return 0;
+  qsort(keys, count, sizeof(uint64_t), compare_keys);
+  long unique = 1;
+  for (long i = 1; i < count; i++)
+    if (keys[i] != keys[unique - 1]) keys[unique++] = keys[i];
+  return unique;
+}
+
+/*
+  snake_cells function:
+  This function decodes a key: the ranks of the cells of the snake from the head to the tail, and the bit mask
+  of the ranks it holds. It returns its length.
+*/
+static int snake_cells(const solver *s, uint64_t key, int *ranks, uint32_t *occupied){
+  int length = (int)(key & 31) + 1;
+  uint64_t links = key >> POLICY_KEY_LINKS;
+  ranks[0] = (int)(key >> POLICY_KEY_HEAD & 31);
+  *occupied = 1u << ranks[0];
+  for (int i = 1; i < length; i++, links >>= 2){
+    ranks[i] = s->neighbor[ranks[i - 1]][links & 3];
+    *occupied |= 1u << ranks[i];
+  }
+  return length;
+}
+
+/*
+  find_snake function:
+  This function returns the index of a snake in its layer (binary search), or -1 if it isn't there.
+*/
+static long find_snake(const layer *l, uint64_t key){
+  long low = 0, high = l->count - 1;
+  while (low <= high){
+    long middle = low + (high - low) / 2;
+    if (l->keys[middle] == key) return middle;
+    if (l->keys[middle] < key) low = middle + 1;
+    else high = middle - 1;
+  }
+  return -1;
+}
+
+/*
+  layer_bytes function:
+  This function returns the memory held by the layers (keys, moves and gains).
+*/
+static size_t layer_bytes(const solver *s){
+  size_t bytes = 0;
+  for (int length = 1; length < s->cells; length++){
+    const layer *l = &s->layers[length];
+    bytes += l->count * (sizeof(uint64_t) * (l->moves != NULL ? 2 : 1) + (l->gain != NULL ? sizeof(float) : 0));
+  }
+  return bytes;
+}
+
+/*
+  note_memory function:
+  This function updates the peak memory with the layers and the scratch of the current phase.
+*/
+static void note_memory(solver *s, size_t scratch){
+  size_t bytes = layer_bytes(s) + scratch;
+  for (int w = 0; w < s->set->threads; w++) bytes += s->found[w].capacity * sizeof(uint64_t);
+  if (bytes > s->peak) s->peak = bytes;
+}
+
+/*
+  explore_task function:
+  This function expands a chunk of the frontier of an exploration round: each valid move of each snake either
+  eats (the snake grows, its tail stays) or not (it keeps its length: the move must leave a free cell for the bonus,
+  or go where the tail was). The snakes reached are appended to the worker's list.
+*/
+static void explore_task(void *data, int worker, long task){
+  solver *s = data;
+  key_list *found = &s->found[worker];
+  int ranks[POLICY_MAX_CELLS];
+  uint32_t occupied;
+  long end = (task + 1) * CHUNK < s->nfrontier ? (task + 1) * CHUNK : s->nfrontier;
+
+  for (long i = task * CHUNK; i < end; i++){
+    uint64_t key = s->frontier[i];
+    int length = snake_cells(s, key, ranks, &occupied);
+    int tail = ranks[length - 1];
+    uint64_t links = key >> POLICY_KEY_LINKS;
+    for (int d = 0; d < 4; d++){
+      int next = s->neighbor[ranks[0]][d];
+      if (next < 0) continue;
+      bool empty = !(occupied >> next & 1);
+      uint64_t pushed = (links << 2) | (uint64_t)((d + 2) & 3); //New first link: from the new head back to the old one
+      if (s->grow){
+        if (empty) push_key(found, (uint64_t)length | (uint64_t)next << POLICY_KEY_HEAD | pushed << POLICY_KEY_LINKS);
+      } else if ((empty && s->cells - length >= 2) || (next == tail && length > 1)){
+        uint64_t kept = pushed & ((1ULL << (2 * (length - 1))) - 1); //The last link is left by the tail
+        push_key(found, (uint64_t)(length - 1) | (uint64_t)next << POLICY_KEY_HEAD | kept << POLICY_KEY_LINKS);
+      }
+    }
+  }
+}
+
+/*
+  explore_round function:
+  This function expands snakes on all the workers, and gathers the snakes reached, sorted and without duplicates.
+  It returns false if there is no memory.
+*/
+static bool explore_round(solver *s, const uint64_t *keys, long count, bool grow, key_list *reached){
+  s->frontier = keys;
+  s->nfrontier = count;
+  s->grow = grow;
+  for (int w = 0; w < s->set->threads; w++) s->found[w].count = 0;
+  workpool_run((count + CHUNK - 1) / CHUNK, s->set->threads, explore_task, s, NULL);
+
+  reached->count = 0;
+  for (int w = 0; w < s->set->threads; w++){
+    const key_list *found = &s->found[w];
+    if (found->failed) return false;
+    for (long i = 0; i < found->count; i++) push_key(reached, found->keys[i]);
+  }
+  reached->count = sort_keys(reached->keys, reached->count);
+  return !reached->failed;
+}
+
+/*
+  explore_layer function:
+  This function finds the snakes of a length: every snake of length 1, or the snakes grown from the length below,
+  then the rounds of moves that don't eat from the snakes new in the previous round, until no new snake is found.
+  It counts the rounds, and returns false if there is no memory.
+*/
+static bool explore_layer(solver *s, int length, int *rounds){
+  layer *l = &s->layers[length];
+  key_list known = {NULL, 0, 0, false}, frontier = {NULL, 0, 0, false}, reached = {NULL, 0, 0, false};
+  bool ok = true;
+
+  if (length == 1){
+    for (int r = 0; r < s->cells; r++) push_key(&known, (uint64_t)r << POLICY_KEY_HEAD);
+    ok = !known.failed;
+  } else {
+    ok = explore_round(s, s->layers[length - 1].keys, s->layers[length - 1].count, true, &known);
+  }
+  for (long i = 0; ok && i < known.count; i++) push_key(&frontier, known.keys[i]);
+
+  for (*rounds = 0; ok && frontier.count > 0; (*rounds)++){
+    ok = explore_round(s, frontier.keys, frontier.count, false, &reached);
+    note_memory(s, (known.capacity + frontier.capacity + reached.capacity) * sizeof(uint64_t));
+
+    //New snakes: the ones reached that are not known yet (both lists are sorted)
+    frontier.count = 0;
+    for (long i = 0, j = 0; ok && i < reached.count; i++){
+      while (j < known.count && known.keys[j] < reached.keys[i]) j++;
+      if (j == known.count || known.keys[j] != reached.keys[i]) push_key(&frontier, reached.keys[i]);
+    }
+    for (long i = 0; ok && i < frontier.count; i++) push_key(&known, frontier.keys[i]);
+    ok = ok && !frontier.failed && !known.failed;
+    if (ok && frontier.count > 0) known.count = sort_keys(known.keys, known.count);
+  }
+
+  free(frontier.keys);
+  free(reached.keys);
+  l->keys = known.keys;
+  l->count = known.count;
+  return ok;
+}
+
+/*
+  compare_seeds function:
+  This function orders the eating states by decreasing value (then by snake, so the moves don't depend on qsort).
+*/
+static int compare_seeds(const void *a, const void *b){
+  const seed *x = a, *y = b;
+  if (x->value != y->value) return (x->value < y->value) - (x->value > y->value);
+  return (x->snake > y->snake) - (x->snake < y->snake);
+}
+
+/*
+  predecessors function:
+  This function lists the snakes that become a snake by a move that doesn't eat (with the bonus on a cell),
+  and the move each of them makes: the snake without its head, plus a cell next to its tail (free, or the head:
+  a move into the cell the tail leaves). It returns their number.
+*/
+static int predecessors(const solver *s, uint64_t key, int bonus, uint64_t *keys, int *moves){
+  int ranks[POLICY_MAX_CELLS];
+  uint32_t occupied;
+  int length = snake_cells(s, key, ranks, &occupied);
+  uint64_t links = key >> POLICY_KEY_LINKS;
+  int count = 0;
+
+  for (int e = 0; e < 4; e++){
+    int tail = s->neighbor[ranks[length - 1]][e];
+    if (tail < 0 || tail == bonus) continue;
+    if (length == 1){
+      keys[count] = (uint64_t)tail << POLICY_KEY_HEAD;
+      moves[count++] = (e + 2) & 3;
+    } else if (!(occupied >> tail & 1) || tail == ranks[0]){
+      uint64_t previous = (links >> 2) | (uint64_t)e << (2 * (length - 2));
+      keys[count] = (uint64_t)(length - 1) | (uint64_t)ranks[1] << POLICY_KEY_HEAD | previous << POLICY_KEY_LINKS;
+      moves[count++] = (int)((links & 3) + 2) & 3;
+    }
+  }
+  return count;
+}
+
+/*
+  solve_task function:
+  This function solves the states of a length with the bonus on one cell: the eating states are sorted by value,
+  then, for each value from the best, a breadth-first search backward from its states gives that value to every
+  snake reaching them (and not a better one), with the move toward the closest. The snakes that can't reach the
+  bonus get the value 0 and any valid move.
+*/
+static void solve_task(void *data, int worker, long task){
+  solver *s = data;
+  int bonus = (int)task, length = s->length, cells = s->cells;
+  const layer *l = &s->layers[length];
+  const layer *longer = (length + 1 < cells) ? &s->layers[length + 1] : NULL; //NULL: eating wins the game
+  seed *seeds = s->seeds[worker];
+  long *queue = s->queues[worker];
+  int ranks[POLICY_MAX_CELLS];
+  uint32_t occupied;
+
+  long nseeds = 0;
+  for (long i = 0; i < l->count; i++){
+    float *value = &s->values[i * cells + bonus];
+    s->best[i * cells + bonus] = 0;
+    snake_cells(s, l->keys[i], ranks, &occupied);
+    *value = (occupied >> bonus & 1) ? 0 : -1; //0: not a state, the bonus can't be under the snake
+    for (int d = 0; *value < 0 && d < 4; d++){
+      if (s->neighbor[ranks[0]][d] != bonus) continue;
+      float gain = 1;
+      if (longer != NULL){
+        uint64_t links = ((l->keys[i] >> POLICY_KEY_LINKS) << 2) | (uint64_t)((d + 2) & 3);
+        long j = find_snake(longer, (uint64_t)length | (uint64_t)bonus << POLICY_KEY_HEAD | links << POLICY_KEY_LINKS);
+        gain = (j >= 0) ? longer->gain[j] : 0;
+      }
+      seeds[nseeds].snake = i;
+      seeds[nseeds].value = gain;
+      seeds[nseeds++].move = d;
+    }
+  }
+  qsort(seeds, nseeds, sizeof(seed), compare_seeds);
+
+  for (long first = 0, last; first < nseeds; first = last){
+    long head = 0, tail = 0;
+    float v = seeds[first].value;
+    for (last = first; last < nseeds && seeds[last].value == v; last++){
+      long i = seeds[last].snake;
+      if (s->values[i * cells + bonus] >= 0) continue; //A better value is reachable
+      s->values[i * cells + bonus] = v;
+      s->best[i * cells + bonus] = (unsigned char)seeds[last].move;
+      queue[tail++] = i;
+    }
+    while (head < tail){
+      uint64_t keys[4];
+      int moves[4];
+      int n = predecessors(s, l->keys[queue[head++]], bonus, keys, moves);
+      for (int k = 0; k < n; k++){
+        long j = find_snake(l, keys[k]);
+        if (j < 0 || s->values[j * cells + bonus] >= 0) continue; //Never reached, or already solved
+        s->values[j * cells + bonus] = v;
+        s->best[j * cells + bonus] = (unsigned char)moves[k];
+        queue[tail++] = j;
+      }
+    }
+  }
+
+  for (long i = 0; i < l->count; i++){
+    if (s->values[i * cells + bonus] >= 0) continue;
+    s->values[i * cells + bonus] = 0;
+    snake_cells(s, l->keys[i], ranks, &occupied);
+    for (int d = 3; d >= 0; d--){
+      int next = s->neighbor[ranks[0]][d];
+      if (next >= 0 && (!(occupied >> next & 1) || (next == ranks[length - 1] && length > 1))) s->best[i * cells + bonus] = (unsigned char)d;
+    }
+  }
+}
+
+/*
+  solve_layer function:
+  This function solves the states of a length (one task per bonus cell), packs their moves, and keeps the gain
+  of eating into each snake for the length below (for length 1, the expected score of a game instead, the head
+  and the bonus being drawn on two different free cells). It returns false if there is no memory.
+*/
+static bool solve_layer(solver *s, int length, double *score){
+  layer *l = &s->layers[length];
+  int cells = s->cells;
+  bool ok = true;
+  s->length = length;
+  s->values = malloc(l->count * cells * sizeof(float));
+  s->best = malloc(l->count * cells);
+  l->moves = calloc(l->count, sizeof(uint64_t));
+  l->gain = (length > 1) ? malloc(l->count * sizeof(float)) : NULL;
+  ok = s->values != NULL && s->best != NULL && l->moves != NULL && (length == 1 || l->gain != NULL);
+  for (int w = 0; ok && w < s->set->threads; w++){
+    s->seeds[w] = malloc(l->count * sizeof(seed)); //The bonus is next to the head of a snake at most once
+    s->queues[w] = malloc(l->count * sizeof(long));
+    ok = s->seeds[w] != NULL && s->queues[w] != NULL;
+  }
+
+  if (ok){
+    note_memory(s, l->count * cells * (sizeof(float) + 1) + s->set->threads * l->count * (sizeof(seed) + sizeof(long)));
+    workpool_run(cells, s->set->threads, solve_task, s, NULL);
+
+    int ranks[POLICY_MAX_CELLS];
+    uint32_t occupied;
+    double total = 0;
+    for (long i = 0; i < l->count; i++){
+      double sum = 0;
+      snake_cells(s, l->keys[i], ranks, &occupied);
+      for (int b = 0; b < cells; b++){
+        l->moves[i] |= (uint64_t)s->best[i * cells + b] << (2 * b);
+        if (!(occupied >> b & 1)) sum += s->values[i * cells + b];
+      }
+      if (length > 1) l->gain[i] = (float)(1 + sum / (cells - length));
+      total += sum;
+    }
+    if (length == 1) *score = total / ((double)l->count * (cells - 1));
+  }
+
+  //The gains of the longer snakes are not needed anymore
+  if (length + 1 < cells){
+    free(s->layers[length + 1].gain);
+    s->layers[length + 1].gain = NULL;
+  }
+  free(s->values);
+  free(s->best);
+  for (int w = 0; w < s->set->threads; w++){
+    free(s->seeds[w]);
+    free(s->queues[w]);
+    s->seeds[w] = NULL;
+    s->queues[w] = NULL;
+  }
+  return ok;
+}
+
+/*
+  write_table function:
+  This function writes the policy table of the level in the directory (see PolicyHeader), and its name in path:
+  every snake is put in the slots from policySlot, in a table at most half full. Like compileLevel, the file
+  is written under a temporary name then renamed. It returns false if it can't be written.
+*/
+static bool write_table(solver *s, const sim_level *level, double score, char *path, size_t pathSize, size_t *size){
+  uint64_t snakes = 0, slots = 2;
+  for (int length = 1; length < s->cells; length++) snakes += s->layers[length].count;
+  while (slots < 2 * snakes) slots *= 2;
+
+  PolicyEntry *entries = malloc(slots * sizeof(PolicyEntry));
+  if (entries == NULL) return false;
+  note_memory(s, slots * sizeof(PolicyEntry));
+  for (uint64_t i = 0; i < slots; i++){
+    entries[i].key = POLICY_EMPTY;
+    entries[i].moves = 0;
+  }
+  for (int length = 1; length < s->cells; length++){
+    const layer *l = &s->layers[length];
+    for (long i = 0; i < l->count; i++){
+      uint64_t slot = policySlot(l->keys[i], slots - 1);
+      while (entries[slot].key != POLICY_EMPTY) slot = (slot + 1) & (slots - 1);
+      entries[slot].key = l->keys[i];
+      entries[slot].moves = l->moves[i];
+    }
+  }
+
+  int cells = level->xsize * level->ysize;
+  size_t offset = policyEntriesOffset(cells);
+  PolicyHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "SNAKEPOL", 8);
+  header.version = POLICY_VERSION;
+  header.byteOrder = LEVEL_ARTIFACT_BYTE_ORDER;
+  header.mapxsize = level->xsize;
+  header.mapysize = level->ysize;
+  header.signature = levelSignature(level->map, level->xsize, level->ysize);
+  header.cells = s->cells;
+  header.snakes = snakes;
+  header.slots = slots;
+  header.size = offset + slots * sizeof(PolicyEntry);
+  header.score = score;
+  *size = header.size;
+
+  //Header, walls and padding in one block, then the slots
+  unsigned char *front = calloc(offset, 1);
+  char temporary[4096 + 8]; //path and ".tmp"
+  policyPath(path, pathSize, s->set->directory, level->xsize, level->ysize, header.signature);
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *file = (front != NULL) ? fopen(temporary, "wb") : NULL;
+  bool ok = (file != NULL);
+  if (ok){
+    memcpy(front, &header, sizeof(header));
+    for (int i = 0; i < cells; i++) front[sizeof(header) + i] = (level->map[i / level->xsize][i % level->xsize] == WALL);
+    ok = fwrite(front, 1, offset, file) == offset && fwrite(entries, sizeof(PolicyEntry), slots, file) == slots;
+    ok = (fclose(file) == 0) && ok;
+    ok = ok && rename(temporary, path) == 0;
+    if (!ok) remove(temporary);
+  }
+  free(front);
+  free(entries);
+  return ok;
+}
@@ -0,0 +1,474 @@
+/*
+  Tournament runner: plays many independent games of several levels and strategies on all the cores,
+  then reports the results per level and per strategy, as CSV or JSON.
+  Every game has its own engine state (snake_sim.c) and its own AI context (player_api.h), so the games
+  share nothing and are scheduled by a work-stealing pool (workpool.c). Game g of every level and strategy
+  uses the seed seed+g, so the strategies are compared on the same games, whatever the number of threads.
+  With -batch n, each task plays n games in lockstep and their moves are decided together (playerMoves):
+  the results are the same, only the time changes.
+
+  Build:
+    gcc -std=c99 -Wall -O2 -pthread -o tournament tournament.c workpool.c snake_sim.c player.c
+  Usage:
+    ./tournament [-games integer] [-seed integer] [-threads integer] [-batch integer] [-moves integer] [-idle integer]
+                 [-strategies name,name...] [-format csv/json] [-stats on/off] [-o file] level_file...
+*/
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+// compiler's header files
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t
+#include <stdio.h> // printf, fprintf, fopen, snprintf
+#include <stdlib.h> // malloc, calloc, free, qsort, strtol
+#include <string.h> // strcmp, strtok, memset
+#include <time.h> // clock_gettime, time
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "player_api.h"
+#include "snake_sim.h"
+#include "workpool.h"
+
+#define MAX_STRATEGIES 8 // strategies in a tournament
+
+/*
+  Settings of a tournament, read from the command line
+*/
+typedef struct {
+  long games; // number of games per level and strategy
+  uint64_t seed; // seed of the first game, the following games use seed+1, seed+2, ...
+  int threads; // number of workers
+  int batch; // games played in lockstep by a task (1: one game per task, played alone)
+  long maxmoves; // move limit per game (0: none)
+  long maxidle; // limit of moves without eating (0: none, -1: 10 times the free cells of the level)
+  char *strategies[MAX_STRATEGIES]; // names of the strategies
+  int nstrategies; // number of strategies
+  bool json; // JSON report instead of CSV
+  bool stats; // latency and strategy mix per level and strategy (on stderr)
+  const char *output; // report file (NULL: standard output)
+} settings;
+
+/*
+  result struct, the outcome of one game
+*/
+typedef struct {
+  bool played; // false if the game could not be set up
+  sim_status status; // outcome
+  long score; // final score
+  long length; // final snake length
+  long moves; // moves played
+  double seconds; // time spent playing
+} result;
+
+/*
+  slot struct, the games and the AIs playing them, owned by one worker for one level and strategy
+  (set up by the first task the worker runs there, then reused): one game, or the games of a batch
+*/
+typedef struct {
+  bool ready; // whether the games and contexts are set up
+  int ngames; // number of games (the batch size)
+  sim_game *games; // engine states
+  GameContext **ctxs; // AI states
+  MoveBatch *batch; // moves to decide together (NULL when the batch size is 1)
+  int *entries; // game of each entry of the batch
+} slot;
+
+/*
+  tournament struct, everything the workers share (read only, except the results and each worker's own slots)
+*/
+typedef struct {
+  const settings *set; // settings
+  sim_level *levels; // levels played
+  const char **names; // file names of the levels
+  int nlevels; // number of levels
+  long groups; // tasks per level and strategy (games played by batches)
+  result *results; // one result per game
+  slot *slots; // nlevels * nstrategies slots per worker
+} tournament;
+
+// prototypes of the local/private functions
+static bool read_parameters(int, char **, settings *, int *);
+static double now(void);
+static int compare_longs(const void *, const void *);
+static action play_move(void *, char **, int, int, snake_list, action);
+static bool setup_slot(slot *, const sim_level *, const char *, bool, int);
+static void free_slot(slot *);
+static void play_batch(slot *, int, long, long);
+static void run_task(void *, int, long);
+static void print_json_string(FILE *, const char *);
+static void report(FILE *, const tournament *);
+static void report_mcts(const tournament *, int);
+
+int main(int argc, char **argv){
+  settings set;
+  int firstlevel;
+
+  if (!read_parameters(argc, argv, &set, &firstlevel)){
+    printf("Usage: tournament [-games integer] [-seed integer] [-threads integer] [-batch integer] [-moves integer] [-idle integer] "
+           "[-strategies name,name...] [-format csv/json] [-stats on/off] [-o file] level_file...\n");
+    printf("Strategies: smart, hamilton, lookahead, mcts (default: smart,hamilton)\n");
+    printf("The MCTS budget per move is read from SNAKE_MCTS_BUDGET (microseconds) and SNAKE_MCTS_PLAYOUTS,\n"
+           "its transposition table is turned off with SNAKE_MCTS_TABLE=off\n");
+    return 1;
+  }
+
+  tournament t = {&set, NULL, NULL, argc - firstlevel, 0, NULL, NULL};
+  t.levels = calloc(t.nlevels, sizeof(sim_level));
+  t.names = (const char **)argv + firstlevel;
+  for (int i = 0; t.levels != NULL && i < t.nlevels; i++){
+    if (!sim_level_read(&t.levels[i], t.names[i])) return 1;
+  }
+
+  long ngames = t.nlevels * set.nstrategies * set.games;
+  t.groups = (set.games + set.batch - 1) / set.batch;
+  long ntasks = t.nlevels * set.nstrategies * t.groups;
+  int nslots = t.nlevels * set.nstrategies;
+  t.results = calloc(ngames, sizeof(result));
+  t.slots = calloc((size_t)set.threads * nslots, sizeof(slot));
+  if (t.levels == NULL || t.results == NULL || t.slots == NULL){
+    fprintf(stderr, "Not enough memory\n");
+    return 1;
+  }
+
+  workpool_stats stats;
+  double start = now();
+  workpool_run(ntasks, set.threads, run_task, &t, &stats);
+  double elapsed = now() - start;
+
+  long moves = 0;
+  for (long i = 0; i < ngames; i++) moves += t.results[i].moves;
+  fprintf(stderr, "%ld games, %ld moves on %d threads in %.3f s: %.0f games/s, %.0f moves/s, %ld steals\n",
+          ngames, moves, stats.threads, elapsed, ngames / elapsed, moves / elapsed, stats.steals);
+  report_mcts(&t, nslots);
+
+  FILE *out = (set.output != NULL) ? fopen(set.output, "w") : stdout;
+  if (out == NULL){
+    fprintf(stderr, "Cannot write %s\n", set.output);
+    return 1;
+  }
+  report(out, &t);
+  if (out != stdout) fclose(out);
+
+  for (int i = 0; i < set.threads * nslots; i++) free_slot(&t.slots[i]);
+  for (int i = 0; i < t.nlevels; i++) sim_level_free(&t.levels[i]);
+  free(t.slots);
+  free(t.results);
+  free(t.levels);
+  return 0;
+}
+
+/*
+  read_parameters function:
+  This function reads the options, the remaining arguments are level files.
+  The strategy names are checked with a throwaway AI context.
+*/
+static bool read_parameters(int argc, char **argv, settings *set, int *firstlevel){
+  static char defaults[] = "smart,hamilton";
+  char *strategies = defaults;
+
+  set->games = 100;
+  set->seed = (uint64_t)time(NULL);
+  set->threads = workpool_default_threads();
+  set->batch = 1;
+  set->maxmoves = 0;
+  set->maxidle = -1;
+  set->json = false;
+  set->stats = false;
+  set->output = NULL;
+
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-games") == 0) set->games = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-seed") == 0) set->seed = strtoull(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-threads") == 0) set->threads = (int)strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-batch") == 0) set->batch = (int)strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-moves") == 0) set->maxmoves = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-idle") == 0) set->maxidle = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-strategies") == 0) strategies = argv[i + 1];
+    else if (strcmp(argv[i], "-format") == 0 && strcmp(argv[i + 1], "csv") == 0) set->json = false;
+    else if (strcmp(argv[i], "-format") == 0 && strcmp(argv[i + 1], "json") == 0) set->json = true;
+    else if (strcmp(argv[i], "-stats") == 0) set->stats = (strcmp(argv[i + 1], "on") == 0);
+    else if (strcmp(argv[i], "-o") == 0) set->output = argv[i + 1];
+    else return false;
+    i += 2;
+  }
+  *firstlevel = i;
+
+  GameContext *check = newGameContext(0);
+  if (check == NULL) return false;
+  set->nstrategies = 0;
+  for (char *name = strtok(strategies, ","); name != NULL; name = strtok(NULL, ",")){
+    if (set->nstrategies == MAX_STRATEGIES || !chooseStrategy(check, name)){
+      freeGameContext(check);
+      return false;
+    }
+    set->strategies[set->nstrategies++] = name;
+  }
+  freeGameContext(check);
+
+  return i < argc && set->games > 0 && set->threads > 0 && set->batch > 0 && set->nstrategies > 0;
+}
+
+/*
+  now function:
+  This function returns a monotonic time in seconds.
+*/
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compare_longs(const void *a, const void *b){
+  long x = *(const long *)a, y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  play_move function:
+  This function is the sim_player of the games: the move is chosen with the slot's own AI context.
+*/
+static action play_move(void *data, char **map, int mapxsize, int mapysize, snake_list s, action last_action){
+  return playerMove(data, map, mapxsize, mapysize, s, last_action);
+}
+
+/*
+  setup_slot function:
+  This function allocates the games and the AI contexts of a slot (and the batch deciding their moves when there
+  are several games), and returns false if there is no memory.
+*/
+static bool setup_slot(slot *sl, const sim_level *level, const char *strategy, bool stats, int ngames){
+  sl->games = calloc(ngames, sizeof(sim_game));
+  sl->ctxs = calloc(ngames, sizeof(GameContext *));
+  sl->entries = calloc(ngames, sizeof(int));
+  if (sl->games == NULL || sl->ctxs == NULL || sl->entries == NULL || (ngames > 1 && (sl->batch = newMoveBatch(ngames)) == NULL)){
+    free_slot(sl);
+    return false;
+  }
+
+  for (sl->ngames = 0; sl->ngames < ngames; sl->ngames++){
+    GameContext *ctx = newGameContext(0);
+    if (ctx == NULL || !sim_game_init(&sl->games[sl->ngames], level, 0)){
+      freeGameContext(ctx);
+      free_slot(sl);
+      return false;
+    }
+    sl->ctxs[sl->ngames] = ctx;
+    chooseStrategy(ctx, strategy);
+    enableMoveStats(ctx, stats);
+    sim_game_set_player(&sl->games[sl->ngames], play_move, ctx);
+  }
+  sl->ready = true;
+  return true;
+}
+
+/*
+  free_slot function:
+  This function releases the games, contexts and batch of a slot (if any).
+*/
+static void free_slot(slot *sl){
+  for (int i = 0; i < sl->ngames; i++){
+    sim_game_free(&sl->games[i]);
+    freeGameContext(sl->ctxs[i]);
+  }
+  freeMoveBatch(sl->batch);
+  free(sl->games);
+  free(sl->ctxs);
+  free(sl->entries);
+  memset(sl, 0, sizeof(slot));
+}
+
+/*
+  play_batch function:
+  This function plays the first n games of a slot in lockstep until they all end: at each turn,
+  the moves of the games still running are decided together, then applied.
+*/
+static void play_batch(slot *sl, int n, long maxmoves, long maxidle){
+  MoveBatch *batch = sl->batch;
+  for (;;){
+    batch->count = 0;
+    for (int i = 0; i < n; i++){
+      sim_game *game = &sl->games[i];
+      if (sim_begin_move(game) != GAME_RUNNING) continue;
+      int e = batch->count++;
+      sl->entries[e] = i;
+      batch->contexts[e] = sl->ctxs[i];
+      batch->maps[e] = game->map;
+      batch->mapxsizes[e] = game->level->xsize;
+      batch->mapysizes[e] = game->level->ysize;
+      batch->snakes[e] = sim_snake(game);
+      batch->lastActions[e] = game->last_action;
+    }
+    if (batch->count == 0) return;
+
+    playerMoves(batch);
+    for (int e = 0; e < batch->count; e++){
+      sim_game *game = &sl->games[sl->entries[e]];
+      sim_end_move(game, batch->actions[e]);
+      sim_check_limits(game, maxmoves, maxidle);
+    }
+  }
+}
+
+/*
+  run_task function:
+  This function plays a batch of games: task = (level * nstrategies + strategy) * groups + group,
+  where the group holds the games group * batch ... (group + 1) * batch - 1 (one game without -batch).
+  The engine and the AI of each game are both seeded from the game number, so the result doesn't depend
+  on the worker nor on the batch. The time of a batch is shared between its games by their number of moves.
+*/
+static void run_task(void *data, int worker, long task){
+  tournament *t = data;
+  const settings *set = t->set;
+  long first = task % t->groups * set->batch;
+  int k = (int)(task / t->groups % set->nstrategies);
+  int l = (int)(task / t->groups / set->nstrategies);
+  slot *sl = &t->slots[((long)worker * t->nlevels + l) * set->nstrategies + k];
+  result *r = &t->results[((long)l * set->nstrategies + k) * set->games + first];
+  int n = (int)(set->games - first < set->batch ? set->games - first : set->batch);
+
+  if (!sl->ready && !setup_slot(sl, &t->levels[l], set->strategies[k], set->stats, set->batch)) return;
+
+  const sim_level *level = &t->levels[l];
+  long maxidle = set->maxidle < 0 ? 10L * level->freecells : set->maxidle;
+
+  for (int i = 0; i < n; i++){
+    uint64_t seed = set->seed + (uint64_t)(first + i);
+    sim_game_reset(&sl->games[i], seed);
+    seedGameContext(sl->ctxs[i], seed);
+  }
+  double start = now();
+  if (sl->batch == NULL) sim_play(&sl->games[0], set->maxmoves, maxidle);
+  else play_batch(sl, n, set->maxmoves, maxidle);
+  double seconds = now() - start;
+
+  long moves = 0;
+  for (int i = 0; i < n; i++) moves += sl->games[i].moves;
+  for (int i = 0; i < n; i++){
+    const sim_game *game = &sl->games[i];
+    r[i].seconds = (n == 1) ? seconds : seconds * game->moves / (moves > 0 ? moves : 1);
+    r[i].played = true;
+    r[i].status = game->status;
+    r[i].score = game->score;
+    r[i].length = game->length;
+    r[i].moves = game->moves;
+  }
+}
+
+/*
+  report_mcts function:
+  This function prints the search throughput of the MCTS strategy (if it was played), per level:
+  playouts per second, mean and longest search of a move, mean depth of the tree and playouts reused from the
+  transposition table.
+  With -stats on, it also prints the latency and the strategy mix of every level and strategy.
+*/
+static void report_mcts(const tournament *t, int nslots){
+  const settings *set = t->set;
+  for (int l = 0; l < t->nlevels; l++){
+    for (int k = 0; k < set->nstrategies; k++){
+      MctsStats total = {0, 0, 0, 0, 0, 0};
+      MoveStats moveStats;
+      memset(&moveStats, 0, sizeof(moveStats));
+      for (int w = 0; w < set->threads; w++){
+        const slot *sl = &t->slots[(long)w * nslots + l * set->nstrategies + k];
+        for (int i = 0; i < sl->ngames; i++){
+          MctsStats stats;
+          MoveStats slotStats;
+          getMoveStats(sl->ctxs[i], &slotStats);
+          mergeMoveStats(&moveStats, &slotStats);
+          getMctsStats(sl->ctxs[i], &stats);
+          total.moves += stats.moves;
+          total.playouts += stats.playouts;
+          total.seconds += stats.seconds;
+          total.depth += stats.depth;
+          total.reused += stats.reused;
+          if (stats.maxSeconds > total.maxSeconds) total.maxSeconds = stats.maxSeconds;
+        }
+      }
+      if (set->stats){
+        char title[256];
+        snprintf(title, sizeof(title), "%s, %s", t->names[l], set->strategies[k]);
+        printMoveStats(stderr, title, &moveStats);
+      }
+      if (total.moves == 0) continue;
+      fprintf(stderr, "%s, %s: %ld searches, %.0f playouts/s, %.1f playouts/search, %.1f us/search, max %.1f us, depth %.1f, reused %.1f\n",
+              t->names[l], set->strategies[k], total.moves, total.playouts / total.seconds,
+              (double)total.playouts / total.moves, total.seconds * 1e6 / total.moves, total.maxSeconds * 1e6,
+              (double)total.depth / total.moves, (double)total.reused / total.moves);
+    }
+  }
+}
+
+/*
+  print_json_string function:
+  This function prints a string between quotes, with the JSON escapes.
+*/
+static void print_json_string(FILE *out, const char *s){
+  fputc('"', out);
+  for (; *s != '\0'; s++){
+    if (*s == '"' || *s == '\\') fputc('\\', out);
+    if ((unsigned char)*s < 0x20) fprintf(out, "\\u%04x", *s);
+    else fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+/*
+  report function:
+  This function aggregates the results per level and strategy, then prints one CSV line
+  (or one JSON object) for each: outcomes, score percentiles, mean length and moves, time per move.
+*/
+static void report(FILE *out, const tournament *t){
+  const settings *set = t->set;
+  long *scores = malloc(set->games * sizeof(long));
+  if (scores == NULL) return;
+
+  if (set->json) fprintf(out, "{\"seed\": %llu, \"games\": %ld, \"results\": [", (unsigned long long)set->seed, set->games);
+  else fprintf(out, "level,strategy,games,won,stuck,invalid,timeout,score_mean,score_p10,score_p50,score_p90,score_max,"
+               "length_mean,moves_mean,ns_per_move\n");
+
+  for (int l = 0; l < t->nlevels; l++){
+    for (int k = 0; k < set->nstrategies; k++){
+      const result *r = &t->results[((long)l * set->nstrategies + k) * set->games];
+      long outcomes[GAME_TIMEOUT + 1] = {0};
+      long played = 0, moves = 0;
+      double scoreSum = 0, lengthSum = 0, seconds = 0;
+
+      for (long g = 0; g < set->games; g++){
+        if (!r[g].played) continue;
+        outcomes[r[g].status]++;
+        scores[played++] = r[g].score;
+        scoreSum += r[g].score;
+        lengthSum += r[g].length;
+        moves += r[g].moves;
+        seconds += r[g].seconds;
+      }
+      if (played == 0) continue;
+      qsort(scores, played, sizeof(long), compare_longs);
+      double nsPerMove = seconds * 1e9 / (moves > 0 ? moves : 1);
+
+      if (set->json){
+        fprintf(out, "%s\n  {\"level\": ", (l == 0 && k == 0) ? "" : ",");
+        print_json_string(out, t->names[l]);
+        fprintf(out, ", \"strategy\": ");
+        print_json_string(out, set->strategies[k]);
+        fprintf(out, ", \"games\": %ld, \"won\": %ld, \"stuck\": %ld, \"invalid\": %ld, \"timeout\": %ld, "
+                "\"score\": {\"mean\": %.2f, \"p10\": %ld, \"p50\": %ld, \"p90\": %ld, \"max\": %ld}, "
+                "\"length_mean\": %.2f, \"moves_mean\": %.1f, \"ns_per_move\": %.1f}",
+                played, outcomes[GAME_WON], outcomes[GAME_STUCK], outcomes[GAME_INVALID], outcomes[GAME_TIMEOUT],
+                scoreSum / played, scores[played / 10], scores[played / 2], scores[played * 9 / 10], scores[played - 1],
+                lengthSum / played, (double)moves / played, nsPerMove);
+      } else {
+        fprintf(out, "%s,%s,%ld,%ld,%ld,%ld,%ld,%.2f,%ld,%ld,%ld,%ld,%.2f,%.1f,%.1f\n",
+                t->names[l], set->strategies[k], played,
+                outcomes[GAME_WON], outcomes[GAME_STUCK], outcomes[GAME_INVALID], outcomes[GAME_TIMEOUT],
+                scoreSum / played, scores[played / 10], scores[played / 2], scores[played * 9 / 10], scores[played - 1],
+                lengthSum / played, (double)moves / played, nsPerMove);
+      }
+    }
+  }
+
+  if (set->json) fprintf(out, "\n]}\n");
+  free(scores);
+}
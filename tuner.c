@@ -0,0 +1,395 @@
+/*
+  Auto-tuner: searches the constants of the smart strategy (StrategyParams, see player_api.h) that give the best
+  mean score on a level, playing the candidate sets in parallel on the headless engine (snake_sim.c, workpool.c).
+  For each level:
+    1. grid search over the four thresholds of smartStrategy (3 values each, the other constants at their defaults),
+    2. cross-entropy search over all the constants, starting from the best grid point: each iteration samples
+       a population around the current mean, then moves the mean and the spread to the best quarter,
+    3. the best set found and the defaults are played again on other seeds, so that a set which only
+       got lucky on the tuning games is not kept.
+  Every candidate is played on the same games (seed, seed+1, ...), which makes the comparisons fair.
+  The result is one line per level, in the format read by the player with SNAKE_PARAMS=file.
+
+  Build:
+    gcc -std=c99 -Wall -O2 -pthread -o tuner tuner.c workpool.c snake_sim.c player.c -lm
+  Usage:
+    ./tuner [-games integer] [-validate integer] [-seed integer] [-threads integer] [-iterations integer]
+            [-population integer] [-strategy smart/lookahead] [-o file] level_file...
+*/
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+// compiler's header files
+#include <math.h> // sqrt, log, cos, floor
+#include <stdbool.h> // bool, true, false
+#include <stdint.h> // uint64_t
+#include <stdio.h> // printf, fprintf, fopen
+#include <stdlib.h> // malloc, calloc, free, qsort, strtol
+#include <string.h> // strcmp
+#include <time.h> // clock_gettime, time
+
+// main program's header files
+#include "snake_def.h"
+#include "snake_dec.h"
+#include "player_api.h"
+#include "snake_sim.h"
+#include "workpool.h"
+
+#define GRID_PARAMS 4 // thresholds of smartStrategy searched by the grid (the first fields of StrategyParams)
+#define VALIDATION_SEED 1000000 // offset of the seeds of the validation games
+
+/*
+  Settings of a tuning run, read from the command line
+*/
+typedef struct {
+  long games; // games played per candidate
+  long validate; // games played by the best candidate and the defaults at the end
+  uint64_t seed; // seed of the first game
+  int threads; // number of workers
+  int iterations; // iterations of the cross-entropy search
+  int population; // candidates per iteration
+  const char *strategy; // strategy tuned ("smart", or "lookahead" which falls back to smart)
+  const char *output; // parameter file written (NULL: standard output)
+} settings;
+
+/*
+  bound struct, the search space of a field of StrategyParams
+*/
+typedef struct {
+  const char *name; // name of the field
+  double min; // smallest value
+  double max; // largest value
+  bool integer; // whether the value is rounded (thresholds compared to lengths or distances)
+} bound;
+
+// search space, one entry per field of StrategyParams (found by name)
+static const bound bounds[] = {
+  {"aggressiveLength", 1, 60, true},
+  {"bonusRadius", 0, 20, true},
+  {"fillRatio", 0.2, 1.0, false},
+  {"distanceRatio", 0.5, 4.0, false},
+  {"zigzagBonusWeight", 0, 100, false},
+  {"zigzagSpaceWeight", 0, 200, false},
+  {"aggressiveBonusWeight", 0, 800, false},
+  {"aggressiveSpaceWeight", 0, 200, false},
+  {"trapWeight", 0, 100000, false},
+};
+
+/*
+  slot struct, the game and the AI context of a worker on the level being tuned
+*/
+typedef struct {
+  bool ready; // whether game and ctx are set up
+  sim_game game; // engine state
+  GameContext *ctx; // AI state
+} slot;
+
+/*
+  evaluation struct, a batch of candidates played on the same games (shared by the workers)
+*/
+typedef struct {
+  const settings *set; // settings
+  const sim_level *level; // level played
+  const StrategyParams *candidates; // candidate sets
+  long games; // games per candidate
+  uint64_t seed; // seed of the first game
+  long maxidle; // limit of moves without eating
+  slot *slots; // one slot per worker
+  long *scores; // score of each game, candidate after candidate
+} evaluation;
+
+/*
+  candidate struct, a parameter set and its mean score
+*/
+typedef struct {
+  StrategyParams params; // parameter set
+  double score; // mean score
+} candidate;
+
+// prototypes of the local/private functions
+static bool read_parameters(int, char **, settings *, int *);
+static double now(void);
+static action play_move(void *, char **, int, int, snake_list, action);
+static void play_game(void *, int, long);
+static const bound *find_bound(int);
+static double clamp_param(const bound *, double);
+static double gaussian(uint64_t *);
+static int compare_candidates(const void *, const void *);
+static void evaluate(evaluation *, candidate *, int, long, uint64_t);
+static bool tune_level(const settings *, const char *, FILE *);
+
+int main(int argc, char **argv){
+  settings set;
+  int firstlevel;
+
+  if (!read_parameters(argc, argv, &set, &firstlevel)){
+    printf("Usage: tuner [-games integer] [-validate integer] [-seed integer] [-threads integer] [-iterations integer] "
+           "[-population integer] [-strategy smart/lookahead] [-o file] level_file...\n");
+    return 1;
+  }
+
+  FILE *out = (set.output != NULL) ? fopen(set.output, "w") : stdout;
+  if (out == NULL){
+    fprintf(stderr, "Cannot write %s\n", set.output);
+    return 1;
+  }
+  fprintf(out, "# StrategyParams tuned by tuner (strategy %s, %ld games per candidate, seed %llu)\n",
+          set.strategy, set.games, (unsigned long long)set.seed);
+  for (int i = firstlevel; i < argc; i++){
+    if (!tune_level(&set, argv[i], out)) return 1;
+  }
+  if (out != stdout) fclose(out);
+  return 0;
+}
+
+/*
+  read_parameters function:
+  This function reads the options, the remaining arguments are level files.
+*/
+static bool read_parameters(int argc, char **argv, settings *set, int *firstlevel){
+  set->games = 50;
+  set->validate = 200;
+  set->seed = (uint64_t)time(NULL);
+  set->threads = workpool_default_threads();
+  set->iterations = 10;
+  set->population = 24;
+  set->strategy = "smart";
+  set->output = NULL;
+
+  int i = 1;
+  while (i + 1 < argc && argv[i][0] == '-'){
+    if (strcmp(argv[i], "-games") == 0) set->games = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-validate") == 0) set->validate = strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-seed") == 0) set->seed = strtoull(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-threads") == 0) set->threads = (int)strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-iterations") == 0) set->iterations = (int)strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-population") == 0) set->population = (int)strtol(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "-strategy") == 0 && (strcmp(argv[i + 1], "smart") == 0 || strcmp(argv[i + 1], "lookahead") == 0))
+      set->strategy = argv[i + 1];
+    else if (strcmp(argv[i], "-o") == 0) set->output = argv[i + 1];
+    else return false;
+    i += 2;
+  }
+  *firstlevel = i;
+  return i < argc && set->games > 0 && set->validate > 0 && set->threads > 0
+    && set->iterations >= 0 && set->population >= 4;
+}
+
+/*
+  now function:
+  This function returns a monotonic time in seconds.
+*/
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+  play_move function:
+  This function is the sim_player of the games: the move is chosen with the slot's own AI context.
+*/
+static action play_move(void *data, char **map, int mapxsize, int mapysize, snake_list s, action last_action){
+  return playerMove(data, map, mapxsize, mapysize, s, last_action);
+}
+
+/*
+  play_game function:
+  This function plays one game of an evaluation: task = candidate * games + game.
+*/
+static void play_game(void *data, int worker, long task){
+  evaluation *e = data;
+  slot *sl = &e->slots[worker];
+  long g = task % e->games;
+
+  e->scores[task] = 0;
+  if (!sl->ready){
+    sl->ctx = newGameContext(0);
+    if (sl->ctx == NULL) return;
+    if (!sim_game_init(&sl->game, e->level, 0)){
+      freeGameContext(sl->ctx);
+      return;
+    }
+    chooseStrategy(sl->ctx, e->set->strategy);
+    sim_game_set_player(&sl->game, play_move, sl->ctx);
+    sl->ready = true;
+  }
+
+  setStrategyParams(sl->ctx, &e->candidates[task / e->games]);
+  sim_game_reset(&sl->game, e->seed + (uint64_t)g);
+  seedGameContext(sl->ctx, e->seed + (uint64_t)g);
+  sim_play(&sl->game, 0, e->maxidle);
+  e->scores[task] = sl->game.score;
+}
+
+/*
+  find_bound function:
+  This function returns the search space of a field of StrategyParams (NULL if the field is not tuned).
+*/
+static const bound *find_bound(int param){
+  for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++){
+    if (strcmp(bounds[i].name, strategyParamName(param)) == 0) return &bounds[i];
+  }
+  return NULL;
+}
+
+/*
+  clamp_param function:
+  This function brings a value back into the search space of its field (and rounds it if needed).
+*/
+static double clamp_param(const bound *b, double value){
+  if (b->integer) value = floor(value + 0.5);
+  if (value < b->min) value = b->min;
+  if (value > b->max) value = b->max;
+  return value;
+}
+
+/*
+  gaussian function:
+  This function draws a number from the standard normal distribution (Box-Muller).
+*/
+static double gaussian(uint64_t *rng){
+  double u = ((sim_random(rng) >> 11) + 1.0) / 9007199254740993.0; //In ]0, 1]
+  double v = (sim_random(rng) >> 11) / 9007199254740992.0;
+  return sqrt(-2 * log(u)) * cos(2 * 3.14159265358979323846 * v);
+}
+
+static int compare_candidates(const void *a, const void *b){
+  double x = ((const candidate *)a)->score, y = ((const candidate *)b)->score;
+  return (x < y) - (x > y); //Best first
+}
+
+/*
+  evaluate function:
+  This function plays every candidate on the games seed .. seed+games-1 (all the games of all the candidates
+  in one run of the pool) and sets their mean scores.
+*/
+static void evaluate(evaluation *e, candidate *cands, int ncands, long games, uint64_t seed){
+  StrategyParams *params = malloc(ncands * sizeof(StrategyParams));
+  long *scores = malloc((size_t)ncands * games * sizeof(long));
+  if (params == NULL || scores == NULL){
+    for (int c = 0; c < ncands; c++) cands[c].score = 0;
+    free(params);
+    free(scores);
+    return;
+  }
+
+  for (int c = 0; c < ncands; c++) params[c] = cands[c].params;
+  e->candidates = params;
+  e->games = games;
+  e->seed = seed;
+  e->scores = scores;
+  workpool_run((long)ncands * games, e->set->threads, play_game, e, NULL);
+
+  for (int c = 0; c < ncands; c++){
+    double sum = 0;
+    for (long g = 0; g < games; g++) sum += scores[(long)c * games + g];
+    cands[c].score = sum / games;
+  }
+  free(params);
+  free(scores);
+}
+
+/*
+  tune_level function:
+  This function runs the grid search, the cross-entropy search and the validation on a level,
+  then writes the best parameter set for its map size.
+*/
+static bool tune_level(const settings *set, const char *filename, FILE *out){
+  sim_level level;
+  if (!sim_level_read(&level, filename)) return false;
+
+  int nparams = strategyParamCount();
+  int gridSize = 1;
+  for (int i = 0; i < GRID_PARAMS; i++) gridSize *= 3;
+  int ncands = gridSize > set->population ? gridSize : set->population;
+  candidate *cands = malloc(ncands * sizeof(candidate));
+  slot *slots = calloc(set->threads, sizeof(slot));
+  double *mean = malloc(nparams * sizeof(double));
+  double *sigma = malloc(nparams * sizeof(double));
+  if (cands == NULL || slots == NULL || mean == NULL || sigma == NULL){
+    fprintf(stderr, "Not enough memory\n");
+    return false;
+  }
+
+  evaluation e = {set, &level, NULL, 0, 0, 10L * level.freecells, slots, NULL};
+  StrategyParams defaults;
+  defaultStrategyParams(&defaults);
+  double start = now();
+
+  //1. Grid: each threshold at its default, or halfway to one of its bounds
+  for (int c = 0; c < gridSize; c++){
+    cands[c].params = defaults;
+    for (int i = 0, code = c; i < GRID_PARAMS; i++, code /= 3){
+      const bound *b = find_bound(i);
+      double *value = strategyParam(&cands[c].params, i);
+      if (b == NULL) continue;
+      if (code % 3 == 1) *value = clamp_param(b, (b->min + *value) / 2);
+      if (code % 3 == 2) *value = clamp_param(b, (*value + b->max) / 2);
+    }
+  }
+  evaluate(&e, cands, gridSize, set->games, set->seed);
+  qsort(cands, gridSize, sizeof(candidate), compare_candidates);
+  candidate best = cands[0];
+  fprintf(stderr, "%s: grid of %d sets, best mean score %.2f\n", filename, gridSize, best.score);
+
+  //2. Cross-entropy search around the best set
+  for (int i = 0; i < nparams; i++){
+    const bound *b = find_bound(i);
+    mean[i] = *strategyParam(&best.params, i);
+    sigma[i] = (b != NULL) ? (b->max - b->min) / 4 : 0;
+  }
+  uint64_t rng = set->seed ^ 0x5DEECE66DULL;
+  int elite = set->population / 4;
+  for (int it = 0; it < set->iterations; it++){
+    cands[0] = best; //The best set so far is always played again
+    for (int c = 1; c < set->population; c++){
+      cands[c].params = defaults;
+      for (int i = 0; i < nparams; i++){
+        const bound *b = find_bound(i);
+        if (b != NULL) *strategyParam(&cands[c].params, i) = clamp_param(b, mean[i] + sigma[i] * gaussian(&rng));
+      }
+    }
+    evaluate(&e, cands, set->population, set->games, set->seed);
+    qsort(cands, set->population, sizeof(candidate), compare_candidates);
+    if (cands[0].score > best.score) best = cands[0];
+
+    //Mean and spread of the elite (the spread is smoothed, and never drops under 1% of the search space)
+    for (int i = 0; i < nparams; i++){
+      const bound *b = find_bound(i);
+      if (b == NULL) continue;
+      double sum = 0, squares = 0;
+      for (int c = 0; c < elite; c++) sum += *strategyParam(&cands[c].params, i);
+      mean[i] = sum / elite;
+      for (int c = 0; c < elite; c++){
+        double d = *strategyParam(&cands[c].params, i) - mean[i];
+        squares += d * d;
+      }
+      sigma[i] = 0.7 * sqrt(squares / elite) + 0.3 * sigma[i];
+      if (sigma[i] < (b->max - b->min) / 100) sigma[i] = (b->max - b->min) / 100;
+    }
+    fprintf(stderr, "%s: iteration %d, best mean score %.2f (this iteration %.2f)\n", filename, it + 1, best.score, cands[0].score);
+  }
+
+  //3. Validation on other games
+  cands[0].params = defaults;
+  cands[1] = best;
+  evaluate(&e, cands, 2, set->validate, set->seed + VALIDATION_SEED);
+  bool better = cands[1].score > cands[0].score;
+  fprintf(stderr, "%s: validation on %ld games, defaults %.2f, tuned %.2f%s (%.1f s)\n", filename, set->validate,
+          cands[0].score, cands[1].score, better ? "" : ", defaults kept", now() - start);
+  fprintf(out, "# %s: mean score %.2f (defaults %.2f)\n", filename, better ? cands[1].score : cands[0].score, cands[0].score);
+  writeStrategyParams(out, level.xsize, level.ysize, better ? &best.params : &defaults);
+  fflush(out);
+
+  for (int i = 0; i < set->threads; i++){
+    if (!slots[i].ready) continue;
+    sim_game_free(&slots[i].game);
+    freeGameContext(slots[i].ctx);
+  }
+  free(cands);
+  free(slots);
+  free(mean);
+  free(sigma);
+  sim_level_free(&level);
+  return true;
+}
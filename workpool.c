@@ -0,0 +1,190 @@
+/*
+  Work-stealing pool, see workpool.h.
+  Tasks are plain indexes, so a share of tasks is a range [begin, end) protected by its own lock:
+  the owner pops begin, thieves cut end. Locks are only contended during steals, which are rare
+  compared to the tasks (whole games).
+*/
+#define _POSIX_C_SOURCE 200809L // sysconf
+
+// compiler's header files
+#include <pthread.h> // pthread_create, pthread_join, pthread_mutex_*
+#include <stdbool.h> // bool, true, false
+#include <stdlib.h> // calloc, free
+#include <unistd.h> // sysconf
+
+// main program's header files
+#include "workpool.h"
+
+/*
+  share struct, the tasks a worker still has to run, padded to its own cache lines
+*/
+typedef struct {
+  pthread_mutex_t lock; // protects begin and end
+  long begin; // next task to run
+  long end; // end of the range (excluded)
+  long steals; // number of steals made by this worker
+  char padding[64]; // keeps two shares off the same cache line
+} share;
+
+/*
+  pool struct, shared by the workers of a run
+*/
+typedef struct {
+  share *shares; // one share per worker
+  int nthreads; // number of workers
+  workpool_task run; // function running a task
+  void *data; // data given to run
+} pool;
+
+/*
+  worker struct, the argument of a worker thread
+*/
+typedef struct {
+  pool *pool; // pool of the run
+  int id; // number of the worker
+} worker;
+
+// prototypes of the local/private functions
+static bool pop_task(share *, long *);
+static bool steal_tasks(pool *, int);
+static void *worker_main(void *);
+
+/*
+  workpool_default_threads function:
+  This function returns the number of online cores (at least 1).
+*/
+int workpool_default_threads(void){
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+/*
+  pop_task function:
+  This function takes the next task of a share, and returns false if the share is empty.
+*/
+static bool pop_task(share *sh, long *task){
+  bool found = false;
+  pthread_mutex_lock(&sh->lock);
+  if (sh->begin < sh->end){
+    *task = sh->begin++;
+    found = true;
+  }
+  pthread_mutex_unlock(&sh->lock);
+  return found;
+}
+
+/*
+  steal_tasks function:
+  This function moves the back half of the largest share left to the share of the thief (which is empty).
+  It returns false when there is nothing left to steal: all the tasks are running or done.
+*/
+static bool steal_tasks(pool *p, int thief){
+  for (;;){
+    //Largest share left
+    int victim = -1;
+    long largest = 0;
+    for (int i = 0; i < p->nthreads; i++){
+      if (i == thief) continue;
+      pthread_mutex_lock(&p->shares[i].lock);
+      long left = p->shares[i].end - p->shares[i].begin;
+      pthread_mutex_unlock(&p->shares[i].lock);
+      if (left > largest){
+        largest = left;
+        victim = i;
+      }
+    }
+    if (victim < 0) return false;
+
+    //Cut its back half (it may have shrunk in the meantime)
+    share *sh = &p->shares[victim];
+    long begin = 0, end = 0;
+    pthread_mutex_lock(&sh->lock);
+    long left = sh->end - sh->begin;
+    if (left > 0){
+      end = sh->end;
+      begin = sh->end - (left + 1) / 2;
+      sh->end = begin;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    if (left <= 0) continue; //Emptied by its owner or another thief, look again
+
+    share *own = &p->shares[thief];
+    pthread_mutex_lock(&own->lock);
+    own->begin = begin;
+    own->end = end;
+    own->steals++;
+    pthread_mutex_unlock(&own->lock);
+    return true;
+  }
+}
+
+/*
+  worker_main function:
+  This function runs the tasks of a worker's share, then steals more until there are none left.
+*/
+static void *worker_main(void *arg){
+  worker *w = arg;
+  pool *p = w->pool;
+  long task;
+
+  do {
+    while (pop_task(&p->shares[w->id], &task)){
+      p->run(p->data, w->id, task);
+    }
+  } while (steal_tasks(p, w->id));
+  return NULL;
+}
+
+/*
+  workpool_run function:
+  This function runs the tasks 0 .. ntasks-1 with nthreads workers (the calling thread is worker 0),
+  and returns when all of them are done. It returns false if some workers could not be started
+  (their tasks are then stolen by the others, so all the tasks are still run).
+*/
+bool workpool_run(long ntasks, int nthreads, workpool_task run, void *data, workpool_stats *stats){
+  if (nthreads < 1) nthreads = 1;
+  if (nthreads > ntasks && ntasks > 0) nthreads = (int)ntasks;
+  if (stats != NULL){
+    stats->threads = nthreads;
+    stats->steals = 0;
+  }
+
+  pool p = {calloc(nthreads, sizeof(share)), nthreads, run, data};
+  worker *workers = calloc(nthreads, sizeof(worker));
+  pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+  bool *started = calloc(nthreads, sizeof(bool));
+  if (p.shares == NULL || workers == NULL || threads == NULL || started == NULL){
+    free(p.shares);
+    free(workers);
+    free(threads);
+    free(started);
+    return false;
+  }
+
+  //Contiguous shares of (almost) the same size
+  for (int i = 0; i < nthreads; i++){
+    pthread_mutex_init(&p.shares[i].lock, NULL);
+    p.shares[i].begin = ntasks * i / nthreads;
+    p.shares[i].end = ntasks * (i + 1) / nthreads;
+    workers[i].pool = &p;
+    workers[i].id = i;
+  }
+
+  bool ok = true;
+  for (int i = 1; i < nthreads; i++){
+    started[i] = (pthread_create(&threads[i], NULL, worker_main, &workers[i]) == 0);
+    if (!started[i]) ok = false; //Its share gets stolen by the others
+  }
+  worker_main(&workers[0]);
+  for (int i = 1; i < nthreads; i++){
+    if (started[i]) pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; stats != NULL && i < nthreads; i++) stats->steals += p.shares[i].steals;
+  for (int i = 0; i < nthreads; i++) pthread_mutex_destroy(&p.shares[i].lock);
+  free(p.shares);
+  free(workers);
+  free(threads);
+  free(started);
+  return ok;
+}
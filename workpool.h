@@ -0,0 +1,27 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stdbool.h> // bool
+
+/*
+  Work-stealing pool running a fixed number of independent tasks (0 .. ntasks-1) on several threads.
+  Each worker starts with a contiguous share of the tasks and takes them from the front of its share;
+  a worker that runs out steals the back half of the largest share left, so that long tasks on one
+  worker don't leave the others idle.
+*/
+
+// function running one task, on the worker numbered worker (0 .. nthreads-1)
+typedef void (*workpool_task)(void *data, int worker, long task);
+
+/*
+  workpool_stats struct, what happened during a run
+*/
+typedef struct {
+  int threads; // number of workers
+  long steals; // number of successful steals
+} workpool_stats;
+
+int workpool_default_threads(void);
+bool workpool_run(long ntasks, int nthreads, workpool_task run, void *data, workpool_stats *stats);
+
+#endif